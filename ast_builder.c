@@ -2,12 +2,14 @@
 #include <ctype.h> // isalnum
 #include <stddef.h>
 #include <string.h> // cmp
+#include <stdatomic.h>
+#include <pthread.h>
 
 #include "ast_builder.h"
 #include "dynarray.h"
 #include "tokenizer.h"
 
-const char * ast_builder_errmsg;
+_Thread_local const char * ast_builder_errmsg; // per thread, see ast_build_parallel
 
 void print_wchar(uint32_t type) {
     for (int i = 3; i >= 0; --i) {
@@ -61,7 +63,8 @@ void ast_free_node(AST_Node * node) {
     for (size_t i = 0; i < node->count; ++i) {
         ast_free_node(node->items + i);
     }
-    da_free(node);
+    if (node->capacity) da_free(node); // capacity 0: children borrowed from a cache image
+    else node->count = 0;
 }
 /*
 void ast_free(AST * ast) {
@@ -83,11 +86,13 @@ typedef struct {
     AST_Node * parent;
     Token * begin;
     Token * end; // past end
+    int lazy; // function bodies are only brace matched, see `ast_build_lazy`
 } AST_Builder_Frame;
 
 int ast_parse_DECL(AST_Builder_Frame * frame);
 int ast_parse_FUNC(AST_Builder_Frame * frame);
 int ast_parse_BLCK(AST_Builder_Frame * frame);
+int ast_skip_BLCK(AST_Builder_Frame * frame);
 
 int ast_parse_stmt(AST_Builder_Frame * frame);
 int ast_parse_IFEL(AST_Builder_Frame * frame);
@@ -136,6 +141,171 @@ int ast_build(AST_Node * top, Tokenizer * tok) {
     return 0;
 }
 
+int ast_build_lazy(AST_Node * top, Tokenizer * tok) {
+    *top = (AST_Node) {'TOP'};
+
+    AST_Builder_Frame frame = {
+        .parent = top,
+        .begin  = tok->items,
+        .end    = tok->items + tok->count,
+        .lazy   = 1,
+    };
+
+    // (DECL|FUNC)*
+    while (frame.begin < frame.end) {
+        if (ast_parse_DECL(&frame) &&
+            ast_parse_FUNC(&frame)) error("Invalid top level code");
+    }
+    return 0;
+}
+
+int ast_parse_lazy(AST_Node * func) {
+    AST_Node * lazy = func->items + func->count - 1;
+    AST_Node body = {'TOP'}; // only a container
+    AST_Builder_Frame frame = {
+        .parent = &body,
+        .begin  = lazy->token,
+        .end    = lazy->items[0].token + 1,
+    };
+    if (ast_parse_BLCK(&frame)) return 1;
+    if (frame.begin != frame.end) {
+        ast_free_node(&body);
+        error("Invalid block syntax");
+    }
+    ast_free_node(lazy);
+    *lazy = body.items[0];
+    free(body.items);
+    return 0;
+}
+
+int ast_build_items(AST_Node * top, Token * begin, Token * end, int stmts) {
+    *top = (AST_Node) {'TOP'};
+
+    AST_Builder_Frame frame = {
+        .parent = top,
+        .begin  = begin,
+        .end    = end,
+    };
+
+    // (DECL|FUNC|stmt)*, a DECL is a global
+    while (frame.begin < frame.end) {
+        if (ast_parse_DECL(&frame) &&
+            ast_parse_FUNC(&frame) &&
+            (!stmts || ast_parse_stmt(&frame))) {
+            ast_free_node(top);
+            error(stmts ? "Invalid top level code or statement" : "Invalid top level code");
+        }
+    }
+    return 0;
+}
+
+// a run of top level items, parsed into its own 'TOP'
+typedef struct {
+    Token * begin;
+    Token * end;
+    AST_Node top;
+    const char * errmsg; // NULL if parsed
+} AST_Chunk;
+
+typedef struct {
+    AST_Chunk * items;
+    size_t count;
+    size_t capacity;
+    atomic_size_t next; // next chunk to be claimed
+} AST_Chunks;
+
+static const size_t AST_CHUNK_MIN_TOKENS = 4096;
+
+// `;` or a `}` closing back to depth 0, found by brace matching only
+Token * ast_item_end(Token * begin, Token * end) {
+    long depth = 0;
+    for (Token * cursor = begin; cursor < end; ++cursor) {
+        if (cursor->len != 1) continue;
+        char c = cursor->begin[0];
+        if (c == '{') depth += 1;
+        else if (c == '}') depth -= 1;
+        else if (c != ';') continue;
+        if (depth == 0 && c != '{') return cursor + 1;
+    }
+    return end; // possibly unbalanced: the parser will complain
+}
+
+// split at the end of top level items
+static void ast_split_chunks(AST_Chunks * chunks, Tokenizer * tok) {
+    Token * end = tok->items + tok->count;
+    Token * chunk_begin = tok->items;
+    for (Token * cursor = tok->items; cursor < end; ) {
+        cursor = ast_item_end(cursor, end);
+        if (cursor - chunk_begin >= AST_CHUNK_MIN_TOKENS || cursor == end) {
+            da_append(chunks, ((AST_Chunk) {chunk_begin, cursor}));
+            chunk_begin = cursor;
+        }
+    }
+}
+
+static void ast_parse_chunk(AST_Chunk * chunk) {
+    chunk->top = (AST_Node) {'TOP'};
+    AST_Builder_Frame frame = {
+        .parent = &chunk->top,
+        .begin  = chunk->begin,
+        .end    = chunk->end,
+    };
+    while (frame.begin < frame.end) {
+        if (ast_parse_DECL(&frame) &&
+            ast_parse_FUNC(&frame)) {
+            chunk->errmsg = "Invalid top level code";
+            return;
+        }
+    }
+}
+
+static void * ast_chunk_worker(void * arg) {
+    AST_Chunks * chunks = arg;
+    size_t i;
+    while ((i = atomic_fetch_add(&chunks->next, 1)) < chunks->count) {
+        ast_parse_chunk(chunks->items + i);
+    }
+    return NULL;
+}
+
+int ast_build_parallel(AST_Node * top, Tokenizer * tok, int n_threads) {
+    AST_Chunks chunks = {};
+    ast_split_chunks(&chunks, tok);
+    if (n_threads <= 1 || chunks.count <= 1) {
+        da_free(&chunks);
+        return ast_build(top, tok);
+    }
+    if (n_threads > chunks.count) n_threads = chunks.count;
+    atomic_init(&chunks.next, 0);
+
+    // the calling thread is worker 0
+    pthread_t * threads = (pthread_t *)malloc(n_threads * sizeof(pthread_t));
+    int n_started = 1;
+    for (; n_started < n_threads; ++n_started) {
+        if (pthread_create(threads + n_started, NULL, ast_chunk_worker, &chunks)) break;
+    }
+    ast_chunk_worker(&chunks);
+    for (int i = 1; i < n_started; ++i) pthread_join(threads[i], NULL);
+    free(threads);
+
+    // merge in source order, report the first error in source order
+    *top = (AST_Node) {'TOP'};
+    int status = 0;
+    for (size_t i = 0; i < chunks.count; ++i) {
+        AST_Chunk * chunk = chunks.items + i;
+        if (chunk->errmsg && !status) {
+            ast_builder_errmsg = chunk->errmsg;
+            status = 1;
+        }
+        for (size_t j = 0; j < chunk->top.count; ++j) {
+            da_append(top, chunk->top.items[j]);
+        }
+        free(chunk->top.items); // only the container, children moved
+    }
+    da_free(&chunks);
+    return status;
+}
+
 #define tokstrcmp(tok, str) strncmp(str, (tok)->begin, (tok)->len)
 
 
@@ -151,6 +321,7 @@ int ast_build(AST_Node * top, Tokenizer * tok) {
         .parent = &node,                                                \
         .begin = frame->begin,                                          \
         .end = frame->end,                                              \
+        .lazy = frame->lazy,                                            \
     }
 
 #define parse_fin()                             \
@@ -195,7 +366,7 @@ int ast_parse_FUNC(AST_Builder_Frame * frame) {
     }
     if (ast_parse_exact(&subframe, ")")) error_free(errmsg);
 
-    if (ast_parse_BLCK(&subframe)) error_free(errmsg);
+    if (subframe.lazy ? ast_skip_BLCK(&subframe) : ast_parse_BLCK(&subframe)) error_free(errmsg);
     
     parse_fin();
 }
@@ -207,6 +378,22 @@ int ast_parse_BLCK(AST_Builder_Frame * frame) {
     parse_fin();
 }
 
+// 'LAZY': the `{` of a block, and its `}` as the only child
+int ast_skip_BLCK(AST_Builder_Frame * frame) {
+    parse_init('LAZY', "Invalid block syntax");
+    node.token = subframe.begin;
+    if (ast_parse_exact(&subframe, "{")) error_free(errmsg);
+    long depth = 1;
+    for (; subframe.begin < subframe.end && depth; ++subframe.begin) {
+        if (subframe.begin->len != 1) continue;
+        if (subframe.begin->begin[0] == '{') depth += 1;
+        if (subframe.begin->begin[0] == '}') depth -= 1;
+    }
+    if (depth) error_free(errmsg_eof);
+    da_append(&node, ((AST_Node) {'EXCT', subframe.begin - 1}));
+    parse_fin();
+}
+
 // stmt
 int ast_parse_stmt(AST_Builder_Frame * frame) {
     // alternative structure
@@ -232,6 +419,7 @@ int ast_parse_IFEL(AST_Builder_Frame * frame) {
 }
 int ast_parse_WHIL(AST_Builder_Frame * frame) {
     parse_init('WHIL', "Invalid while loop");
+    node.token = subframe.begin; // `while`, to locate the loop
     if (ast_parse_exact(&subframe, "while")) error_free(errmsg);
     if (ast_parse_exact(&subframe, "(")) error_free(errmsg);
     if (ast_parse_EXPR(&subframe)) error_free(errmsg);
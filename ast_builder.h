@@ -11,8 +11,9 @@
   
   TOP : (DECL|FUNC)*      -- technically +
       
-  FUNC: int IDEN ( [int IDEN] (, int IDEN)* ) BLCK
+  FUNC: int IDEN ( [int IDEN] (, int IDEN)* ) BLCK|LAZY
   BLCK: { stmt* }
+  LAZY: { ... }                 -- unparsed, see ast_build_lazy
   DECL: int IDEN [ LITR ] ... ;
       
   stmt: collectively referring to:
@@ -42,7 +43,7 @@
   IDEN: TOKN that is [a-zA-Z_][a-zA-Z0-9_]*
 */
 
-extern const char * ast_builder_errmsg;
+extern _Thread_local const char * ast_builder_errmsg;
 
 typedef struct AST_Node {
     uint32_t type;
@@ -55,6 +56,9 @@ typedef struct AST_Node {
     struct AST_Node * items;
     size_t count;
     size_t capacity;
+
+    // analysis result attached by the cvm, NULL if none (see cvm.c)
+    struct CVM_Annot * annot;
 } AST_Node;
 /*
 typedef struct {
@@ -75,6 +79,17 @@ typedef struct {
 
 // int ast_build(AST * ast, Tokenizer * tok); // return 1 on fail
 int ast_build(AST_Node * ast, Tokenizer * tok); // return 1 on fail
+// same tree as `ast_build`, with top level items parsed on `n_threads` threads
+int ast_build_parallel(AST_Node * ast, Tokenizer * tok, int n_threads); // return 1 on fail
+// same tree as `ast_build`, except that each function body is a 'LAZY' node:
+// its tokens are only brace matched, `ast_parse_lazy` parses it on demand
+int ast_build_lazy(AST_Node * ast, Tokenizer * tok); // return 1 on fail
+// replace the 'LAZY' body of a 'FUNC' with its 'BLCK', the tree is unchanged on fail
+int ast_parse_lazy(AST_Node * func); // return 1 on fail
+// the end of the top level item at `begin`: past its `;` or closing `}`
+Token * ast_item_end(Token * begin, Token * end);
+// top level items of a token range and, if `stmts`, statements as well (REPL)
+int ast_build_items(AST_Node * ast, Token * begin, Token * end, int stmts); // return 1 on fail
 // void ast_free(AST * ast);
 void ast_free_node(AST_Node * node);
 // void ast_print(AST ast);
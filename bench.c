@@ -0,0 +1,159 @@
+// scaling benchmark of the tokenizer, ast_builder and cvm on generated programs, see gen.h
+// prints one gnuplot data block per parameter:
+//   gnuplot> plot 'bench.dat' index 0 using 3:6 with linespoints  # build time over tokens
+
+#include <stdio.h>
+#include <stddef.h> // size_t
+#include <stdlib.h> // memory
+#include <string.h> // strcmp
+#include <math.h> // log
+#include <time.h> // clock_gettime
+#include <malloc.h> // mallinfo2
+
+#include "gen.h"
+#include "tokenizer.h"
+#include "ast_builder.h"
+#include "cvm.h"
+
+typedef struct {
+    const char * name;
+    int * field; // in the config being swept
+    int values[8]; // -1 ended
+} Sweep;
+
+typedef struct {
+    size_t bytes, tokens, steps;
+    double time[3]; // tokenize, ast_build, cvm_run, best of the reps
+    size_t memory[3]; // heap growth of the token array, of the AST, and arrays of the run
+} Point;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static size_t heap_used() {
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd; // large blocks are mmap'ed
+}
+
+// return 1 on fail
+static int bench_point(Point * point, const Gen_Config * config, int reps, FILE * os) {
+    *point = (Point) {};
+    for (int rep = 0; rep < reps; ++rep) {
+        Tokenizer tok = {};
+        tok.buffer = gen_program(config);
+        point->bytes = strlen(tok.buffer);
+
+        size_t heap = heap_used();
+        double t = now();
+        if (Tokenizer_tokenize(&tok)) {
+            printf("ERROR: Tokenizer: %s\n", tok.errmsg);
+            Tokenizer_free(&tok);
+            return 1;
+        }
+        double times[3];
+        times[0] = now() - t;
+        point->tokens = tok.count;
+        point->memory[0] = heap_used() - heap;
+
+        AST_Node ast = {};
+        heap = heap_used();
+        t = now();
+        int status = ast_build(&ast, &tok);
+        times[1] = now() - t;
+        point->memory[1] = heap_used() - heap;
+        if (status) {
+            printf("ERROR: AST Builder: %s\n", ast_builder_errmsg);
+            ast_free_node(&ast);
+            Tokenizer_free(&tok);
+            return 1;
+        }
+
+        int ret_val;
+        t = now();
+        status = cvm_run(&ret_val, &ast, stdin, os);
+        times[2] = now() - t;
+        point->steps = cvm_stats.steps;
+        point->memory[2] = cvm_stats.memory_max;
+        ast_free_node(&ast);
+        Tokenizer_free(&tok);
+        if (status) {
+            printf("ERROR: CVM: %s\n", cvm_errmsg ? cvm_errmsg : "syntax error");
+            return 1;
+        }
+        for (int i = 0; i < 3; ++i) {
+            if (rep == 0 || times[i] < point->time[i]) point->time[i] = times[i];
+        }
+    }
+    return 0;
+}
+
+// slope of log(time) over log(size) between the first and last points, 1 is linear;
+// the size is the token count for the front end, executed statements for the run
+static double growth(const Point * first, const Point * last, int stage) {
+    double from = stage < 2 ? first->tokens : first->steps;
+    double to = stage < 2 ? last->tokens : last->steps;
+    if (from == to || from == 0 || first->time[stage] <= 0) return NAN;
+    return log(last->time[stage] / first->time[stage]) / log(to / from);
+}
+
+int main(int argc, char ** argv) {
+    Gen_Config config = GEN_DEFAULTS;
+    int reps = 3;
+    const char * only = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            config.seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+            reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--only") == 0 && i + 1 < argc) {
+            only = argv[++i];
+        } else {
+            printf("Usage: %s [--seed <n>] [--reps <n>] [--only funcs|depth|nesting|dims|loops]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (reps < 1) reps = 1;
+    FILE * os = fopen("/dev/null", "w");
+    if (!os) {
+        printf("ERROR: Cannot open /dev/null.\n");
+        return 1;
+    }
+
+    const Gen_Config base = config;
+    Sweep sweeps[] = {
+        {"funcs", &config.n_funcs, {16, 64, 256, 1024, -1}},
+        {"depth", &config.expr_depth, {2, 4, 8, 16, 32, 64, -1}},
+        {"nesting", &config.nesting, {0, 2, 4, 6, -1}},
+        {"dims", &config.n_dims, {1, 2, 3, 4, 6, -1}},
+        {"loops", &config.loop_count, {1, 4, 16, 64, 256, -1}},
+    };
+    int status = 0;
+    for (size_t s = 0; s < sizeof(sweeps) / sizeof(*sweeps) && !status; ++s) {
+        Sweep * sweep = sweeps + s;
+        if (only && strcmp(only, sweep->name)) continue;
+        printf("# %s\n", sweep->name);
+        printf("# %-8s %10s %10s %10s %12s %12s %12s %12s %12s %12s\n", "value", "bytes", "tokens", "steps",
+               "tokenize_s", "build_s", "run_s", "tok_mem", "ast_mem", "array_mem");
+        Point first, last;
+        for (int i = 0; sweep->values[i] >= 0; ++i) {
+            config = base;
+            *sweep->field = sweep->values[i];
+            status = bench_point(&last, &config, reps, os);
+            if (status) break;
+            if (i == 0) first = last;
+            printf("  %-8d %10zu %10zu %10zu %12.6f %12.6f %12.6f %12zu %12zu %12zu\n", sweep->values[i],
+                   last.bytes, last.tokens, last.steps, last.time[0], last.time[1], last.time[2],
+                   last.memory[0], last.memory[1], last.memory[2]);
+            fflush(stdout);
+        }
+        if (!status) {
+            printf("# growth: tokenize %.2f, build %.2f over tokens, run %.2f over steps\n\n\n",
+                   growth(&first, &last, 0), growth(&first, &last, 1), growth(&first, &last, 2));
+        }
+    }
+    fclose(os);
+    return status;
+}
@@ -0,0 +1,298 @@
+#include <stdio.h> // file
+#include <stddef.h> // size_t
+#include <stdint.h>
+#include <stdlib.h> // memory
+#include <string.h> // memcmp
+#include <fcntl.h> // open
+#include <unistd.h> // close, getpid
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat, mkdir
+#include <stdatomic.h>
+
+#include "cache.h"
+#include "dynarray.h"
+#include "tokenizer.h"
+#include "ast_builder.h"
+
+#define CACHE_MAGIC "CVMC"
+#define CACHE_VERSION 3
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t hash;
+    uint64_t srclen;
+    uint32_t n_tokens;
+    uint32_t n_nodes;
+} Cache_Header;
+
+typedef struct {
+    uint32_t offset;
+    uint32_t len;
+} Cache_Token;
+
+typedef struct {
+    uint32_t type;
+    int32_t token; // -1 for none
+    uint32_t first;
+    uint32_t count;
+} Cache_Node;
+
+#define CACHE_RESULT_MAGIC "CVMR"
+#define CACHE_RESULT_VERSION 2
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    int32_t status;
+    uint32_t reserved;
+    uint64_t steps;
+    uint64_t depth_max;
+    uint64_t memory_max;
+    double time;
+    uint64_t output_len;
+    uint64_t message_len;
+} Cache_Result_Header;
+
+uint64_t cache_hash_add(uint64_t h, const char * data, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+uint64_t cache_hash(const char * data, size_t len) {
+    return cache_hash_add(14695981039346656037ULL, data, len); // FNV-1a
+}
+
+// of the source, and of whether its AST is lazy
+static uint64_t cache_key(const char * source, size_t srclen, int lazy) {
+    uint64_t hash = cache_hash(source, srclen);
+    return lazy ? cache_hash_add(hash, "LAZY", 4) : hash;
+}
+
+static void cache_path(char * path, size_t size, const char * dir, uint64_t hash, const char * ext) {
+    snprintf(path, size, "%s/%016llx.%s", dir, (unsigned long long)hash, ext);
+}
+
+// entries are written to a temporary file, then renamed over `path`
+static FILE * cache_create(const char * dir, const char * path, char * tmppath, size_t size) {
+    mkdir(dir, 0755); // ok if exists
+    // unique per store, threads of a server may store the same entry at once
+    static atomic_uint n_stores = 0;
+    snprintf(tmppath, size, "%s.tmp%d.%u", path, (int)getpid(), atomic_fetch_add(&n_stores, 1));
+    return fopen(tmppath, "wb");
+}
+
+static int cache_commit(FILE * fp, int failed, const char * tmppath, const char * path) {
+    if (fclose(fp) || failed || rename(tmppath, path)) {
+        remove(tmppath);
+        return 1;
+    }
+    return 0;
+}
+
+int cache_load(AST_Node * ast, Tokenizer * tok, const char * dir, int lazy) {
+    size_t srclen = strlen(tok->buffer);
+    uint64_t hash = cache_key(tok->buffer, srclen, lazy);
+    char path[4096];
+    cache_path(path, sizeof(path), dir, hash, "cvmc");
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 1;
+    struct stat st;
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(Cache_Header)) {
+        close(fd);
+        return 1;
+    }
+    size_t filelen = st.st_size;
+    const char * image = mmap(NULL, filelen, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) return 1;
+
+    // validate before trusting any index
+    const Cache_Header * header = (const Cache_Header *)image;
+    if (memcmp(header->magic, CACHE_MAGIC, 4) ||
+        header->version != CACHE_VERSION ||
+        header->hash != hash ||
+        header->srclen != srclen ||
+        header->n_nodes == 0 ||
+        filelen != sizeof(Cache_Header)
+                   + header->n_tokens * sizeof(Cache_Token)
+                   + header->n_nodes * sizeof(Cache_Node)) {
+        munmap((void *)image, filelen);
+        return 1;
+    }
+    const Cache_Token * ctoks = (const Cache_Token *)(header + 1);
+    const Cache_Node * cnodes = (const Cache_Node *)(ctoks + header->n_tokens);
+    size_t n_tokens = header->n_tokens;
+    size_t n_nodes = header->n_nodes;
+
+    for (size_t i = 0; i < n_tokens; ++i) {
+        if ((size_t)ctoks[i].offset + ctoks[i].len > srclen) goto corrupt;
+    }
+    for (size_t i = 0; i < n_nodes; ++i) {
+        if (cnodes[i].token >= (int64_t)n_tokens) goto corrupt;
+        if (cnodes[i].count > 0 &&
+            (cnodes[i].first <= i ||
+             (size_t)cnodes[i].first + cnodes[i].count > n_nodes)) goto corrupt;
+    }
+
+    // tokens: one array, owned by `tok` as usual
+    tok->items = (Token *)malloc(n_tokens * sizeof(Token) + 1);
+    tok->count = tok->capacity = n_tokens;
+    for (size_t i = 0; i < n_tokens; ++i) {
+        tok->items[i] = (Token) {tok->buffer + ctoks[i].offset, ctoks[i].len};
+    }
+
+    // nodes: one array for everything below 'TOP', owned by 'TOP'
+    // the other nodes borrow their children from it (capacity 0)
+    AST_Node * pool = (AST_Node *)calloc(n_nodes, sizeof(AST_Node));
+    for (size_t i = 1; i < n_nodes; ++i) {
+        const Cache_Node * c = cnodes + i;
+        pool[i - 1] = (AST_Node) {
+            .type = c->type,
+            .token = c->token < 0 ? NULL : tok->items + c->token,
+            .items = c->count ? pool + c->first - 1 : NULL,
+            .count = c->count,
+        };
+    }
+    *ast = (AST_Node) {
+        .type = cnodes[0].type,
+        .items = pool,
+        .count = cnodes[0].count,
+        .capacity = cnodes[0].count,
+    };
+    if (ast->count == 0) {
+        free(pool);
+        ast->items = NULL;
+    }
+    munmap((void *)image, filelen);
+    return 0;
+
+corrupt:
+    munmap((void *)image, filelen);
+    return 1;
+}
+
+int cache_store(AST_Node * ast, Tokenizer * tok, const char * dir, int lazy) {
+    size_t srclen = strlen(tok->buffer);
+    Cache_Header header = {
+        .magic = CACHE_MAGIC,
+        .version = CACHE_VERSION,
+        .hash = cache_key(tok->buffer, srclen, lazy),
+        .srclen = srclen,
+        .n_tokens = tok->count,
+    };
+
+    // breadth first, so that siblings stay contiguous
+    struct {
+        AST_Node ** items;
+        size_t count;
+        size_t capacity;
+    } queue = {};
+    struct {
+        Cache_Node * items;
+        size_t count;
+        size_t capacity;
+    } cnodes = {};
+    da_append(&queue, ast);
+    for (size_t i = 0; i < queue.count; ++i) {
+        AST_Node * node = queue.items[i];
+        Cache_Node c = {
+            .type = node->type,
+            .token = node->token ? (int32_t)(node->token - tok->items) : -1,
+            .first = node->count ? queue.count : 0,
+            .count = node->count,
+        };
+        da_append(&cnodes, c);
+        for (size_t j = 0; j < node->count; ++j) {
+            da_append(&queue, node->items + j);
+        }
+    }
+    da_free(&queue);
+    header.n_nodes = cnodes.count;
+
+    char path[4096], tmppath[4096 + 32];
+    cache_path(path, sizeof(path), dir, header.hash, "cvmc");
+    FILE * fp = cache_create(dir, path, tmppath, sizeof(tmppath));
+    if (!fp) {
+        da_free(&cnodes);
+        return 1;
+    }
+    int failed = fwrite(&header, sizeof(header), 1, fp) != 1;
+    for (size_t i = 0; i < tok->count && !failed; ++i) {
+        Cache_Token c = {tok->items[i].begin - tok->buffer, tok->items[i].len};
+        failed = fwrite(&c, sizeof(c), 1, fp) != 1;
+    }
+    if (!failed) failed = fwrite(cnodes.items, sizeof(Cache_Node), cnodes.count, fp) != cnodes.count;
+    da_free(&cnodes);
+    return cache_commit(fp, failed, tmppath, path);
+}
+
+int cache_load_result(Cache_Result * result, uint64_t key, const char * dir) {
+    *result = (Cache_Result) {};
+    char path[4096];
+    cache_path(path, sizeof(path), dir, key, "cvmr");
+    FILE * fp = fopen(path, "rb");
+    if (!fp) return 1;
+    Cache_Result_Header header;
+    struct stat st;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || fstat(fileno(fp), &st) ||
+        memcmp(header.magic, CACHE_RESULT_MAGIC, 4) ||
+        header.version != CACHE_RESULT_VERSION ||
+        header.key != key ||
+        header.output_len > (uint64_t)st.st_size || header.message_len > (uint64_t)st.st_size ||
+        (uint64_t)st.st_size != sizeof(header) + header.output_len + header.message_len) {
+        fclose(fp);
+        return 1;
+    }
+    *result = (Cache_Result) {
+        .status = header.status,
+        .steps = header.steps,
+        .depth_max = header.depth_max,
+        .memory_max = header.memory_max,
+        .time = header.time,
+        .output = (char *)malloc(header.output_len + 1),
+        .output_len = header.output_len,
+        .message = (char *)malloc(header.message_len + 1),
+        .message_len = header.message_len,
+    };
+    int failed = !result->output || !result->message ||
+        fread(result->output, 1, result->output_len, fp) != result->output_len ||
+        fread(result->message, 1, result->message_len, fp) != result->message_len;
+    fclose(fp);
+    if (failed) cache_result_free(result);
+    return failed;
+}
+
+int cache_store_result(const Cache_Result * result, uint64_t key, const char * dir) {
+    Cache_Result_Header header = {
+        .magic = CACHE_RESULT_MAGIC,
+        .version = CACHE_RESULT_VERSION,
+        .key = key,
+        .status = result->status,
+        .steps = result->steps,
+        .depth_max = result->depth_max,
+        .memory_max = result->memory_max,
+        .time = result->time,
+        .output_len = result->output_len,
+        .message_len = result->message_len,
+    };
+    char path[4096], tmppath[4096 + 32];
+    cache_path(path, sizeof(path), dir, key, "cvmr");
+    FILE * fp = cache_create(dir, path, tmppath, sizeof(tmppath));
+    if (!fp) return 1;
+    int failed = fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        fwrite(result->output, 1, result->output_len, fp) != result->output_len ||
+        fwrite(result->message, 1, result->message_len, fp) != result->message_len;
+    return cache_commit(fp, failed, tmppath, path);
+}
+
+void cache_result_free(Cache_Result * result) {
+    free(result->output);
+    free(result->message);
+    *result = (Cache_Result) {};
+}
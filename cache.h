@@ -0,0 +1,63 @@
+#ifndef CACHE_H_
+#define CACHE_H_
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t
+
+#include "tokenizer.h"
+#include "ast_builder.h"
+
+/*
+  @def Compiled program cache
+
+  A cache entry is the flattened AST of one source file, stored in
+  `<dir>/<hash>.cvmc` where <hash> is the hex FNV-1a hash of the source,
+  extended with a flag when the bodies are left unparsed (`--lazy-parse`).
+  No pointer is stored: tokens are (offset, len) into the source text
+  and nodes refer to their children by index.
+
+  header
+  Token  : {uint32 offset, uint32 len} * n_tokens
+  Node   : {uint32 type, int32 token, uint32 first, uint32 count} * n_nodes
+
+  Nodes are laid out breadth first, so the children of a node are
+  contiguous and node 0 is 'TOP'.
+
+  A result entry (`--result-cache`) is what a run showed, stored in
+  `<dir>/<key>.cvmr` where <key> hashes whatever decides the run (see
+  main.c): the output, then the message printed after the run.
+
+  header
+  char   : output[output_len], message[message_len]
+*/
+
+uint64_t cache_hash(const char * data, size_t len);
+// `hash` extended with more data, `cache_hash` is from an empty one
+uint64_t cache_hash_add(uint64_t hash, const char * data, size_t len);
+
+// `tok->buffer` must hold the source text already, `lazy` if the AST is
+// from `ast_build_lazy`: its bodies have not been checked for syntax errors
+// fills `tok->items` and `ast`, return 1 on miss
+int cache_load(AST_Node * ast, Tokenizer * tok, const char * dir, int lazy);
+// return 1 on fail, a failed store leaves no entry behind
+int cache_store(AST_Node * ast, Tokenizer * tok, const char * dir, int lazy);
+
+typedef struct {
+    int status; // of `cvm_run`
+    uint64_t steps; // counters of the run, see CVM_Stats
+    uint64_t depth_max;
+    uint64_t memory_max;
+    double time; // seconds
+    char * output; // heap alloc'ed, like `message`
+    size_t output_len;
+    char * message;
+    size_t message_len;
+} Cache_Result;
+
+// return 1 on miss
+int cache_load_result(Cache_Result * result, uint64_t key, const char * dir);
+// return 1 on fail, a failed store leaves no entry behind
+int cache_store_result(const Cache_Result * result, uint64_t key, const char * dir);
+void cache_result_free(Cache_Result * result);
+
+#endif // CACHE_H_
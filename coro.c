@@ -0,0 +1,277 @@
+#define _GNU_SOURCE // fopencookie
+#include <stdio.h>
+#include <stddef.h> // size_t
+#include <stdint.h>
+#include <stdlib.h> // memory
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <ucontext.h>
+#include <unistd.h> // read, write, pipe
+#include <fcntl.h> // O_NONBLOCK
+#include <sys/mman.h> // mmap
+#include <sys/epoll.h>
+
+#include "coro.h"
+#include "dynarray.h"
+#include "cvm.h"
+
+static const size_t CORO_STACK = 8 << 20; // address space, pages are committed on first touch
+static const size_t CORO_GUARD = 4096; // an overflow faults instead of writing into another stack
+#define CORO_EVENTS 64 // per epoll_wait
+
+typedef struct {
+    ucontext_t ctx;
+    char * stack; // mmap'ed, the guard page at the bottom
+    CVM_State * vm; // while another one runs
+    void (*fn)(void * arg);
+    void * arg;
+    int waited_fd; // registered with epoll, -1 if none
+    int done;
+} Coro;
+
+typedef struct {
+    Coro ** items;
+    size_t count;
+    size_t capacity;
+} Coros;
+
+typedef struct {
+    pthread_t thread;
+    int epoll_fd;
+    int wake[2]; // a byte in `wake[1]` when `incoming` grows or on stop
+    pthread_mutex_t lock;
+    Coros incoming; // spawned, not started yet
+    int stopping;
+    // owned by the thread
+    Coros runnable;
+    size_t n_alive;
+    ucontext_t loop;
+    Coro * current;
+} Coro_Thread;
+
+static struct {
+    Coro_Thread * threads;
+    int n_threads;
+    atomic_uint next; // round robin of `coro_spawn`
+} coro = {};
+
+static _Thread_local Coro_Thread * coro_self = NULL;
+
+static void coro_entry() {
+    Coro * co = coro_self->current;
+    co->fn(co->arg);
+    co->done = 1;
+    // back to the loop through `uc_link`
+}
+
+// @return NULL if out of memory
+static Coro * coro_create(Coro_Thread * t, void (*fn)(void *), void * arg) {
+    Coro * co = (Coro *)calloc(1, sizeof(Coro));
+    if (!co) return NULL;
+    co->stack = (char *)mmap(NULL, CORO_STACK, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    co->vm = cvm_state_new();
+    if (co->stack == MAP_FAILED || !co->vm) {
+        if (co->stack != MAP_FAILED) munmap(co->stack, CORO_STACK);
+        cvm_state_free(co->vm);
+        free(co);
+        return NULL;
+    }
+    mprotect(co->stack, CORO_GUARD, PROT_NONE);
+    co->fn = fn;
+    co->arg = arg;
+    co->waited_fd = -1;
+    getcontext(&co->ctx);
+    co->ctx.uc_stack.ss_sp = co->stack;
+    co->ctx.uc_stack.ss_size = CORO_STACK;
+    co->ctx.uc_link = &t->loop;
+    makecontext(&co->ctx, coro_entry, 0);
+    return co;
+}
+
+static void coro_free(Coro * co) {
+    munmap(co->stack, CORO_STACK);
+    cvm_state_free(co->vm);
+    free(co);
+}
+
+// runs `co` until it waits or ends, in its own VM state
+static void coro_resume(Coro_Thread * t, Coro * co) {
+    t->current = co;
+    cvm_state_swap(co->vm);
+    swapcontext(&t->loop, &co->ctx);
+    cvm_state_swap(co->vm);
+    t->current = NULL;
+    if (!co->done) return;
+    t->n_alive -= 1;
+    coro_free(co);
+}
+
+static void * coro_loop(void * arg) {
+    Coro_Thread * t = (Coro_Thread *)arg;
+    coro_self = t;
+    struct epoll_event events[CORO_EVENTS];
+    while (1) {
+        pthread_mutex_lock(&t->lock);
+        Coros incoming = t->incoming;
+        t->incoming = (Coros) {};
+        int stopping = t->stopping;
+        pthread_mutex_unlock(&t->lock);
+        for (size_t i = 0; i < incoming.count; ++i) {
+            Coro * co = incoming.items[i];
+            co->ctx.uc_link = &t->loop;
+            da_append(&t->runnable, co);
+            t->n_alive += 1;
+        }
+        da_free(&incoming);
+
+        // the ones made runnable while running others wait for the next round
+        Coros runnable = t->runnable;
+        t->runnable = (Coros) {};
+        for (size_t i = 0; i < runnable.count; ++i) coro_resume(t, runnable.items[i]);
+        da_free(&runnable);
+        if (stopping && t->n_alive == 0) break;
+
+        int n = epoll_wait(t->epoll_fd, events, CORO_EVENTS, t->runnable.count ? 0 : -1);
+        for (int i = 0; i < n; ++i) {
+            Coro * co = (Coro *)events[i].data.ptr;
+            if (co) {
+                da_append(&t->runnable, co);
+                continue;
+            }
+            char drain[64];
+            while (read(t->wake[0], drain, sizeof(drain)) > 0) {}
+        }
+    }
+    da_free(&t->runnable);
+    return NULL;
+}
+
+int coro_start(int n_threads) {
+    if (n_threads < 1) n_threads = 1;
+    coro.threads = (Coro_Thread *)calloc(n_threads, sizeof(Coro_Thread));
+    if (!coro.threads) return 1;
+    for (coro.n_threads = 0; coro.n_threads < n_threads; ++coro.n_threads) {
+        Coro_Thread * t = coro.threads + coro.n_threads;
+        pthread_mutex_init(&t->lock, NULL);
+        t->epoll_fd = epoll_create1(0);
+        struct epoll_event wake = {.events = EPOLLIN, .data.ptr = NULL};
+        if (t->epoll_fd < 0 || pipe2(t->wake, O_NONBLOCK) ||
+            epoll_ctl(t->epoll_fd, EPOLL_CTL_ADD, t->wake[0], &wake) ||
+            pthread_create(&t->thread, NULL, coro_loop, t)) {
+            if (t->epoll_fd >= 0) close(t->epoll_fd);
+            coro_stop();
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void coro_spawn(void (*fn)(void * arg), void * arg) {
+    Coro_Thread * t = coro.threads + atomic_fetch_add(&coro.next, 1) % coro.n_threads;
+    Coro * co = coro_create(t, fn, arg);
+    if (!co) {
+        fn(arg); // out of memory: run it here, blocking
+        return;
+    }
+    pthread_mutex_lock(&t->lock);
+    da_append(&t->incoming, co);
+    pthread_mutex_unlock(&t->lock);
+    write(t->wake[1], "", 1); // a full pipe already wakes the thread
+}
+
+void coro_stop() {
+    for (int i = 0; i < coro.n_threads; ++i) {
+        Coro_Thread * t = coro.threads + i;
+        pthread_mutex_lock(&t->lock);
+        t->stopping = 1;
+        pthread_mutex_unlock(&t->lock);
+        write(t->wake[1], "", 1);
+    }
+    for (int i = 0; i < coro.n_threads; ++i) {
+        Coro_Thread * t = coro.threads + i;
+        pthread_join(t->thread, NULL);
+        close(t->epoll_fd);
+        close(t->wake[0]);
+        close(t->wake[1]);
+        pthread_mutex_destroy(&t->lock);
+    }
+    free(coro.threads);
+    coro = (typeof(coro)) {};
+}
+
+void coro_wait(int fd, unsigned events) {
+    Coro_Thread * t = coro_self;
+    Coro * co = t ? t->current : NULL;
+    if (!co) return; // not in a coroutine, the caller retries
+    struct epoll_event event = {.events = events | EPOLLONESHOT, .data.ptr = co};
+    if (co->waited_fd != fd) {
+        // the previous one, if any, is closed or stays disarmed (one shot)
+        if (epoll_ctl(t->epoll_fd, EPOLL_CTL_ADD, fd, &event) && errno == EEXIST) {
+            epoll_ctl(t->epoll_fd, EPOLL_CTL_MOD, fd, &event);
+        }
+        co->waited_fd = fd;
+    } else {
+        epoll_ctl(t->epoll_fd, EPOLL_CTL_MOD, fd, &event);
+    }
+    swapcontext(&co->ctx, &t->loop);
+}
+
+ssize_t coro_read(int fd, void * buf, size_t len) {
+    while (1) {
+        ssize_t n = read(fd, buf, len);
+        if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) return n;
+        if (errno != EINTR) coro_wait(fd, EPOLLIN);
+    }
+}
+
+ssize_t coro_write(int fd, const void * buf, size_t len) {
+    while (1) {
+        ssize_t n = write(fd, buf, len);
+        if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) return n;
+        if (errno != EINTR) coro_wait(fd, EPOLLOUT);
+    }
+}
+
+typedef struct {
+    int fd;
+    FILE * flush;
+} Coro_Stream;
+
+static ssize_t coro_stream_read(void * cookie, char * buf, size_t size) {
+    Coro_Stream * s = (Coro_Stream *)cookie;
+    if (s->flush) fflush(s->flush);
+    ssize_t n = coro_read(s->fd, buf, size);
+    return n < 0 ? -1 : n;
+}
+
+static ssize_t coro_stream_write(void * cookie, const char * buf, size_t size) {
+    Coro_Stream * s = (Coro_Stream *)cookie;
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = coro_write(s->fd, buf + done, size - done);
+        if (n <= 0) return done ? (ssize_t)done : -1;
+        done += n;
+    }
+    return done;
+}
+
+static int coro_stream_close(void * cookie) {
+    free(cookie);
+    return 0;
+}
+
+FILE * coro_fdopen(int fd, const char * mode, FILE * flush) {
+    Coro_Stream * s = (Coro_Stream *)malloc(sizeof(Coro_Stream));
+    if (!s) return NULL;
+    *s = (Coro_Stream) {fd, flush};
+    cookie_io_functions_t io = {
+        .read = coro_stream_read,
+        .write = coro_stream_write,
+        .close = coro_stream_close,
+    };
+    FILE * fp = fopencookie(s, mode, io);
+    if (!fp) free(s);
+    return fp;
+}
@@ -0,0 +1,39 @@
+#ifndef CORO_H_
+#define CORO_H_
+
+#include <stdio.h> // FILE
+#include <sys/types.h> // ssize_t
+
+/*
+  @def Coroutine scheduler
+
+  Runs many coroutines on a few threads. Each coroutine has its own stack
+  (8 MiB of address space, committed as it is touched, like a thread's)
+  and its own VM state (see `cvm_state_swap`), and stays on the thread it
+  was given. A coroutine waiting for a file descriptor yields to the event
+  loop of its thread (epoll), which resumes the coroutines whose
+  descriptors are ready, one at a time.
+
+  `coro_read` and `coro_write` are `read` and `write` that yield on
+  EAGAIN, and `coro_fdopen` wraps them in a stdio stream: a program that
+  reads `cin` from such a stream is suspended inside `fscanf` until input
+  arrives, with no change to the VM. Outside of a coroutine they block
+  like `read` and `write`.
+*/
+
+// @return 1 if the threads cannot be started
+int coro_start(int n_threads);
+// runs `fn(arg)` as a coroutine, on the threads in turn
+void coro_spawn(void (*fn)(void * arg), void * arg);
+// waits for every coroutine to end, then for the threads
+void coro_stop();
+
+// in a coroutine: yields until `fd` has one of the epoll `events`
+void coro_wait(int fd, unsigned events);
+ssize_t coro_read(int fd, void * buf, size_t len);
+ssize_t coro_write(int fd, const void * buf, size_t len);
+// a stream over `fd` ("r" or "w") that does not close it; a read first
+// flushes `flush` if not NULL, so that a prompt is seen before the wait
+FILE * coro_fdopen(int fd, const char * mode, FILE * flush);
+
+#endif // CORO_H_
@@ -1,11 +1,21 @@
 #include <stdio.h> // io stream
 #include <stddef.h>
 #include <string.h>
+#include <limits.h> // INT_MAX
+#include <time.h> // clock_gettime
+#include <sys/mman.h> // mmap
 
 #include "cvm.h"
 #include "dynarray.h"
 #include "tokenizer.h"
 #include "ast_builder.h"
+#include "kernels.h"
+#include "trace.h"
+#include "sample.h"
+#include "pipeio.h"
+#include "profile.h"
+#include "pool.h"
+#include "ir.h"
 
 // @desc
 // simplified version:
@@ -25,7 +35,8 @@ typedef struct {
     Dimensions dims; // empty for int
 
     int value; // for int
-    int * values; // for int array
+    int * values; // for int array, zero-initialized
+    size_t bytes; // allocated for `values`, mmap'ed from `CVM_MMAP_MIN_BYTES` on
 } Var;
 
 typedef struct {
@@ -43,6 +54,8 @@ typedef struct {
 typedef struct {
     Token iden;
     AST_Node * def;
+    uint32_t trace_id;
+    int pure; // see `cvm_find_pure_funcs`
 } Func;
 
 typedef struct {
@@ -51,12 +64,217 @@ typedef struct {
     size_t capacity;
 } Funcs;
 
-static Vars globals = {};
-static Funcs funcs = {};
-static CallStack callstack = {};
+// the configuration is shared, the state of a VM is per thread:
+// threads run programs independently, as long as they don't share an AST
+CVM_Config cvm_config = {.opt_level = 2};
+_Thread_local CVM_Stats cvm_stats = {};
+_Thread_local const char * cvm_errmsg = NULL;
+_Thread_local const Token * cvm_errtok = NULL;
+_Thread_local CVM_Globals * cvm_globals_out = NULL;
+static _Thread_local char cvm_errbuf[256];
 
-static FILE * is = NULL;
-static FILE * os = NULL;
+static _Thread_local Vars globals = {};
+static _Thread_local Funcs funcs = {};
+static _Thread_local CallStack callstack = {};
+
+static _Thread_local FILE * is = NULL;
+static _Thread_local FILE * os = NULL;
+static _Thread_local int pipeio_on = 0; // `is` and `os` belong to the I/O threads, see pipeio.h
+
+// analysis results, see `cvm_analyze`
+enum {
+    ANNOT_COUNTED = 1, // 'WHIL': `i = a; while (i < n) { ...; i = i + c; }`
+    ANNOT_HOISTED = 2, // subscript `i` of a counted loop, checked at loop entry
+    ANNOT_INVARIANT = 4, // expression computed once per loop activation
+    ANNOT_BOUND = 8, // 'VARR' resolved once per loop activation, see `Slot`
+    ANNOT_LOOP = 16, // 'WHIL' with a `Loop`
+    ANNOT_PROFILED = 32, // 'IFEL', 'WHIL' or 'CALL' counted for `--profile-out`
+    ANNOT_CALLEE = 64, // 'CALL' whose callee is resolved once, by `cvm_quicken`
+    ANNOT_FORK = 128, // 'BIOP' whose left operand is a pure call run as a task, see pool.h
+    ANNOT_TAIL = 256, // 'RETN' of a call, made in the frame of the returning function
+};
+
+// node variants specialized by `cvm_quicken`, in `CVM_Annot.quick`
+enum {
+    QUICK_NONE,
+    QUICK_CONST, // 'INTG', or 'EXPR' of one: `value`
+    QUICK_LOCAL, // 'VARR' at `var` in the frame, or 'EXPR' of a scalar one
+    QUICK_GLOBAL, // 'VARR' at `var` in `globals`, or 'EXPR' of a scalar one
+    QUICK_BIOP, // 'BIOP' whose operator is `value`
+    QUICK_EXPR, // 'EXPR' evaluated as its operand
+};
+
+// operators of 'BIOP', see `cvm_biop`
+enum {
+    OP_NONE,
+    OP_COUT, OP_CIN, OP_ASSIGN, OP_AND, OP_OR,
+    OP_MUL, OP_DIV, OP_MOD, OP_ADD, OP_SUB,
+    OP_LE, OP_GE, OP_LT, OP_GT, OP_EQ, OP_NE, OP_XOR,
+};
+
+typedef struct CVM_Annot {
+    uint32_t flags;
+    size_t loop; // index in `loops`
+    size_t slot; // index in `slots`, for ANNOT_INVARIANT and ANNOT_BOUND
+    size_t func; // index in `funcs`, for ANNOT_CALLEE and ANNOT_FORK
+    uint64_t counts[2]; // ANNOT_PROFILED, as in profile.h
+    int quick; // QUICK_*, QUICK_NONE if not specialized
+    int value; // QUICK_CONST: the constant, QUICK_BIOP: the operator
+    size_t var; // QUICK_LOCAL and QUICK_GLOBAL
+} CVM_Annot;
+
+// a subscript `arr[..][i][..]` driven by the induction variable
+typedef struct {
+    Token * iden; // array
+    size_t n_subs;
+    size_t sub; // which subscript is `i`
+} Bound_Check;
+
+typedef struct {
+    Token ** items;
+    size_t count;
+    size_t capacity;
+} Names;
+
+enum {
+    KERNEL_NONE,
+    KERNEL_FILL, // A[..][i] = v
+    KERNEL_SUM, // s = s + A[..][i]
+    KERNEL_MAP, // A[..][i] = l op r, `l` and `r` are slices B[..][i] or invariants
+};
+
+// a counted loop `while (i < n) { stmt; i = i + 1; }` run by `kernels.h`
+// slices are rows: only the last subscript is `i`, the others are invariant
+typedef struct {
+    int kind;
+    char op; // KERNEL_MAP: + - *
+    AST_Node * dst; // KERNEL_FILL and KERNEL_MAP: slice, KERNEL_SUM: accumulator
+    AST_Node * src[2]; // KERNEL_FILL: value, KERNEL_SUM: slice, KERNEL_MAP: operands
+} Kernel;
+
+typedef struct {
+    int counted; // the fields below up to `step` are only set for counted loops
+    Token * iv; // induction variable
+    AST_Node * bound; // 'INTG' or scalar 'VARR', loop invariant
+    int inclusive; // `<=` rather than `<`
+    int step; // > 0
+
+    int has_call; // a call may modify globals
+    int has_decl; // the frame may grow, variables may move
+    Names written; // variables written in the condition or the body
+    struct {
+        Bound_Check * items;
+        size_t count;
+        size_t capacity;
+    } checks;
+    Kernel kernel; // -O2
+} Loop;
+
+typedef struct {
+    Loop * items;
+    size_t count;
+    size_t capacity;
+} Loops;
+
+// runtime state of a loop, saved and restored around each activation
+typedef struct {
+    size_t epoch; // unique per activation, 0 when not running
+    int proven; // the bound checks of the loop hold for this activation
+} Loop_State;
+
+// runtime state of an annotated node, valid while `epoch` is its loop's
+typedef struct {
+    size_t epoch;
+    int value; // ANNOT_INVARIANT
+    // ANNOT_BOUND: the element is values[offset + stride * *iv]
+    int * values;
+    size_t offset;
+    size_t stride;
+    int * iv; // NULL if no subscript is the induction variable
+    size_t iv_sub; // which subscript is `*iv`
+    Var * var;
+} Slot;
+
+// limits are checked at loop back-edges and calls
+// the clock is only read every `LIMIT_CLOCK_PERIOD` checks
+static const size_t LIMIT_CLOCK_PERIOD = 4096;
+static _Thread_local int limits_on = 0;
+static _Thread_local int limit_hit = 0;
+static _Thread_local size_t limit_clock_countdown = 0;
+static _Thread_local double start_time = 0;
+
+// pure calls forked on the pool, see `cvm_mark_fork`
+static _Thread_local int parallel_on = 0;
+static _Thread_local size_t n_forks = 0; // ANNOT_FORK nodes
+
+// tail calls: a 'RETN' with ANNOT_TAIL evaluates the arguments and leaves the
+// call to `cvm_call`, which reuses the frame of the returning function
+// the frames of the callee and the caller take turns with `spare_frame`
+static _Thread_local struct {
+    Func * func;
+    Vars args;
+} tail_call = {};
+static _Thread_local Vars spare_frame = {};
+
+// profile-guided decisions, see profile.h
+static const uint64_t PROFILE_MIN_TRIPS = 2; // average iterations of a loop worth optimizing
+
+static _Thread_local struct {
+    AST_Node ** items; // analyzed trees, their annotations are freed on cleanup
+    size_t count;
+    size_t capacity;
+} programs = {};
+static _Thread_local Loops loops = {};
+static _Thread_local size_t n_slots = 0;
+static _Thread_local size_t epoch_counter = 0;
+static _Thread_local struct {
+    Loop_State * items;
+    size_t count;
+    size_t capacity;
+} loop_states = {};
+static _Thread_local struct {
+    Slot * items;
+    size_t count;
+    size_t capacity;
+} slots = {};
+
+// coroutines that interleave runs on one thread swap all of the above,
+// all zero in a new thread
+#define CVM_THREAD_STATE(X) \
+    X(cvm_stats) X(cvm_errmsg) X(cvm_errtok) X(cvm_globals_out) X(cvm_errbuf) \
+    X(globals) X(funcs) X(callstack) X(is) X(os) X(pipeio_on) \
+    X(limits_on) X(limit_hit) X(limit_clock_countdown) X(start_time) \
+    X(parallel_on) X(n_forks) X(tail_call) X(spare_frame) \
+    X(programs) X(loops) X(n_slots) X(epoch_counter) X(loop_states) X(slots)
+
+struct CVM_State {
+#define CVM_STATE_FIELD(var) unsigned char var[sizeof(var)];
+    CVM_THREAD_STATE(CVM_STATE_FIELD)
+#undef CVM_STATE_FIELD
+};
+
+CVM_State * cvm_state_new() {
+    return (CVM_State *)calloc(1, sizeof(CVM_State));
+}
+
+static void cvm_swap_bytes(void * a, void * b, size_t n) {
+    unsigned char * x = (unsigned char *)a, * y = (unsigned char *)b;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char t = x[i];
+        x[i] = y[i];
+        y[i] = t;
+    }
+}
+
+void cvm_state_swap(CVM_State * state) {
+#define CVM_STATE_SWAP(var) cvm_swap_bytes(&var, state->var, sizeof(var));
+    CVM_THREAD_STATE(CVM_STATE_SWAP)
+#undef CVM_STATE_SWAP
+}
+
+void cvm_state_free(CVM_State * state) {
+    free(state);
+}
 
 
 void cvm_cleanup();
@@ -67,6 +285,9 @@ void cvm_callstack_pop();
 int cvm_execute_block(int * ret_val, AST_Node * node);
 int cvm_execute_stmt(int * ret_val, AST_Node * node);
 int cvm_eval_expr(int * ret_val, AST_Node * node);
+int cvm_prove_loop(Loop * loop);
+int cvm_check_hoisted(AST_Node * sub);
+int cvm_run_kernel(Loop * loop, size_t * n_iter);
 
 int parse_int(Token * tok) {
     int res;
@@ -99,49 +320,798 @@ Func * cvm_find_func(Token * iden) {
     return NULL;
 }
 
+// analysis
+
+AST_Node * unwrap_expr(AST_Node * node) {
+    while (node->type == 'EXPR' && node->count == 1) node = node->items + 0;
+    return node;
+}
+int is_scalar_var(AST_Node * node, Token * iden) {
+    node = unwrap_expr(node);
+    return node->type == 'VARR' && node->count == 1 &&
+        (!iden || tokcmp(node->items[0].token, iden) == 0);
+}
+int intg_value(AST_Node * node) {
+    int res = parse_int(node->items[node->count - 1].token);
+    if (node->count == 2 && node->items[0].token->begin[0] == '-') res *= -1;
+    return res;
+}
+
+// the operator of a 'BIOP', OP_NONE if unknown
+int cvm_biop(Token * op) {
+    if (tokstrcmp(op, "<<") == 0) return OP_COUT;
+    if (tokstrcmp(op, ">>") == 0) return OP_CIN;
+    if (tokstrcmp(op, "=") == 0) return OP_ASSIGN;
+    if (tokstrcmp(op, "&&") == 0) return OP_AND;
+    if (tokstrcmp(op, "||") == 0) return OP_OR;
+    if (tokstrcmp(op, "*") == 0) return OP_MUL;
+    if (tokstrcmp(op, "/") == 0) return OP_DIV;
+    if (tokstrcmp(op, "%") == 0) return OP_MOD;
+    if (tokstrcmp(op, "+") == 0) return OP_ADD;
+    if (tokstrcmp(op, "-") == 0) return OP_SUB;
+    if (tokstrcmp(op, "<=") == 0) return OP_LE;
+    if (tokstrcmp(op, ">=") == 0) return OP_GE;
+    if (tokstrcmp(op, "<") == 0) return OP_LT;
+    if (tokstrcmp(op, ">") == 0) return OP_GT;
+    if (tokstrcmp(op, "==") == 0) return OP_EQ;
+    if (tokstrcmp(op, "!=") == 0) return OP_NE;
+    if (tokstrcmp(op, "^") == 0) return OP_XOR;
+    return OP_NONE;
+}
+
+// whether `node` may write `iden`: `=`, `>>` or redeclaration
+int writes_var(AST_Node * node, Token * iden) {
+    if (node->type == 'DECL' && tokcmp(node->items[0].token, iden) == 0) return 1;
+    if (node->type == 'BIOP') {
+        AST_Node * target = NULL;
+        if (tokstrcmp(node->token, "=") == 0) target = unwrap_expr(node->items + 0);
+        if (tokstrcmp(node->token, ">>") == 0) target = unwrap_expr(node->items + 1);
+        if (target && target->type == 'VARR' &&
+            tokcmp(target->items[0].token, iden) == 0) return 1;
+    }
+    for (size_t i = 0; i < node->count; ++i) {
+        if (writes_var(node->items + i, iden)) return 1;
+    }
+    return 0;
+}
+int has_call(AST_Node * node) {
+    if (node->type == 'CALL') return 1;
+    for (size_t i = 0; i < node->count; ++i) {
+        if (has_call(node->items + i)) return 1;
+    }
+    return 0;
+}
+
+int declares_var(AST_Node * node, Token * iden) {
+    if (node->type == 'DECL') return !iden || tokcmp(node->items[0].token, iden) == 0;
+    for (size_t i = 0; i < node->count; ++i) {
+        if (declares_var(node->items + i, iden)) return 1;
+    }
+    return 0;
+}
+
+void collect_written(Names * names, AST_Node * node) {
+    if (node->type == 'BIOP') {
+        AST_Node * target = NULL;
+        if (tokstrcmp(node->token, "=") == 0) target = unwrap_expr(node->items + 0);
+        if (tokstrcmp(node->token, ">>") == 0) target = unwrap_expr(node->items + 1);
+        if (target && target->type == 'VARR') da_append(names, target->items[0].token);
+    }
+    if (node->type == 'DECL') da_append(names, node->items[0].token);
+    for (size_t i = 0; i < node->count; ++i) collect_written(names, node->items + i);
+}
+int names_contain(Names * names, Token * iden) {
+    for (size_t i = 0; i < names->count; ++i) {
+        if (tokcmp(names->items[i], iden) == 0) return 1;
+    }
+    return 0;
+}
+
+// the function being analyzed, to tell which names surely are locals
+typedef struct {
+    AST_Node * func; // 'FUNC'
+    size_t stmt; // index in the body of the statement being analyzed
+    int flat; // `cvm_quicken`: every local is declared by a statement of the body
+} Analysis_Ctx;
+
+// a parameter, or declared by a statement of the body that ran before
+// locals are only destroyed on function exit, so it is a local from then on
+int is_surely_local(Analysis_Ctx * ctx, Token * iden) {
+    AST_Node * func = ctx->func;
+    AST_Node * body = func->items + func->count - 1;
+    for (size_t i = 1; i + 1 < func->count; ++i) {
+        if (tokcmp(func->items[i].token, iden) == 0) return 1;
+    }
+    for (size_t i = 0; i < ctx->stmt; ++i) {
+        if (body->items[i].type == 'DECL' &&
+            tokcmp(body->items[i].items[0].token, iden) == 0) return 1;
+    }
+    return 0;
+}
+
+// whether `node` has the same value during a whole activation of `loop`
+// no write, no side effect, no call, and no variable a callee could write
+int is_invariant(AST_Node * node, Loop * loop, Analysis_Ctx * ctx) {
+    switch (node->type) {
+    case 'EXPR': return node->count == 1 && is_invariant(node->items + 0, loop, ctx);
+    case 'INTG': return 1;
+    case 'VARR': {
+        Token * iden = node->items[0].token;
+        if (names_contain(&loop->written, iden)) return 0;
+        if (loop->has_call && !is_surely_local(ctx, iden)) return 0;
+        for (size_t i = 1; i < node->count; ++i) {
+            if (!is_invariant(node->items + i, loop, ctx)) return 0;
+        }
+        return 1;
+    }
+    case 'UPOP': return is_invariant(node->items + 0, loop, ctx);
+    case 'BIOP': {
+        if (tokstrcmp(node->token, "=") == 0 ||
+            tokstrcmp(node->token, "<<") == 0 ||
+            tokstrcmp(node->token, ">>") == 0) return 0;
+        return is_invariant(node->items + 0, loop, ctx) &&
+            is_invariant(node->items + 1, loop, ctx);
+    }
+    default: return 0; // 'CALL'
+    }
+}
+
+CVM_Annot * cvm_annot_of(AST_Node * node) {
+    if (!node->annot) node->annot = (CVM_Annot *)calloc(1, sizeof(CVM_Annot));
+    return node->annot;
+}
+
+CVM_Annot * cvm_annotate(AST_Node * node, uint32_t flag, size_t loop_id) {
+    cvm_annot_of(node)->flags |= flag;
+    node->annot->loop = loop_id;
+    if (flag == ANNOT_INVARIANT || flag == ANNOT_BOUND) node->annot->slot = n_slots++;
+    return node->annot;
+}
+
+// mark every `arr[..][iv][..]` below `node` with the loop
+// arrays (re)declared in the loop body are left to the per-access check
+void cvm_collect_checks(AST_Node * node, AST_Node * body, size_t loop_id) {
+    Loop * loop = loops.items + loop_id;
+    if (node->type == 'VARR' && node->count > 1 && !declares_var(body, node->items[0].token)) {
+        for (size_t i = 1; i < node->count; ++i) {
+            if (!is_scalar_var(node->items + i, loop->iv)) continue;
+            cvm_annotate(node->items + i, ANNOT_HOISTED, loop_id);
+            da_append(&loop->checks, ((Bound_Check) {node->items[0].token, node->count - 1, i - 1}));
+        }
+    }
+    for (size_t i = 0; i < node->count; ++i) cvm_collect_checks(node->items + i, body, loop_id);
+}
+
+// hoisting: mark the largest invariant expressions worth caching
+// expressions already marked by an enclosing loop are left alone
+void cvm_mark_invariants(AST_Node * node, size_t loop_id, Analysis_Ctx * ctx) {
+    if (node->annot && (node->annot->flags & ANNOT_INVARIANT)) return;
+    int worth = node->type == 'BIOP' || node->type == 'UPOP' ||
+        (node->type == 'VARR' && node->count > 1);
+    if (worth && is_invariant(node, loops.items + loop_id, ctx)) {
+        cvm_annotate(node, ANNOT_INVARIANT, loop_id);
+        return;
+    }
+    for (size_t i = 0; i < node->count; ++i) cvm_mark_invariants(node->items + i, loop_id, ctx);
+}
+
+// strength reduction: variables and array elements addressed by invariant
+// subscripts and at most one subscript `i` are resolved once per activation,
+// then each access is a multiply-add on `i`
+// nested loops bind their own variables
+void cvm_mark_bound(AST_Node * node, size_t loop_id, Analysis_Ctx * ctx) {
+    Loop * loop = loops.items + loop_id;
+    if (node->type == 'WHIL') return;
+    if (node->type == 'VARR' && !node->annot) {
+        size_t n_iv = 0;
+        int affine = 1;
+        for (size_t i = 1; i < node->count && affine; ++i) {
+            if (loop->counted && is_scalar_var(node->items + i, loop->iv)) n_iv += 1;
+            else affine = is_invariant(node->items + i, loop, ctx);
+        }
+        if (affine && n_iv <= 1) cvm_annotate(node, ANNOT_BOUND, loop_id);
+    }
+    for (size_t i = 0; i < node->count; ++i) cvm_mark_bound(node->items + i, loop_id, ctx);
+}
+
+// recognize `while (i < n) { ...; i = i + c; }`
+// `n` is a literal or a variable, neither `i` nor `n` is written elsewhere in the body
+int cvm_match_counted_loop(Loop * loop, AST_Node * node) {
+    AST_Node * cond = unwrap_expr(node->items + 0);
+    AST_Node * body = node->items + 1;
+    if (cond->type != 'BIOP' || body->type != 'BLCK' || body->count == 0) return 0;
+    if (tokstrcmp(cond->token, "<") && tokstrcmp(cond->token, "<=")) return 0;
+    if (!is_scalar_var(cond->items + 0, NULL)) return 0;
+    Token * iv = unwrap_expr(cond->items + 0)->items[0].token;
+    AST_Node * bound = unwrap_expr(cond->items + 1);
+    if (bound->type != 'INTG' && !is_scalar_var(bound, NULL)) return 0;
+
+    // last statement: i = i + c
+    AST_Node * last = body->items + body->count - 1;
+    if (last->type != 'EXPS') return 0;
+    AST_Node * assign = unwrap_expr(last->items + 0);
+    if (assign->type != 'BIOP' || tokstrcmp(assign->token, "=") ||
+        !is_scalar_var(assign->items + 0, iv)) return 0;
+    AST_Node * incr = unwrap_expr(assign->items + 1);
+    if (incr->type != 'BIOP' || tokstrcmp(incr->token, "+")) return 0;
+    AST_Node * step = NULL;
+    if (is_scalar_var(incr->items + 0, iv)) step = unwrap_expr(incr->items + 1);
+    else if (is_scalar_var(incr->items + 1, iv)) step = unwrap_expr(incr->items + 0);
+    if (!step || step->type != 'INTG' || intg_value(step) <= 0) return 0;
+
+    for (size_t i = 0; i + 1 < body->count; ++i) {
+        if (writes_var(body->items + i, iv)) return 0;
+        if (bound->type == 'VARR' && writes_var(body->items + i, bound->items[0].token)) return 0;
+    }
+    loop->counted = 1;
+    loop->iv = iv;
+    loop->bound = bound;
+    loop->inclusive = tokstrcmp(cond->token, "<=") == 0;
+    loop->step = intg_value(step);
+    return 1;
+}
+
+// `arr[..][i]` where `i` is the induction variable and `..` is invariant
+int is_slice(AST_Node * node, Loop * loop, Analysis_Ctx * ctx) {
+    node = unwrap_expr(node);
+    if (node->type != 'VARR' || node->count < 2 ||
+        !is_scalar_var(node->items + node->count - 1, loop->iv)) return 0;
+    for (size_t i = 1; i + 1 < node->count; ++i) {
+        if (!is_invariant(node->items + i, loop, ctx)) return 0;
+    }
+    return 1;
+}
+
+// recognize a loop idiom of `kernels.h` in a counted loop with step 1
+// distinct slices of the same array are distinct rows, so they never
+// partially overlap and the kernels may run in place
+int cvm_match_kernel(Loop * loop, AST_Node * node, Analysis_Ctx * ctx) {
+    AST_Node * body = node->items + 1;
+    if (!loop->counted || loop->step != 1 || loop->has_call ||
+        body->type != 'BLCK' || body->count != 2 || body->items[0].type != 'EXPS') return 0;
+    AST_Node * assign = unwrap_expr(body->items[0].items + 0);
+    if (assign->type != 'BIOP' || tokstrcmp(assign->token, "=")) return 0;
+    AST_Node * target = unwrap_expr(assign->items + 0);
+    AST_Node * value = unwrap_expr(assign->items + 1);
+    Kernel * kernel = &loop->kernel;
+
+    if (is_slice(target, loop, ctx)) {
+        *kernel = (Kernel) {.dst = target};
+        if (is_invariant(value, loop, ctx)) {
+            kernel->kind = KERNEL_FILL;
+            kernel->src[0] = value;
+        } else if (is_slice(value, loop, ctx)) { // copy: v + 0
+            kernel->kind = KERNEL_MAP;
+            kernel->op = '+';
+            kernel->src[0] = value;
+        } else if (value->type == 'BIOP' &&
+                   (tokstrcmp(value->token, "+") == 0 ||
+                    tokstrcmp(value->token, "-") == 0 ||
+                    tokstrcmp(value->token, "*") == 0)) {
+            for (size_t i = 0; i < 2; ++i) {
+                AST_Node * operand = unwrap_expr(value->items + i);
+                if (!is_slice(operand, loop, ctx) && !is_invariant(operand, loop, ctx)) return 0;
+                kernel->src[i] = operand;
+            }
+            kernel->kind = KERNEL_MAP;
+            kernel->op = value->token->begin[0];
+        }
+        return kernel->kind != KERNEL_NONE;
+    }
+
+    // s = s + A[..][i] or s = A[..][i] + s
+    if (!is_scalar_var(target, NULL) || is_scalar_var(target, loop->iv) ||
+        value->type != 'BIOP' || tokstrcmp(value->token, "+")) return 0;
+    Token * acc = target->items[0].token;
+    for (size_t i = 0; i < 2; ++i) {
+        if (is_scalar_var(value->items + i, acc) && is_slice(value->items + 1 - i, loop, ctx)) {
+            *kernel = (Kernel) {KERNEL_SUM, .dst = target, .src = {unwrap_expr(value->items + 1 - i)}};
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// the token the profile entry of a node is keyed by: its own, or the first one below
+Token * profile_token(AST_Node * node) {
+    if (node->token) return node->token;
+    for (size_t i = 0; i < node->count; ++i) {
+        Token * tok = profile_token(node->items + i);
+        if (tok) return tok;
+    }
+    return NULL;
+}
+
+Profile_Entry * cvm_profile_entry(AST_Node * node) {
+    Token * tok = profile_token(node);
+    return tok ? profile_find(node->type, tok->begin - profile.source) : NULL;
+}
+
+// with a profile, loops that never ran are not analyzed: no annotation, no slot
+// nor are loops that average less than two iterations per activation: hoisting
+// only pays off from the second one on, and the state of an activation costs
+int cvm_profile_worth(AST_Node * node) {
+    if (!profile.loaded) return 1;
+    Profile_Entry * entry = cvm_profile_entry(node);
+    return !entry || (entry->counts[0] && entry->counts[1] >= PROFILE_MIN_TRIPS * entry->counts[0]);
+}
+
+// counters for `--profile-out`
+void cvm_profile_annotate(AST_Node * node) {
+    if (profile.recording &&
+        (node->type == 'IFEL' || node->type == 'WHIL' || node->type == 'CALL')) {
+        cvm_annot_of(node)->flags |= ANNOT_PROFILED;
+    }
+    for (size_t i = 0; i < node->count; ++i) cvm_profile_annotate(node->items + i);
+}
+
+// add the counts of a run to the profile
+void cvm_profile_collect(AST_Node * node) {
+    if (node->annot && (node->annot->flags & ANNOT_PROFILED)) {
+        Token * tok = profile_token(node);
+        if (tok) profile_add(node->type, tok->begin - profile.source, node->annot->counts);
+    }
+    for (size_t i = 0; i < node->count; ++i) cvm_profile_collect(node->items + i);
+}
+
+// purity, for `--parallel-calls`: a pure function only touches its parameters
+// and scalar locals, and only calls pure functions, so it gives the same result
+// on any thread and at any time
+int is_pure_node(AST_Node * node, Analysis_Ctx * ctx) {
+    switch (node->type) {
+    case 'DECL': return node->count == 1; // no array
+    case 'VARR': return node->count == 1 && is_surely_local(ctx, node->items[0].token);
+    case 'CALL': {
+        Func * callee = cvm_find_func(node->items[0].token);
+        if (!callee || !callee->pure || node->count + 1 != callee->def->count) return 0;
+    } break;
+    }
+    for (size_t i = 0; i < node->count; ++i) {
+        if (!is_pure_node(node->items + i, ctx)) return 0;
+    }
+    return 1;
+}
+
+// the largest set of functions that are pure assuming the others in the set are:
+// start from every parsed function and drop the impure ones until none is left
+void cvm_find_pure_funcs() {
+    for (size_t i = 0; i < funcs.count; ++i) {
+        AST_Node * def = funcs.items[i].def;
+        funcs.items[i].pure = def->items[def->count - 1].type == 'BLCK';
+    }
+    for (int changed = 1; changed; ) {
+        changed = 0;
+        for (size_t i = 0; i < funcs.count; ++i) {
+            if (!funcs.items[i].pure) continue;
+            Analysis_Ctx ctx = {funcs.items[i].def};
+            AST_Node * body = ctx.func->items + ctx.func->count - 1;
+            for (; ctx.stmt < body->count; ++ctx.stmt) {
+                if (is_pure_node(body->items + ctx.stmt, &ctx)) continue;
+                funcs.items[i].pure = 0;
+                changed = 1;
+                break;
+            }
+        }
+    }
+}
+
+// no write, no I/O, and pure calls only; it may read anything
+int is_side_effect_free(AST_Node * node) {
+    if (node->type == 'BIOP' &&
+        (tokstrcmp(node->token, "=") == 0 ||
+         tokstrcmp(node->token, "<<") == 0 ||
+         tokstrcmp(node->token, ">>") == 0)) return 0;
+    if (node->type == 'CALL') {
+        Func * callee = cvm_find_func(node->items[0].token);
+        if (!callee || !callee->pure || node->count + 1 != callee->def->count) return 0;
+    }
+    for (size_t i = 0; i < node->count; ++i) {
+        if (!is_side_effect_free(node->items + i)) return 0;
+    }
+    return 1;
+}
+
+// `f(..) op e` where `f` is pure and `e` has a call but no side effect:
+// the call of `f` runs as a task while `e` is evaluated; neither can observe
+// the other, so the result is the same as in sequence, errors included
+void cvm_mark_fork(AST_Node * node) {
+    if (tokstrcmp(node->token, "=") == 0 ||
+        tokstrcmp(node->token, "<<") == 0 ||
+        tokstrcmp(node->token, ">>") == 0) return;
+    // short circuit: the right operand may not run at all
+    if (!cvm_config.eager_logic &&
+        (tokstrcmp(node->token, "&&") == 0 || tokstrcmp(node->token, "||") == 0)) return;
+    AST_Node * call = unwrap_expr(node->items + 0);
+    if (call->type != 'CALL' || !has_call(node->items + 1) ||
+        !is_side_effect_free(node->items + 1)) return;
+    Func * func = cvm_find_func(call->items[0].token);
+    if (!func || !func->pure || call->count + 1 != func->def->count) return;
+    CVM_Annot * annot = cvm_annot_of(node);
+    annot->flags |= ANNOT_FORK;
+    annot->func = func - funcs.items;
+    n_forks += 1;
+}
+
+void cvm_analyze_loop(AST_Node * node, Analysis_Ctx * ctx) {
+    Loop loop = {
+        .has_call = has_call(node),
+        .has_decl = declares_var(node, NULL),
+    };
+    cvm_match_counted_loop(&loop, node);
+    int optimize = cvm_config.opt_level >= 1 && ctx->func && cvm_profile_worth(node);
+    if (!optimize && !(cvm_config.checked && loop.counted)) return;
+
+    collect_written(&loop.written, node);
+    size_t loop_id = loops.count;
+    da_append(&loops, loop);
+    da_append(&loop_states, ((Loop_State) {}));
+    cvm_annotate(node, ANNOT_LOOP | (loop.counted ? ANNOT_COUNTED : 0), loop_id);
+
+    AST_Node * body = node->items + 1;
+    if (cvm_config.checked && loop.counted) {
+        // the increment is the last statement, it has no subscript of interest
+        for (size_t i = 0; i + 1 < body->count; ++i) {
+            cvm_collect_checks(body->items + i, body, loop_id);
+        }
+    }
+    if (optimize) {
+        if (cvm_config.opt_level >= 2) cvm_match_kernel(loops.items + loop_id, node, ctx);
+        for (size_t i = 0; i < node->count; ++i) cvm_mark_invariants(node->items + i, loop_id, ctx);
+        if (!loop.has_decl) {
+            for (size_t i = 0; i < node->count; ++i) cvm_mark_bound(node->items + i, loop_id, ctx);
+        }
+    }
+}
+
+void cvm_analyze(AST_Node * node, Analysis_Ctx * ctx) {
+    if (node->type == 'FUNC') {
+        Analysis_Ctx func_ctx = {node};
+        AST_Node * body = node->items + node->count - 1;
+        if (body->type == 'LAZY') return; // analyzed once parsed, see `cvm_parse_body`
+        for (; func_ctx.stmt < body->count; ++func_ctx.stmt) {
+            cvm_analyze(body->items + func_ctx.stmt, &func_ctx);
+        }
+        return;
+    }
+    // outer loops first, so that they take the largest invariants
+    if (node->type == 'WHIL') cvm_analyze_loop(node, ctx);
+    if (node->type == 'BIOP' && parallel_on) cvm_mark_fork(node);
+    if (node->type == 'RETN' && ctx->func && cvm_config.opt_level >= 1 &&
+        unwrap_expr(node->items + 0)->type == 'CALL') {
+        cvm_annot_of(node)->flags |= ANNOT_TAIL;
+    }
+    for (size_t i = 0; i < node->count; ++i) cvm_analyze(node->items + i, ctx);
+}
+
+// quickening: constants, variables, operators and callees are resolved
+// once rather than at each evaluation, which then skips the lookups by name
+// of `get_value` and the operator dispatch on the token of 'BIOP'
+// pool workers share the AST read-only, so nodes are rewritten before the
+// run, from what holds at every evaluation, and never during it
+
+// the index in the frame of `ctx->func` of a local that is there, and
+// there only, whenever `iden` is evaluated: a parameter, or a local of a
+// flat body declared by a statement before; -1 if none
+long cvm_quick_local(Analysis_Ctx * ctx, Token * iden) {
+    AST_Node * func = ctx->func;
+    AST_Node * body = func->items + func->count - 1;
+    // a frame starts with the parameters, the first of a name is found first
+    for (size_t i = 1; i + 1 < func->count; ++i) {
+        if (tokcmp(func->items[i].token, iden) == 0) return i - 1;
+    }
+    if (!ctx->flat) return -1;
+    // then the locals, in the order of their statements
+    long index = func->count - 2;
+    for (size_t i = 0; i < ctx->stmt; ++i) {
+        if (body->items[i].type != 'DECL') continue;
+        if (tokcmp(body->items[i].items[0].token, iden) == 0) return index;
+        index += 1;
+    }
+    return -1;
+}
+
+void cvm_quicken_varr(AST_Node * node, Analysis_Ctx * ctx) {
+    // resolved per loop activation instead, see `Slot`
+    if (node->annot && (node->annot->flags & (ANNOT_BOUND | ANNOT_INVARIANT))) return;
+    Token * iden = node->items[0].token;
+    long local = cvm_quick_local(ctx, iden);
+    if (local >= 0) {
+        cvm_annot_of(node)->quick = QUICK_LOCAL;
+        node->annot->var = local;
+        return;
+    }
+    // a global in every call, unless the function declares the name
+    AST_Node * body = ctx->func->items + ctx->func->count - 1;
+    Var * global = cvm_find_var(&globals, iden);
+    if (!global || declares_var(body, iden)) return;
+    cvm_annot_of(node)->quick = QUICK_GLOBAL;
+    node->annot->var = global - globals.items;
+}
+
+void cvm_quicken(AST_Node * node, Analysis_Ctx * ctx) {
+    if (node->type == 'FUNC') {
+        Analysis_Ctx func_ctx = {node, .flat = 1};
+        AST_Node * body = node->items + node->count - 1;
+        if (body->type == 'LAZY') return; // quickened once parsed
+        for (size_t i = 0; i < body->count; ++i) {
+            if (body->items[i].type != 'DECL' && declares_var(body->items + i, NULL)) func_ctx.flat = 0;
+        }
+        for (; func_ctx.stmt < body->count; ++func_ctx.stmt) {
+            cvm_quicken(body->items + func_ctx.stmt, &func_ctx);
+        }
+        return;
+    }
+    for (size_t i = 0; i < node->count; ++i) cvm_quicken(node->items + i, ctx);
+    switch (node->type) {
+    case 'INTG': {
+        cvm_annot_of(node)->quick = QUICK_CONST;
+        node->annot->value = intg_value(node);
+    } break;
+    // outside of a function, a statement of a session: its frame changes
+    case 'VARR': if (ctx->func) cvm_quicken_varr(node, ctx); break;
+    case 'BIOP': {
+        int op = cvm_biop(node->token);
+        if (op == OP_NONE) break;
+        cvm_annot_of(node)->quick = QUICK_BIOP;
+        node->annot->value = op;
+    } break;
+    case 'CALL': {
+        // functions are only replaced in place (see `cvm_session_define`)
+        Func * func = cvm_find_func(node->items[0].token);
+        if (!func) break;
+        cvm_annot_of(node)->flags |= ANNOT_CALLEE;
+        node->annot->func = func - funcs.items;
+    } break;
+    case 'EXPR': {
+        if (node->count != 1 || (node->annot && node->annot->flags)) break;
+        CVM_Annot * operand = node->items[0].annot;
+        if (operand && (operand->flags & ANNOT_INVARIANT)) break;
+        int quick = operand ? operand->quick : QUICK_NONE;
+        if (quick == QUICK_CONST || ((quick == QUICK_LOCAL || quick == QUICK_GLOBAL) &&
+                                     node->items[0].count == 1)) {
+            CVM_Annot * annot = cvm_annot_of(node);
+            annot->quick = quick;
+            annot->value = operand->value;
+            annot->var = operand->var;
+        } else {
+            cvm_annot_of(node)->quick = QUICK_EXPR;
+        }
+    } break;
+    }
+}
+
+void cvm_annot_free(AST_Node * node) {
+    for (size_t i = 0; i < node->count; ++i) cvm_annot_free(node->items + i);
+    free(node->annot);
+    node->annot = NULL;
+}
+
+// limits
+
+double cvm_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int cvm_limit(const char * errmsg) {
+    cvm_errmsg = errmsg;
+    limit_hit = 1;
+    return 1;
+}
+
+// @return 1 if a limit is exceeded, to be propagated as an error
+int cvm_check_limits() {
+    if (!limits_on) return 0;
+    if (cvm_config.max_steps && cvm_stats.steps > cvm_config.max_steps) {
+        return cvm_limit("Statement limit exceeded");
+    }
+    if (cvm_config.max_time > 0 && limit_clock_countdown-- == 0) {
+        limit_clock_countdown = LIMIT_CLOCK_PERIOD;
+        if (cvm_now() - start_time > cvm_config.max_time) {
+            return cvm_limit("Time limit exceeded");
+        }
+    }
+    return 0;
+}
+
+// variables
+
+// arrays from this size on are anonymous mappings: the kernel hands out
+// zeroed pages on first touch, so untouched parts of a table cost nothing
+static const size_t CVM_MMAP_MIN_BYTES = 64 * 1024;
+
+int * cvm_alloc_values(size_t bytes) {
+    if (bytes < CVM_MMAP_MIN_BYTES) return (int *)calloc(1, bytes ? bytes : 1);
+    void * values = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (values == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+    if (cvm_config.huge_pages) madvise(values, bytes, MADV_HUGEPAGE); // a hint, may fail
+#endif
+    return (int *)values;
+}
+
+void cvm_free_values(int * values, size_t bytes) {
+    if (!values) return;
+    if (bytes < CVM_MMAP_MIN_BYTES) free(values);
+    else munmap(values, bytes);
+}
+
+// @return 1 if the memory limit is exceeded or the array cannot be mapped,
+// `vars` is left unchanged
+int cvm_declare(Vars * vars, AST_Node * node) {
+    // @assert node->count > 0
+    Var newvar = {*node->items[0].token};
+    if (node->count > 1) {
+        size_t size = 1, bytes;
+        int overflow = 0;
+        for (size_t i = 1; i < node->count; ++i) {
+            size_t dim = parse_size_t(node->items[i].token);
+            overflow |= __builtin_mul_overflow(size, dim, &size);
+            da_append(&newvar.dims, dim);
+        }
+        // a wrapped size would pass the limit and be indexed out of bounds
+        if (overflow || __builtin_mul_overflow(size, sizeof(int), &bytes)) {
+            da_free(&newvar.dims);
+            return cvm_limit("Out of memory");
+        }
+        if (cvm_config.max_memory && cvm_stats.memory + bytes > cvm_config.max_memory) {
+            da_free(&newvar.dims);
+            return cvm_limit("Memory limit exceeded");
+        }
+        newvar.values = cvm_alloc_values(bytes);
+        if (!newvar.values) {
+            da_free(&newvar.dims);
+            return cvm_limit("Out of memory");
+        }
+        newvar.bytes = bytes;
+        cvm_stats.memory += bytes;
+        if (cvm_stats.memory > cvm_stats.memory_max) cvm_stats.memory_max = cvm_stats.memory;
+    }
+    da_append(vars, newvar);
+    return 0;
+}
+
+void cvm_var_free(Var * var) {
+    if (var->values) cvm_stats.memory -= var->bytes;
+    cvm_free_values(var->values, var->bytes);
+    da_free(&var->dims);
+}
+
 void cvm_cleanup() {
     da_free(&funcs);
     
     for (size_t i = 0; i < globals.count; ++i) {
-        free(globals.items[i].values);
-        da_free(&globals.items[i].dims);
+        cvm_var_free(globals.items + i);
     }
     da_free(&globals);
 
     for (size_t i = 0; i < callstack.count; ++i) {
         for (int j = 0; j < callstack.items[i].count; ++j) {
-            free(callstack.items[i].items[j].values);
-            da_free(&callstack.items[i].items[j].dims);
+            cvm_var_free(callstack.items[i].items + j);
         }
         da_free(&callstack.items[i]);
     }
     da_free(&callstack);
+    da_free(&spare_frame);
+
+    for (size_t i = 0; i < programs.count; ++i) {
+        if (profile.recording) cvm_profile_collect(programs.items[i]);
+        cvm_annot_free(programs.items[i]);
+    }
+    da_free(&programs);
+    for (size_t i = 0; i < loops.count; ++i) {
+        da_free(&loops.items[i].checks);
+        da_free(&loops.items[i].written);
+    }
+    da_free(&loops);
+    da_free(&loop_states);
+    da_free(&slots);
+    n_slots = 0;
+    parallel_on = 0;
+    n_forks = 0;
+}
+
+
+// errors, counters and limits of one run, or of one input of a session
+// the memory counters carry over: arrays outlive the input that declared them
+void cvm_begin_run() {
+    cvm_errmsg = NULL;
+    cvm_errtok = NULL;
+    cvm_stats.steps = 0;
+    cvm_stats.depth_max = 0;
+    cvm_stats.time = 0;
+    limits_on = cvm_config.max_steps || cvm_config.max_depth ||
+        cvm_config.max_memory || cvm_config.max_time > 0;
+    limit_hit = 0;
+    limit_clock_countdown = LIMIT_CLOCK_PERIOD;
+    start_time = cvm_now();
+}
+
+// annotate a new tree, and make room for the runtime state of its loops
+void cvm_analyze_program(AST_Node * ast) {
+    if (!cvm_config.checked && cvm_config.opt_level < 1 && !profile.recording && !parallel_on) return;
+    Analysis_Ctx ctx = {};
+    cvm_analyze(ast, &ctx);
+    if (profile.recording) cvm_profile_annotate(ast);
+    if (cvm_config.opt_level >= 1) cvm_quicken(ast, &ctx);
+    da_append(&programs, ast);
+    while (slots.count < n_slots) da_append(&slots, ((Slot) {}));
+}
+
+// pool workers share the functions and loop analyses of the thread that
+// started the pool, read-only, and have their own runtime state
+typedef struct {
+    Funcs funcs;
+    Loops loops;
+    size_t n_slots;
+} CVM_Shared;
+
+static void cvm_worker_init(void * arg) {
+    CVM_Shared * shared = (CVM_Shared *)arg;
+    funcs = shared->funcs;
+    loops = shared->loops;
+    for (size_t i = 0; i < loops.count; ++i) da_append(&loop_states, ((Loop_State) {}));
+    for (size_t i = 0; i < shared->n_slots; ++i) da_append(&slots, ((Slot) {}));
+}
+
+static void cvm_worker_fini(void * arg) {
+    funcs = (Funcs) {};
+    loops = (Loops) {};
+    da_free(&loop_states);
+    da_free(&slots);
+    da_free(&callstack);
+    da_free(&spare_frame);
+}
+
+void cvm_copy_globals(CVM_Globals * out) {
+    for (size_t i = 0; i < globals.count; ++i) {
+        Var * var = globals.items + i;
+        CVM_Global copy = {var->iden, .n_dims = var->dims.count, .n_values = 1};
+        for (size_t j = 0; j < var->dims.count; ++j) copy.n_values *= var->dims.items[j];
+        copy.values = (int *)malloc(copy.n_values * sizeof(int));
+        memcpy(copy.values, var->dims.count ? var->values : &var->value, copy.n_values * sizeof(int));
+        if (copy.n_dims) {
+            copy.dims = (size_t *)malloc(copy.n_dims * sizeof(size_t));
+            memcpy(copy.dims, var->dims.items, copy.n_dims * sizeof(size_t));
+        }
+        da_append(out, copy);
+    }
 }
 
+void cvm_globals_free(CVM_Globals * globals) {
+    for (size_t i = 0; i < globals->count; ++i) {
+        free(globals->items[i].dims);
+        free(globals->items[i].values);
+    }
+    da_free(globals);
+}
 
 int cvm_run(int * ret_val, AST_Node * ast, FILE * is_, FILE * os_) {
     is = is_;
     os = os_;
+    cvm_stats = (CVM_Stats) {};
+    cvm_begin_run();
+    // limits, traces and profiles are the walker's
+    if (cvm_config.ir && !limits_on && !trace_ring.items && !profile.source && !profile.recording &&
+        !sample_stack.on) {
+        int status = ir_run(ret_val, ast, is, os);
+        if (status != IR_STATUS_FALLBACK) return status;
+    }
+    int status = 0;
+    // without threads, fall back to synchronous I/O
+    pipeio_on = cvm_config.pipelined_io && !pipeio_start(is, os);
 
-    for (AST_Node * node = ast->items; node - ast->items < ast->count; ++node) {
+    for (AST_Node * node = ast->items; node - ast->items < ast->count && !status; ++node) {
         switch (node->type) {
         case 'DECL': {
-            // @assert node->count > 0
-            Var newvar = {*node->items[0].token};
-            if (node->count > 1) {
-                size_t size = 1;
-                for (size_t i = 1; i < node->count; ++i) {
-                    size_t dim = parse_size_t(node->items[i].token);
-                    size *= dim;
-                    da_append(&newvar.dims, dim);
-                }
-                newvar.values = (int *)malloc(size * sizeof(int));
-            }
-            da_append(&globals, newvar);
+            status = cvm_declare(&globals, node);
         } break;
         case 'FUNC': {
             // @assert node->count > 0
             Func newfunc = {.iden = *node->items[0].token, .def = node};
+            newfunc.trace_id = trace_name(newfunc.iden.begin, newfunc.iden.len);
             /*
             if (node->count > 1) {
                 for (size_t i = 1; i < node->count ; ++i) {
@@ -153,28 +1123,170 @@ int cvm_run(int * ret_val, AST_Node * ast, FILE * is_, FILE * os_) {
         } // switch
     }
 
+    // lazily parsed bodies would grow the analyses the workers share
+    int has_lazy = 0;
+    for (size_t i = 0; i < funcs.count; ++i) {
+        AST_Node * def = funcs.items[i].def;
+        has_lazy |= def->items[def->count - 1].type == 'LAZY';
+    }
+    // counters, limits, traces and samples are per thread, a task would escape them
+    parallel_on = cvm_config.parallel_calls > 1 && !has_lazy && !limits_on &&
+        !profile.recording && !trace_ring.items && !sample_stack.on;
+    if (parallel_on) cvm_find_pure_funcs();
+    cvm_analyze_program(ast);
+    CVM_Shared shared = {funcs, loops, n_slots};
+    parallel_on = n_forks && !status &&
+        !pool_start(cvm_config.parallel_calls, cvm_worker_init, cvm_worker_fini, &shared);
+
     const char * entry_point_name = "main";
     Token entry_point_token = {entry_point_name, strlen(entry_point_name)};
     Func * entry_point = cvm_find_func(&entry_point_token);
-    int status;
-    if (entry_point) {
+    if (status) {
+        // limit hit by a global declaration
+    } else if (entry_point) {
         Vars args = {}; // no argument for main
         status = cvm_call(ret_val, entry_point, args);
     } else {
         status = 1;
     }
     
+    if (pipeio_on) pipeio_stop();
+    pipeio_on = 0;
+    if (parallel_on) pool_stop();
+    cvm_stats.time = cvm_now() - start_time;
+    if (cvm_globals_out) cvm_copy_globals(cvm_globals_out);
     cvm_cleanup();
+    if (limit_hit) status = CVM_STATUS_LIMIT;
     return status;
 }
 
+void cvm_session_begin(FILE * is_, FILE * os_) {
+    is = is_;
+    os = os_;
+    cvm_stats = (CVM_Stats) {};
+    cvm_begin_run();
+}
+
+int cvm_session_define(AST_Node * node) {
+    cvm_begin_run();
+    switch (node->type) {
+    case 'DECL': {
+        Vars declared = {};
+        if (cvm_declare(&declared, node)) return CVM_STATUS_LIMIT;
+        Var * old = cvm_find_var(&globals, node->items[0].token);
+        if (old) {
+            cvm_var_free(old);
+            *old = declared.items[0];
+        } else {
+            da_append(&globals, declared.items[0]);
+        }
+        da_free(&declared);
+    } break;
+    case 'FUNC': {
+        Func newfunc = {.iden = *node->items[0].token, .def = node};
+        newfunc.trace_id = trace_name(newfunc.iden.begin, newfunc.iden.len);
+        Func * old = cvm_find_func(&newfunc.iden);
+        if (old) *old = newfunc;
+        else da_append(&funcs, newfunc);
+        cvm_analyze_program(node);
+    } break;
+    default: return 1;
+    }
+    return 0;
+}
+
+int cvm_session_run(int * ret_val, AST_Node * node, int is_expr) {
+    cvm_begin_run();
+    // the session frame: statements run like the body of a function
+    // that never returns, whose locals stay around
+    if (callstack.count == 0) cvm_callstack_push((Vars) {});
+    cvm_analyze_program(node);
+    int status;
+    if (is_expr) {
+        status = cvm_eval_expr(ret_val, node);
+    } else {
+        status = cvm_execute_stmt(ret_val, node);
+        if (status == 2) status = 0;
+    }
+    cvm_stats.time = cvm_now() - start_time;
+    if (limit_hit) status = CVM_STATUS_LIMIT;
+    return status;
+}
+int cvm_session_exec(int * ret_val, AST_Node * node) {
+    return cvm_session_run(ret_val, node, 0);
+}
+int cvm_session_eval(int * ret_val, AST_Node * node) {
+    return cvm_session_run(ret_val, node, 1);
+}
+
+void cvm_session_end() {
+    cvm_cleanup();
+}
+
+
+// a function body left to first use by `ast_build_lazy`
+int cvm_parse_body(Func * func) {
+    AST_Node * lazy = func->def->items + func->def->count - 1;
+    Token * open = lazy->token;
+    if (ast_parse_lazy(func->def)) {
+        snprintf(cvm_errbuf, sizeof(cvm_errbuf), "%s in the body of `%.*s`",
+                 ast_builder_errmsg, (int)func->iden.len, func->iden.begin);
+        cvm_errmsg = cvm_errbuf;
+        cvm_errtok = open;
+        return 1;
+    }
+    cvm_analyze_program(func->def);
+    return 0;
+}
+
+// the frame of a returning function, emptied, becomes that of its tail call
+void cvm_callstack_replace(Vars newframe) {
+    Vars * frame = cvm_callstack_get();
+    for (size_t i = 0; i < frame->count; ++i) {
+        cvm_var_free(frame->items + i);
+    }
+    frame->count = 0;
+    if (spare_frame.items) da_free(frame);
+    else spare_frame = *frame;
+    *frame = newframe;
+}
 
 int cvm_call(int * ret_val, Func * func, Vars args) {
+    if (func->def->items[func->def->count - 1].type == 'LAZY' && cvm_parse_body(func)) {
+        da_free(&args);
+        return 1;
+    }
+    if (cvm_check_limits() ||
+        (cvm_config.max_depth && callstack.count >= cvm_config.max_depth &&
+         cvm_limit("Call depth limit exceeded"))) {
+        da_free(&args);
+        return 1;
+    }
     cvm_callstack_push(args);
+    if (callstack.count > cvm_stats.depth_max) cvm_stats.depth_max = callstack.count;
+    trace_event(TRACE_CALL, func->trace_id, 0);
+    sample_push(func->def);
     AST_Node * block = func->def->items + func->def->count - 1;
     int status = cvm_execute_block(ret_val, block);
+    // tail calls, in a loop rather than on the C stack
+    while (status == 3) {
+        func = tail_call.func;
+        cvm_callstack_replace(tail_call.args);
+        tail_call.args = (Vars) {};
+        sample_replace(func->def);
+        if (func->def->items[func->def->count - 1].type == 'LAZY' && cvm_parse_body(func)) {
+            status = 1;
+        } else if (cvm_check_limits()) {
+            status = 1;
+        } else {
+            block = func->def->items + func->def->count - 1;
+            status = cvm_execute_block(ret_val, block);
+        }
+    }
     if (status == 0 && ret_val) *ret_val = 0;
     if (status == 2) status = 0;
+    trace_event(TRACE_RETURN, func->trace_id, ret_val ? *ret_val : 0);
+    sample_pop();
     cvm_callstack_pop();
     return status;
 }
@@ -192,15 +1304,15 @@ void cvm_callstack_pop() {
     callstack.count -= 1;
     Vars * popped = callstack.items + callstack.count;
     for (size_t i = 0; i < popped->count; ++i) {
-        free(popped->items[i].values);
-        da_free(&popped->items[i].dims);
+        cvm_var_free(popped->items + i);
     }
     da_free(popped);
 }
 
 // if no return stmt is encountered, `ret_val` is not modified
 // so it is safe to pass NULL
-// @return 0 if success (no return), 1 if syntax error, 2 if returned
+// @return 0 if success (no return), 1 if syntax error, 2 if returned,
+// 3 if returned a tail call, see `tail_call`
 int cvm_execute_block(int * ret_val, AST_Node * node) {
     int status = 0;
     for (size_t i = 0; i < node->count; ++i) {
@@ -210,24 +1322,16 @@ int cvm_execute_block(int * ret_val, AST_Node * node) {
     return status; // should be 0
 }
 
-// @return 0 if success, 1 if syntax error, 2 if returned
+int cvm_eval_tail_call(AST_Node * call);
+
+// @return 0 if success, 1 if syntax error, 2 if returned, 3 if returned a tail call
 int cvm_execute_stmt(int * ret_val, AST_Node * node) {
     int status = 0;
+    cvm_stats.steps += 1;
+    sample_stmt(node);
     switch (node->type) {
     case 'DECL': {
-        // @assert node->count > 0
-        Var newvar = {*node->items[0].token};
-        if (node->count > 1) {
-            size_t size = 1;
-            for (size_t i = 1; i < node->count; ++i) {
-                size_t dim = parse_size_t(node->items[i].token);
-                size *= dim;
-                da_append(&newvar.dims, dim);
-            }
-            newvar.values = (int *)malloc(size * sizeof(int));
-        }
-        Vars * frame = cvm_callstack_get();
-        da_append(frame, newvar);
+        status = cvm_declare(cvm_callstack_get(), node);
     } break;
     case 'EXPS': {
         // @assert node->count == 1
@@ -239,6 +1343,7 @@ int cvm_execute_stmt(int * ret_val, AST_Node * node) {
         int cond;
         status = cvm_eval_expr(&cond, node->items + 0);
         if (status) break;
+        if (node->annot) node->annot->counts[cond != 0] += 1; // ANNOT_PROFILED
         
         AST_Node * branch = NULL;
         if (cond) branch = node->items + 1;
@@ -250,15 +1355,47 @@ int cvm_execute_stmt(int * ret_val, AST_Node * node) {
     case 'WHIL': {
         // @assert node->count == 2
         int cond;
-        while (1) {
+        // a new activation, the previous one is restored on exit for recursion
+        int has_state = node->annot && (node->annot->flags & ANNOT_LOOP);
+        Loop_State saved_state;
+        int done = 0; // run by a kernel
+        size_t n_iter = 0;
+        if (has_state) {
+            Loop * loop = loops.items + node->annot->loop;
+            Loop_State * state = loop_states.items + node->annot->loop;
+            saved_state = *state;
+            state->epoch = ++epoch_counter;
+            state->proven = cvm_config.checked && loop->counted && cvm_prove_loop(loop);
+            // a loop trace shows every iteration, which a kernel does not have
+            done = loop->kernel.kind != KERNEL_NONE && !trace_ring.loops && cvm_run_kernel(loop, &n_iter) == 0;
+        }
+        while (!done) {
+            sample_stmt(node); // the condition, after the body
             status = cvm_eval_expr(&cond, node->items + 0);
             if (status || !cond) break;
+            n_iter += 1;
+            cvm_stats.steps += 1; // an iteration, so that an empty body counts too
+            if (trace_ring.loops) trace_event(TRACE_LOOP, node->token->begin - trace_ring.source, 0);
             if (node->items[1].type == 'BLCK') status = cvm_execute_block(ret_val, node->items + 1);
             else status = cvm_execute_stmt(ret_val, node->items + 1);
+            if (status) break; // 1 or 2
+            status = cvm_check_limits(); // back-edge
+            if (status) break;
+        }
+        // by index: a body parsed on first call adds loops, `loop_states` may have moved
+        if (has_state) loop_states.items[node->annot->loop] = saved_state;
+        if (node->annot && (node->annot->flags & ANNOT_PROFILED)) {
+            node->annot->counts[0] += 1;
+            node->annot->counts[1] += n_iter;
         }
     } break;
     case 'RETN': {
         // @assert node->count == 1
+        // a trace shows every call and return, so no frame is skipped there
+        if (node->annot && (node->annot->flags & ANNOT_TAIL) && !trace_ring.items) {
+            status = cvm_eval_tail_call(unwrap_expr(node->items + 0));
+            break;
+        }
         status = cvm_eval_expr(ret_val, node->items + 0);
         if (status) break;
         status = 2; // successfully returned
@@ -268,11 +1405,223 @@ int cvm_execute_stmt(int * ret_val, AST_Node * node) {
     return status;
 }
 
+Var * cvm_lookup(Token * iden, int * is_local) {
+    Var * var = cvm_find_var(cvm_callstack_get(), iden);
+    if (is_local) *is_local = var != NULL;
+    if (!var) var = cvm_find_var(&globals, iden);
+    return var;
+}
+
+// whether the check of a subscript is covered by its loop
+int cvm_check_hoisted(AST_Node * sub) {
+    return sub->annot && (sub->annot->flags & ANNOT_HOISTED) &&
+        loop_states.items[sub->annot->loop].proven;
+}
+
+// at loop entry, check that every subscript `i` of the loop stays in bounds
+// for all values `i` can take in the body: [i, n) or [i, n]
+// @return 1 if proven, 0 if the subscripts have to be checked one by one
+int cvm_prove_loop(Loop * loop) {
+    int iv_local, bound_local = 1;
+    Var * iv = cvm_lookup(loop->iv, &iv_local);
+    if (!iv || iv->dims.count) return 0;
+    long long lo = iv->value, hi;
+    if (loop->bound->type == 'INTG') {
+        hi = intg_value(loop->bound);
+    } else {
+        Var * bound = cvm_lookup(loop->bound->items[0].token, &bound_local);
+        if (!bound || bound->dims.count) return 0;
+        hi = bound->value;
+    }
+    if (!loop->inclusive) hi -= 1;
+    // a callee can write globals behind our back
+    if (loop->has_call && (!iv_local || !bound_local)) return 0;
+    if (lo > hi) return 1; // the body never runs
+    if (lo < 0 || hi + loop->step > INT_MAX) return 0;
+    for (size_t i = 0; i < loop->checks.count; ++i) {
+        Bound_Check * check = loop->checks.items + i;
+        Var * arr = cvm_lookup(check->iden, NULL);
+        if (!arr || arr->dims.count != check->n_subs) return 0;
+        if (hi >= arr->dims.items[check->sub]) return 0;
+    }
+    return 1;
+}
+
+// the row of a kernel slice, if `[lo, hi)` is within it
+// @return NULL if the generic loop has to run instead
+int * cvm_kernel_row(AST_Node * node, long long lo, long long hi) {
+    Var * var = cvm_lookup(node->items[0].token, NULL);
+    if (!var || var->dims.count != node->count - 1) return NULL;
+    size_t n_dims = var->dims.count;
+    if (lo < 0 || hi > (long long)var->dims.items[n_dims - 1]) return NULL;
+    size_t offset = 0;
+    for (size_t i = 0; i + 1 < n_dims; ++i) {
+        int thisindex;
+        if (cvm_eval_expr(&thisindex, node->items + i + 1)) return NULL;
+        if (thisindex < 0 || (size_t)thisindex >= var->dims.items[i]) return NULL;
+        offset = offset * var->dims.items[i] + (size_t)thisindex;
+    }
+    return var->values + offset * var->dims.items[n_dims - 1];
+}
+
+// run a loop matched by `cvm_match_kernel`, at loop entry
+// every precondition is checked first, and nothing is written unless all hold:
+// then the generic loop runs instead and reports errors where they happen
+// @return 0 if the loop ran `n_iter` iterations, 1 if the generic loop has to run
+int cvm_run_kernel(Loop * loop, size_t * n_iter) {
+    Kernel * kernel = &loop->kernel;
+    Var * iv = cvm_lookup(loop->iv, NULL);
+    if (!iv || iv->dims.count) return 1;
+    long long lo = iv->value, hi;
+    if (loop->bound->type == 'INTG') {
+        hi = intg_value(loop->bound);
+    } else {
+        Var * bound = cvm_lookup(loop->bound->items[0].token, NULL);
+        if (!bound || bound->dims.count) return 1;
+        hi = bound->value;
+    }
+    if (loop->inclusive) hi += 1;
+    if (lo >= hi || hi > INT_MAX) return 1;
+    size_t n = hi - lo;
+    // the iteration and its two statements, as counted by the generic loop
+    if (limits_on && cvm_config.max_steps &&
+        cvm_stats.steps + 3 * n > cvm_config.max_steps) return 1;
+
+    if (kernel->kind == KERNEL_SUM) {
+        int * src = cvm_kernel_row(kernel->src[0], lo, hi);
+        Var * acc = cvm_lookup(kernel->dst->items[0].token, NULL);
+        if (!src || !acc || acc->dims.count) return 1;
+        acc->value = (int)((unsigned)acc->value + (unsigned)kernel_sum(src + lo, n));
+    } else {
+        Kernel_Operand operands[2] = {};
+        for (size_t i = 0; i < 2 && kernel->src[i]; ++i) {
+            AST_Node * src = kernel->src[i];
+            if (src->type == 'VARR' && src->count > 1 &&
+                is_scalar_var(src->items + src->count - 1, loop->iv)) {
+                int * row = cvm_kernel_row(src, lo, hi);
+                if (!row) return 1;
+                operands[i].row = row + lo;
+            } else if (cvm_eval_expr(&operands[i].value, src)) {
+                return 1;
+            }
+        }
+        int * dst = cvm_kernel_row(kernel->dst, lo, hi);
+        if (!dst) return 1;
+        if (kernel->kind == KERNEL_FILL) kernel_fill(dst + lo, operands[0].value, n);
+        else kernel_map(dst + lo, operands[0], kernel->op, operands[1], n);
+    }
+    iv->value = hi;
+    cvm_stats.steps += 3 * n;
+    *n_iter = n;
+    return 0;
+}
+
+int cvm_index_error(Var * var, AST_Node * node, int sub, int index) {
+    snprintf(cvm_errbuf, sizeof(cvm_errbuf),
+             "Index %d out of range [0, %zu) in subscript %d of `%.*s`",
+             index, var->dims.items[sub], sub + 1,
+             (int)var->iden.len, var->iden.begin);
+    cvm_errmsg = cvm_errbuf;
+    cvm_errtok = node->items[0].token;
+    return 1;
+}
+
+// ANNOT_BOUND, first access in an activation of the loop:
+// resolve the variable and sum up the invariant subscripts
+int cvm_bind_slot(Slot * slot, AST_Node * node) {
+    Var * var = cvm_lookup(node->items[0].token, NULL);
+    if (!var) return 1;
+    slot->var = var;
+    slot->iv = NULL;
+    slot->offset = 0;
+    if (node->count == 1) { // int
+        slot->values = &var->value;
+        return 0;
+    }
+    if (node->count - 1 != var->dims.count) return 1;
+    Loop * loop = loops.items + node->annot->loop;
+    size_t postfix_hypervolume = 1;
+    for (int i = var->dims.count - 1; i >= 0; --i) {
+        AST_Node * sub = node->items + i + 1;
+        if (loop->counted && is_scalar_var(sub, loop->iv)) {
+            Var * iv = cvm_lookup(loop->iv, NULL);
+            if (!iv) return 1;
+            slot->iv = &iv->value;
+            slot->iv_sub = i;
+            slot->stride = postfix_hypervolume;
+        } else {
+            int thisindex;
+            if (cvm_eval_expr(&thisindex, sub)) return 1;
+            if (cvm_config.checked &&
+                (thisindex < 0 || (size_t)thisindex >= var->dims.items[i])) {
+                return cvm_index_error(var, node, i, thisindex);
+            }
+            slot->offset += postfix_hypervolume * (size_t)thisindex;
+        }
+        postfix_hypervolume *= var->dims.items[i];
+    }
+    slot->values = var->values;
+    return 0;
+}
+
+int * get_bound_value(AST_Node * node) {
+    Slot * slot = slots.items + node->annot->slot;
+    size_t epoch = loop_states.items[node->annot->loop].epoch;
+    if (slot->epoch != epoch) {
+        if (cvm_bind_slot(slot, node)) return NULL;
+        slot->epoch = epoch;
+    }
+    if (!slot->iv) return slot->values + slot->offset;
+    int index = *slot->iv;
+    if (cvm_config.checked &&
+        !cvm_check_hoisted(node->items + slot->iv_sub + 1) &&
+        (index < 0 || (size_t)index >= slot->var->dims.items[slot->iv_sub])) {
+        cvm_index_error(slot->var, node, slot->iv_sub, index);
+        return NULL;
+    }
+    return slot->values + slot->offset + slot->stride * (size_t)index;
+}
+
+// QUICK_LOCAL or QUICK_GLOBAL
+static inline Var * cvm_quick_var(CVM_Annot * annot) {
+    if (annot->quick == QUICK_LOCAL) return cvm_callstack_get()->items + annot->var;
+    return globals.items + annot->var;
+}
+
+// the value of a quickened constant or scalar, read in place
+// @return 0 if `node` is neither and has to be evaluated
+static inline int cvm_quick_read(int * ret_val, AST_Node * node) {
+    CVM_Annot * annot = node->annot;
+    if (!annot) return 0;
+    if (annot->quick == QUICK_CONST) {
+        *ret_val = annot->value;
+        return 1;
+    }
+    if ((annot->quick != QUICK_LOCAL && annot->quick != QUICK_GLOBAL) || node->count != 1) return 0;
+    *ret_val = cvm_quick_var(annot)->value;
+    return 1;
+}
+
 int * get_value(AST_Node * node) {
     // @assert node->type == 'VARR'
-    Var * var = cvm_find_var(cvm_callstack_get(), node->items[0].token);
-    if (!var) {
-        var = cvm_find_var(&globals, node->items[0].token);
+    Var * var;
+    if (node->annot && node->annot->quick) {
+        var = cvm_quick_var(node->annot);
+        if (node->count == 2 && var->dims.count == 1) { // 1-D array
+            int index;
+            if (!cvm_quick_read(&index, node->items + 1) && cvm_eval_expr(&index, node->items + 1)) return NULL;
+            if (cvm_config.checked &&
+                !cvm_check_hoisted(node->items + 1) &&
+                (index < 0 || (size_t)index >= var->dims.items[0])) {
+                cvm_index_error(var, node, 0, index);
+                return NULL;
+            }
+            return var->values + index;
+        }
+    } else {
+        if (node->annot && (node->annot->flags & ANNOT_BOUND)) return get_bound_value(node);
+        var = cvm_find_var(cvm_callstack_get(), node->items[0].token);
+        if (!var) var = cvm_find_var(&globals, node->items[0].token);
         if (!var) return NULL;
     }
     if (node->count == 1) { // int
@@ -287,9 +1636,15 @@ int * get_value(AST_Node * node) {
         size_t postfix_hypervolume = 1;
         for (int i = var->dims.count - 1; i >= 0; --i) {
             int thisindex;
-            int status = cvm_eval_expr(&thisindex, node->items + i + 1);
-            if (status) return NULL;
-            // [!] @assume thisindex in-bounds
+            if (!cvm_quick_read(&thisindex, node->items + i + 1) &&
+                cvm_eval_expr(&thisindex, node->items + i + 1)) return NULL;
+            // unchecked: @assume thisindex in-bounds
+            if (cvm_config.checked &&
+                !cvm_check_hoisted(node->items + i + 1) &&
+                (thisindex < 0 || (size_t)thisindex >= var->dims.items[i])) {
+                cvm_index_error(var, node, i, thisindex);
+                return NULL;
+            }
             index += postfix_hypervolume * (size_t)thisindex;
             postfix_hypervolume *= var->dims.items[i];
         }
@@ -313,8 +1668,122 @@ int is_endl(AST_Node * node) {
         node->items[0].token != NULL &&
         tokstrcmp(node->items[0].token, "endl");
 }
+int cvm_eval_node(int * ret_val, AST_Node * node);
+
 // @return 0 for evaluated to int, 1 for syntax error, 2 for evaluated to cout, 3 for cin
 int cvm_eval_expr(int * ret_val, AST_Node * node) {
+    if (!node->annot) return cvm_eval_node(ret_val, node);
+    int value;
+    if (cvm_quick_read(&value, node)) {
+        if (ret_val) *ret_val = value;
+        return 0;
+    }
+    if (node->annot->quick == QUICK_EXPR) return cvm_eval_node(ret_val, node->items + 0);
+    if (!(node->annot->flags & ANNOT_INVARIANT)) return cvm_eval_node(ret_val, node);
+    // hoisted: evaluated on first use in each activation of its loop
+    Slot * slot = slots.items + node->annot->slot;
+    size_t epoch = loop_states.items[node->annot->loop].epoch;
+    if (slot->epoch != epoch) {
+        int status = cvm_eval_node(&slot->value, node);
+        if (status) return status;
+        slot->epoch = epoch;
+    }
+    if (ret_val) *ret_val = slot->value;
+    return 0;
+}
+
+// the frame of a call of `func`, freed on error
+int cvm_eval_args(Vars * args, Func * func, AST_Node * node) {
+    for (int i = 1; i < node->count; ++i) {
+        int thisarg;
+        int status = cvm_eval_expr(&thisarg, node->items + i);
+        if (status) {
+            da_free(args);
+            return status;
+        }
+        da_append(args, ((Var) {.iden = *func->def->items[i].token, .value = thisarg}));
+    }
+    return 0;
+}
+
+// the function called by a 'CALL', NULL if none takes its arguments
+Func * cvm_callee(AST_Node * node) {
+    CVM_Annot * annot = node->annot;
+    Func * func = annot && (annot->flags & ANNOT_CALLEE) ?
+        funcs.items + annot->func : cvm_find_func(node->items[0].token);
+    // only when profiling: pure calls may run on several threads
+    if (annot && (annot->flags & ANNOT_PROFILED)) annot->counts[0] += 1;
+    // node: iden expr expr .. expr
+    // func: iden expr expr .. expr blck
+    if (!func || node->count + 1 != func->def->count) return NULL;
+    return func;
+}
+
+// ANNOT_TAIL: the arguments are evaluated in the frame of the returning function,
+// into `spare_frame` if there is one, and `cvm_call` makes the call
+// @return 3, or 1 on error
+int cvm_eval_tail_call(AST_Node * call) {
+    Func * func = cvm_callee(call);
+    if (!func) return 1;
+    Vars args = spare_frame; // calls made by the arguments take another one
+    spare_frame = (Vars) {};
+    if (cvm_eval_args(&args, func, call)) return 1;
+    tail_call.func = func;
+    tail_call.args = args;
+    return 3;
+}
+
+// ANNOT_FORK: a pure call forked on the pool
+typedef struct {
+    Pool_Task task; // first, the pool hands it back as a `Pool_Task *`
+    Func * func;
+    Vars args;
+    int ret_val;
+    int status;
+    size_t steps; // executed by the task, counted by the thread that forked it
+    const char * errmsg;
+    const Token * errtok;
+} Call_Task;
+
+// runs on a thief, or in place when joined, maybe while the thread is
+// in the middle of something else whose counters and error it leaves alone
+static void cvm_run_task(Pool_Task * task) {
+    Call_Task * call = (Call_Task *)task;
+    size_t steps = cvm_stats.steps;
+    const char * errmsg = cvm_errmsg;
+    const Token * errtok = cvm_errtok;
+    cvm_errmsg = NULL;
+    cvm_errtok = NULL;
+    call->status = cvm_call(&call->ret_val, call->func, call->args);
+    call->steps = cvm_stats.steps - steps;
+    call->errmsg = cvm_errmsg;
+    call->errtok = cvm_errtok;
+    cvm_stats.steps = steps;
+    cvm_errmsg = errmsg;
+    cvm_errtok = errtok;
+}
+
+// `l` from a task, `r` in place meanwhile; errors of `l` come first as in sequence
+int cvm_eval_forked(int * l, int * r, AST_Node * node) {
+    AST_Node * call = unwrap_expr(node->items + 0);
+    Call_Task task = {.task.run = cvm_run_task, .func = funcs.items + node->annot->func};
+    int status = cvm_eval_args(&task.args, task.func, call);
+    if (status) return status;
+    int forked = !pool_fork(&task.task);
+    if (!forked) cvm_run_task(&task.task);
+    status = cvm_eval_expr(r, node->items + 1);
+    if (forked) pool_join(&task.task);
+    cvm_stats.steps += task.steps;
+    if (task.status) {
+        cvm_errmsg = task.errmsg;
+        cvm_errtok = task.errtok;
+        return task.status;
+    }
+    *l = task.ret_val;
+    return status;
+}
+
+int cvm_eval_node(int * ret_val, AST_Node * node) {
     // @assert node->type == 'EXPR'
     int status = 0;
     switch (node->type) {
@@ -328,21 +1797,14 @@ int cvm_eval_expr(int * ret_val, AST_Node * node) {
         if (ret_val) *ret_val = *value;
     } break;
     case 'CALL': {
-        Func * func = cvm_find_func(node->items[0].token);
-        // node: iden expr expr .. expr
-        // func: iden expr expr .. expr blck
-        if (!func || node->count + 1 != func->def->count) {
+        Func * func = cvm_callee(node);
+        if (!func) {
             status = 1;
             break;
         }
         Vars args = {}; // must be DA of int
-        // pass arguments
-        for (int i = 1; i < node->count; ++i) {
-            int thisarg;
-            status = cvm_eval_expr(&thisarg, node->items + i);
-            if (status) break;
-            da_append(&args, ((Var) {.iden = *func->def->items[i].token, .value = thisarg}));
-        }
+        status = cvm_eval_args(&args, func, node);
+        if (status) break;
         status = cvm_call(ret_val, func, args); // `args` ownership passed to stack manager
     } break;
     case 'INTG': {
@@ -363,7 +1825,9 @@ int cvm_eval_expr(int * ret_val, AST_Node * node) {
     } break;
     case 'BIOP': {
         // @assert node->count == 2
-        if (tokstrcmp(node->token, "<<") == 0) {
+        int op = node->annot && node->annot->quick == QUICK_BIOP ?
+            node->annot->value : cvm_biop(node->token);
+        if (op == OP_COUT) {
             if (!node->items[0].items[0].token ||
                 tokstrcmp(node->items[0].items[0].token, "cout") != 0) {
                 if (cvm_eval_expr(NULL, node->items + 0) != 2) { // cout
@@ -373,17 +1837,21 @@ int cvm_eval_expr(int * ret_val, AST_Node * node) {
             }
             if (node->items[1].items[0].token &&
                 tokstrcmp(node->items[1].items[0].token, "endl") == 0) {
-                fprintf(os, "\n");
+                if (pipeio_on) pipeio_write_endl();
+                else fprintf(os, "\n");
+                trace_event(TRACE_COUT, 1, 0);
                 status = 2; // return cout
                 break;
             } 
             int r;
             status = cvm_eval_expr(&r, node->items + 1);
             if (status) break;
-            fprintf(os, "%d", r);
+            if (pipeio_on) pipeio_write_int(r);
+            else fprintf(os, "%d", r);
+            trace_event(TRACE_COUT, 0, r);
             status = 2; // return cout
             break;
-        } else if (tokstrcmp(node->token, ">>") == 0) {
+        } else if (op == OP_CIN) {
             if (!node->items[0].items[0].token ||
                 tokstrcmp(node->items[0].items[0].token, "cin") != 0) {
                 if (cvm_eval_expr(NULL, node->items + 1) != 3) { // cin
@@ -396,10 +1864,12 @@ int cvm_eval_expr(int * ret_val, AST_Node * node) {
                 status = 1;
                 break;
             }
-            fscanf(is, "%d", pr);
+            if (pipeio_on) pipeio_read_int(pr);
+            else fscanf(is, "%d", pr);
+            trace_event(TRACE_CIN, 0, *pr);
             status = 3; // return cin
             break;
-        } else if (tokstrcmp(node->token, "=") == 0) {
+        } else if (op == OP_ASSIGN) {
             if (node->items[0].type != 'VARR') {
                 status = 1;
                 break;
@@ -410,50 +1880,65 @@ int cvm_eval_expr(int * ret_val, AST_Node * node) {
                 break;
             }
             int r;
-            status = cvm_eval_expr(&r, node->items + 1);
-            if (status) break;
+            if (!cvm_quick_read(&r, node->items + 1)) {
+                status = cvm_eval_expr(&r, node->items + 1);
+                if (status) break;
+            }
             *pl = r;
             if (ret_val) *ret_val = r;
             break;
-        } 
+        } else if (!cvm_config.eager_logic && (op == OP_AND || op == OP_OR)) {
+            // short circuit: the right operand is only evaluated if it decides
+            int is_and = op == OP_AND;
+            int l, r;
+            status = cvm_eval_expr(&l, node->items + 0);
+            if (status) break;
+            if (is_and ? !l : l) {
+                if (ret_val) *ret_val = !is_and;
+                break;
+            }
+            status = cvm_eval_expr(&r, node->items + 1);
+            if (status) break;
+            if (ret_val) *ret_val = r != 0;
+            break;
+        }
 
         int l, r;
-        status = cvm_eval_expr(&l, node->items + 0);
-        if (status) break;
-        status = cvm_eval_expr(&r, node->items + 1);
-        if (status) break;
-        
-        if (tokstrcmp(node->token, "*") == 0) {
-            if (ret_val) *ret_val = l * r;
-        } else if (tokstrcmp(node->token, "/") == 0) {
-            if (ret_val) *ret_val = l / r;
-        } else if (tokstrcmp(node->token, "%") == 0) {
-            if (ret_val) *ret_val = l % r;
-        } else if (tokstrcmp(node->token, "+") == 0) {
-            if (ret_val) *ret_val = l + r;
-        } else if (tokstrcmp(node->token, "-") == 0) {
-            if (ret_val) *ret_val = l - r;
-        } else if (tokstrcmp(node->token, "<=") == 0) {
-            if (ret_val) *ret_val = l <= r;
-        } else if (tokstrcmp(node->token, ">=") == 0) {
-            if (ret_val) *ret_val = l >= r;
-        } else if (tokstrcmp(node->token, "<") == 0) {
-            if (ret_val) *ret_val = l < r;
-        } else if (tokstrcmp(node->token, ">") == 0) {
-            if (ret_val) *ret_val = l > r;
-        } else if (tokstrcmp(node->token, "==") == 0) {
-            if (ret_val) *ret_val = l == r;
-        } else if (tokstrcmp(node->token, "!=") == 0) {
-            if (ret_val) *ret_val = l != r;
-        } else if (tokstrcmp(node->token, "^") == 0) {
-            if (ret_val) *ret_val = l && !r || !l && r;
-        } else if (tokstrcmp(node->token, "&&") == 0) {
-            if (ret_val) *ret_val = l && r;
-        } else if (tokstrcmp(node->token, "||") == 0) {
-            if (ret_val) *ret_val = l || r;
+        if (node->annot && (node->annot->flags & ANNOT_FORK) && pool_should_fork()) {
+            status = cvm_eval_forked(&l, &r, node);
+            if (status) break;
         } else {
-            // @assert unreachable
-            status = -1;
+            // quickened operands are read in place
+            if (!cvm_quick_read(&l, node->items + 0)) {
+                status = cvm_eval_expr(&l, node->items + 0);
+                if (status) break;
+            }
+            if (!cvm_quick_read(&r, node->items + 1)) {
+                status = cvm_eval_expr(&r, node->items + 1);
+                if (status) break;
+            }
+        }
+        
+        if (!ret_val) {
+            if (op == OP_NONE) status = -1; // @assert unreachable
+            break;
+        }
+        switch (op) {
+        case OP_MUL: *ret_val = l * r; break;
+        case OP_DIV: *ret_val = l / r; break;
+        case OP_MOD: *ret_val = l % r; break;
+        case OP_ADD: *ret_val = l + r; break;
+        case OP_SUB: *ret_val = l - r; break;
+        case OP_LE: *ret_val = l <= r; break;
+        case OP_GE: *ret_val = l >= r; break;
+        case OP_LT: *ret_val = l < r; break;
+        case OP_GT: *ret_val = l > r; break;
+        case OP_EQ: *ret_val = l == r; break;
+        case OP_NE: *ret_val = l != r; break;
+        case OP_XOR: *ret_val = l && !r || !l && r; break;
+        case OP_AND: *ret_val = l && r; break;
+        case OP_OR: *ret_val = l || r; break;
+        default: status = -1; // @assert unreachable
         }
     } break;
     }
@@ -3,6 +3,86 @@
 
 #include "ast_builder.h"
 
+typedef struct {
+    int eager_logic; // evaluate both operands of `&&` and `||`, as before short-circuiting
+    int checked; // check every subscript against the array dimensions
+    int opt_level; // 0: plain tree walking, 1: loop optimizer, 2: and array kernels (default)
+    int huge_pages; // ask for transparent huge pages for large arrays
+    int pipelined_io; // `cin`/`cout` through I/O threads in `cvm_run`, see pipeio.h
+    int parallel_calls; // threads for pure calls in `cvm_run`, see pool.h, 0 or 1 for none
+    int ir; // `cvm_run` lowers to the SSA IR and runs that when it can, see ir.h
+    const char * ir_passes; // comma separated, NULL for the default pipeline
+
+    // resource limits, 0 for none
+    size_t max_steps; // executed statements and loop iterations
+    size_t max_depth; // call depth
+    size_t max_memory; // bytes of arrays alive at once
+    double max_time; // seconds of wall time
+} CVM_Config;
+
+// counters of the last `cvm_run`, partial if it was aborted
+typedef struct {
+    size_t steps; // executed statements and loop iterations
+    size_t depth_max;
+    size_t memory; // bytes of arrays alive
+    size_t memory_max;
+    double time; // seconds
+} CVM_Stats;
+
+// the value of a global when a run ended, see `cvm_globals_out`
+typedef struct {
+    Token iden;
+    size_t * dims; // `n_dims` sizes, NULL for int
+    size_t n_dims;
+    int * values; // `n_values` elements in row-major order, 1 for int
+    size_t n_values;
+} CVM_Global;
+
+typedef struct {
+    CVM_Global * items;
+    size_t count;
+    size_t capacity;
+} CVM_Globals;
+
+// `cvm_run` status besides 0 (ok) and 1 (error)
+#define CVM_STATUS_LIMIT 4 // a resource limit was exceeded, see `cvm_errmsg`
+
+extern CVM_Config cvm_config;
+// per thread, like the rest of the VM state
+extern _Thread_local CVM_Stats cvm_stats;
+extern _Thread_local const char * cvm_errmsg; // NULL if no message, not heap alloc'ed
+extern _Thread_local const Token * cvm_errtok; // where `cvm_errmsg` happened, may be NULL
+// if set, `cvm_run` appends a copy of the globals to it at the end, failed or not
+extern _Thread_local CVM_Globals * cvm_globals_out;
+
+void cvm_globals_free(CVM_Globals * globals);
+
+// zeroed array storage, mapped from a size on, for the other engines as well
+int * cvm_alloc_values(size_t bytes);
+void cvm_free_values(int * values, size_t bytes);
+
 int cvm_run(int * ret_val, AST_Node * ast, FILE * is_, FILE * os_);
 
+// sessions, for the REPL: definitions and statements are added one at a time,
+// and globals keep their values in between
+// the nodes must outlive the session, each call resets errors and counters
+void cvm_session_begin(FILE * is_, FILE * os_);
+// a global 'DECL' or a 'FUNC', replacing any previous definition of the name
+int cvm_session_define(AST_Node * node);
+// a statement, `ret_val` gets the value of a `return`
+int cvm_session_exec(int * ret_val, AST_Node * node);
+// an expression, @return as `cvm_run`, or 2 and 3 for cout and cin
+int cvm_session_eval(int * ret_val, AST_Node * node);
+void cvm_session_end();
+
+// the state of the VM is per thread; coroutines that interleave runs on one
+// thread keep theirs in a CVM_State while another one runs (see coro.h)
+typedef struct CVM_State CVM_State;
+// the state of a new thread
+CVM_State * cvm_state_new();
+// exchanges the state of the calling thread with `state`
+void cvm_state_swap(CVM_State * state);
+// once its run ended, `cvm_run` frees what a run allocates
+void cvm_state_free(CVM_State * state);
+
 #endif // CVM_H_
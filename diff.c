@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stddef.h> // size_t
+#include <stdlib.h> // memory
+#include <string.h>
+
+#include "diff.h"
+#include "cvm.h"
+#include "spmd.h"
+
+typedef struct {
+    char * output; // heap alloc'ed
+    size_t output_len;
+    int status;
+    int ret_val;
+    char errmsg[256]; // empty if no message
+    const Token * errtok;
+    CVM_Globals globals;
+    size_t steps;
+} Diff_Result;
+
+// return 1 if a stream cannot be opened
+// the streams are files, not memory streams: `--pipelined-io` reads the descriptor
+static int diff_execute(Diff_Result * result, AST_Node * ast, const char * input, size_t input_len) {
+    *result = (Diff_Result) {.ret_val = -1};
+    FILE * is = tmpfile();
+    FILE * os = tmpfile();
+    if (!is || !os || fwrite(input, 1, input_len, is) != input_len || fseek(is, 0, SEEK_SET)) {
+        if (is) fclose(is);
+        if (os) fclose(os);
+        return 1;
+    }
+    cvm_globals_out = &result->globals;
+    result->status = cvm_run(&result->ret_val, ast, is, os);
+    cvm_globals_out = NULL;
+    if (cvm_errmsg) snprintf(result->errmsg, sizeof(result->errmsg), "%s", cvm_errmsg);
+    result->errtok = cvm_errtok;
+    result->steps = cvm_stats.steps;
+    fclose(is);
+
+    fflush(os);
+    long len = ftell(os);
+    result->output = (char *)malloc(len > 0 ? len : 1);
+    rewind(os);
+    result->output_len = len > 0 ? fread(result->output, 1, len, os) : 0;
+    fclose(os);
+    return 0;
+}
+
+static void diff_result_free(Diff_Result * result) {
+    free(result->output);
+    cvm_globals_free(&result->globals);
+}
+
+// the options that make the candidate differ from the reference
+static const char * diff_label(const CVM_Config * config) {
+    static char label[128];
+    snprintf(label, sizeof(label), "-O%d%s%s%s", config->opt_level,
+             config->parallel_calls > 1 ? " --parallel-calls" : "",
+             config->pipelined_io ? " --pipelined-io" : "",
+             config->ir ? " --ir" : "");
+    return label;
+}
+
+// the line holding `text[pos]`, up to 60 chars of it
+static void diff_print_line(FILE * report, const char * who, const char * text, size_t len, size_t pos) {
+    if (pos >= len) {
+        fprintf(report, "  %-12s <end of output>\n", who);
+        return;
+    }
+    size_t begin = pos;
+    while (begin > 0 && text[begin - 1] != '\n') --begin;
+    size_t end = pos;
+    while (end < len && text[end] != '\n') ++end;
+    if (end - begin > 60) end = begin + 60;
+    fprintf(report, "  %-12s %.*s\n", who, (int)(end - begin), text + begin);
+}
+
+static int diff_output(FILE * report, Diff_Result * ref, Diff_Result * opt, const char * label) {
+    size_t n = ref->output_len < opt->output_len ? ref->output_len : opt->output_len;
+    size_t pos = 0;
+    while (pos < n && ref->output[pos] == opt->output[pos]) ++pos;
+    if (pos == n && ref->output_len == opt->output_len) return 0;
+    size_t line = 1;
+    for (size_t i = 0; i < pos; ++i) line += ref->output[i] == '\n';
+    fprintf(report, "Output differs at line %zu:\n", line);
+    diff_print_line(report, "reference", ref->output, ref->output_len, pos);
+    diff_print_line(report, label, opt->output, opt->output_len, pos);
+    return 1;
+}
+
+static int diff_error(FILE * report, Diff_Result * ref, Diff_Result * opt, const char * label) {
+    if (ref->status == opt->status && strcmp(ref->errmsg, opt->errmsg) == 0 &&
+        ref->errtok == opt->errtok) return 0;
+    fprintf(report, "Status or error differs:\n");
+    Diff_Result * results[2] = {ref, opt};
+    const char * whos[2] = {"reference", label};
+    for (int i = 0; i < 2; ++i) {
+        const Token * tok = results[i]->errtok;
+        fprintf(report, "  %-12s status %d, %s", whos[i], results[i]->status,
+                results[i]->errmsg[0] ? results[i]->errmsg : "no message");
+        if (tok) fprintf(report, " at `%.*s`", (int)tok->len, tok->begin);
+        fprintf(report, "\n");
+    }
+    return 1;
+}
+
+static int diff_globals(FILE * report, Diff_Result * ref, Diff_Result * opt, const char * label) {
+    // the same AST declares the same globals in the same order
+    for (size_t i = 0; i < ref->globals.count && i < opt->globals.count; ++i) {
+        CVM_Global * r = ref->globals.items + i;
+        CVM_Global * o = opt->globals.items + i;
+        size_t j = 0;
+        while (j < r->n_values && j < o->n_values && r->values[j] == o->values[j]) ++j;
+        if (j == r->n_values && j == o->n_values) continue;
+        fprintf(report, "Global `%.*s", (int)r->iden.len, r->iden.begin);
+        // row-major index to subscripts
+        for (size_t k = 0; k < r->n_dims; ++k) {
+            size_t stride = 1;
+            for (size_t l = k + 1; l < r->n_dims; ++l) stride *= r->dims[l];
+            fprintf(report, "[%zu]", j / stride % r->dims[k]);
+        }
+        fprintf(report, "` differs:\n");
+        fprintf(report, "  %-12s %d\n", "reference", r->values[j]);
+        fprintf(report, "  %-12s %d\n", label, o->values[j]);
+        return 1;
+    }
+    if (ref->globals.count == opt->globals.count) return 0;
+    fprintf(report, "Number of globals differs: %zu in the reference, %zu with %s\n",
+            ref->globals.count, opt->globals.count, label);
+    return 1;
+}
+
+int diff_run(AST_Node * ast, const char * input, size_t input_len, FILE * report) {
+    CVM_Config config = cvm_config;
+    const char * label = diff_label(&config);
+    Diff_Result ref, opt;
+
+    cvm_config.opt_level = 0;
+    cvm_config.parallel_calls = 0;
+    cvm_config.pipelined_io = 0;
+    cvm_config.ir = 0;
+    int failed = diff_execute(&ref, ast, input, input_len);
+    cvm_config = config;
+    if (failed) {
+        fprintf(report, "ERROR: Cannot open temporary files.\n");
+        return 1;
+    }
+    if (diff_execute(&opt, ast, input, input_len)) {
+        diff_result_free(&ref);
+        fprintf(report, "ERROR: Cannot open temporary files.\n");
+        return 1;
+    }
+
+    int diverged = diff_output(report, &ref, &opt, label) ||
+        diff_error(report, &ref, &opt, label);
+    if (!diverged && ref.status == 0 && ref.ret_val != opt.ret_val) {
+        fprintf(report, "Return value differs:\n  %-12s %d\n  %-12s %d\n",
+                "reference", ref.ret_val, label, opt.ret_val);
+        diverged = 1;
+    }
+    if (!diverged) diverged = diff_globals(report, &ref, &opt, label);
+    if (!diverged && ref.steps != opt.steps) {
+        fprintf(report, "Executed statements differ:\n  %-12s %zu\n  %-12s %zu\n",
+                "reference", ref.steps, label, opt.steps);
+        diverged = 1;
+    }
+    if (!diverged) {
+        fprintf(report, "Same under the reference and %s: %zu bytes of output, status %d",
+                label, ref.output_len, ref.status);
+        if (ref.status == 0) fprintf(report, ", return value %d", ref.ret_val);
+        fprintf(report, ", %zu globals, %zu statements\n", ref.globals.count, ref.steps);
+    }
+    diff_result_free(&ref);
+    diff_result_free(&opt);
+    return diverged;
+}
+
+int diff_run_spmd(AST_Node * ast, const char ** inputs, const size_t * input_lens, size_t n_lanes,
+                  FILE * report) {
+    CVM_Config config = cvm_config;
+    Diff_Result refs[SPMD_LANES];
+    FILE * is[SPMD_LANES] = {};
+    int failed = 0;
+    size_t n_refs = 0;
+    cvm_config.opt_level = 0;
+    cvm_config.parallel_calls = 0;
+    cvm_config.pipelined_io = 0;
+    cvm_config.ir = 0;
+    for (; n_refs < n_lanes && !failed; ++n_refs) {
+        failed = diff_execute(refs + n_refs, ast, inputs[n_refs], input_lens[n_refs]);
+    }
+    cvm_config = config;
+    for (size_t l = 0; l < n_lanes && !failed; ++l) {
+        is[l] = tmpfile();
+        failed = !is[l] || fwrite(inputs[l], 1, input_lens[l], is[l]) != input_lens[l] ||
+            fseek(is[l], 0, SEEK_SET);
+    }
+    int ret_vals[SPMD_LANES];
+    int status = failed ? 1 : spmd_run(ret_vals, ast, is, n_lanes);
+    for (size_t l = 0; l < n_lanes; ++l) {
+        if (is[l]) fclose(is[l]);
+    }
+    if (failed) {
+        for (size_t l = 0; l < n_refs; ++l) diff_result_free(refs + l);
+        fprintf(report, "ERROR: Cannot open temporary files.\n");
+        return 1;
+    }
+
+    // a failed batch runs again on the cvm, which is right by definition, but
+    // then one of its inputs should fail on its own
+    int diverged = 0;
+    size_t n_failed = 0;
+    for (size_t l = 0; l < n_lanes; ++l) n_failed += refs[l].status != 0;
+    if (status && n_failed == 0) {
+        fprintf(report, "The batch fails although every input runs alone\n");
+        diverged = 1;
+    }
+    for (size_t l = 0; l < n_lanes && !status && !diverged; ++l) {
+        char label[32];
+        snprintf(label, sizeof(label), "--spmd lane %zu", l);
+        size_t len;
+        const char * output = spmd_output(l, &len);
+        // the lane as a run of its own that succeeded
+        Diff_Result lane = {.output = (char *)output, .output_len = len, .ret_val = ret_vals[l]};
+        diverged = diff_output(report, refs + l, &lane, label) ||
+            diff_error(report, refs + l, &lane, label);
+        if (!diverged && refs[l].ret_val != lane.ret_val) {
+            fprintf(report, "Return value differs:\n  %-12s %d\n  %-12s %d\n",
+                    "reference", refs[l].ret_val, label, lane.ret_val);
+            diverged = 1;
+        }
+    }
+    if (!diverged) {
+        fprintf(report, "Same under the reference and --spmd: %zu inputs, ", n_lanes);
+        if (status) fprintf(report, "%zu of them fail, so does the batch\n", n_failed);
+        else fprintf(report, "all of them succeed\n");
+    }
+    for (size_t l = 0; l < n_lanes; ++l) diff_result_free(refs + l);
+    return diverged;
+}
@@ -0,0 +1,41 @@
+#ifndef DIFF_H_
+#define DIFF_H_
+
+#include <stdio.h> // FILE
+#include <stddef.h> // size_t
+
+#include "ast_builder.h"
+
+/*
+  @def Differential execution
+
+  Runs a program twice on the same input: under the reference, the plain
+  tree walker (`-O0`, no parallel calls, no I/O threads, no `--ir`), then
+  under `cvm_config` as set by the options, and compares in this order
+
+  - the output, byte for byte
+  - the status and the error message, with its location
+  - the return value of `main`
+  - the final value of every global, element by element
+  - the number of executed statements, which `--max-steps` depends on
+
+  The semantic options (`--eager-logic`, `--checked`, the limits) are the
+  same for both runs. The first divergence is reported, with the line of
+  the output or the global element where it is.
+
+  Both runs change the shared `cvm_config`, so nothing else may run a
+  program meanwhile.
+*/
+
+// @return 0 if the runs agree, 1 if they diverge; `report` gets a summary,
+// or the first divergence
+int diff_run(AST_Node * ast, const char * input, size_t input_len, FILE * report);
+
+// `--spmd`: runs `n_lanes` inputs (at most SPMD_LANES) as one batch and
+// compares the output and return value of each lane to the reference on its
+// input; a batch that fails is right if one of its inputs fails alone
+// @return 0 if they agree, 1 if they diverge
+int diff_run_spmd(AST_Node * ast, const char ** inputs, const size_t * input_lens, size_t n_lanes,
+                  FILE * report);
+
+#endif // DIFF_H_
@@ -0,0 +1,132 @@
+// corpus runner for differential execution, see diff.h: generates programs with
+// quirks (see gen.h) from consecutive seeds, runs each under the reference and
+// under the given options, and prints every program whose runs diverge
+//   ./difftest --seeds 500 -O1 --parallel-calls
+// with --spmd, each program runs on SPMD_LANES inputs at once instead
+
+#define _GNU_SOURCE // open_memstream
+#include <stdio.h>
+#include <stddef.h> // size_t
+#include <stdlib.h> // memory
+#include <string.h> // strcmp
+
+#include "gen.h"
+#include "tokenizer.h"
+#include "ast_builder.h"
+#include "cvm.h"
+#include "diff.h"
+#include "spmd.h"
+
+// the shape of a program varies with its seed, small enough to run in milliseconds
+static Gen_Config corpus_config(uint64_t seed) {
+    Gen_Config config = {
+        .seed = seed,
+        .n_funcs = 1 + seed % 9,
+        .expr_depth = 1 + seed / 9 % 5,
+        .nesting = seed / 45 % 4,
+        .n_dims = 1 + seed / 7 % 3,
+        .loop_count = 1 + seed / 3 % 5,
+        .quirks = 1,
+    };
+    return config;
+}
+
+// @return 0 if the runs agree, 1 if they diverge, 2 if the program does not build
+static int diff_seed(uint64_t seed, int verbose, int spmd) {
+    Gen_Config config = corpus_config(seed);
+    Tokenizer tok = {};
+    tok.buffer = gen_program(&config);
+    // lanes on different inputs, so that they diverge
+    char inputs[SPMD_LANES][32];
+    const char * input_ptrs[SPMD_LANES];
+    size_t input_lens[SPMD_LANES];
+    for (int l = 0; l < SPMD_LANES; ++l) {
+        input_lens[l] = snprintf(inputs[l], sizeof(inputs[l]), "%d\n", (int)((seed * 7919 + l * 104729) % 1000));
+        input_ptrs[l] = inputs[l];
+    }
+    const char * input = inputs[0];
+    int input_len = input_lens[0];
+
+    AST_Node ast = {};
+    if (Tokenizer_tokenize(&tok) || ast_build(&ast, &tok)) {
+        printf("seed %llu: does not build: %s\n", (unsigned long long)seed,
+               tok.errmsg ? tok.errmsg : ast_builder_errmsg);
+        ast_free_node(&ast);
+        Tokenizer_free(&tok);
+        return 2;
+    }
+    char * report = NULL;
+    size_t report_len = 0;
+    FILE * os = open_memstream(&report, &report_len);
+    int status = !os ? 1 : spmd ? diff_run_spmd(&ast, input_ptrs, input_lens, SPMD_LANES, os) :
+        diff_run(&ast, input, input_len, os);
+    if (os) fclose(os);
+    if (status || verbose) {
+        printf("seed %llu: ./genprog --quirks --seed %llu --funcs %d --depth %d --nesting %d "
+               "--dims %d --loops %d, input %.*s", (unsigned long long)seed,
+               (unsigned long long)seed, config.n_funcs, config.expr_depth, config.nesting,
+               config.n_dims, config.loop_count, input_len, input);
+        for (int l = 1; spmd && l < SPMD_LANES; ++l) printf("  lane %d input %s", l, inputs[l]);
+        if (report) fputs(report, stdout);
+    }
+    free(report);
+    ast_free_node(&ast);
+    Tokenizer_free(&tok);
+    return status;
+}
+
+int main(int argc, char ** argv) {
+    uint64_t first = 1;
+    int n_seeds = 200;
+    int verbose = 0;
+    int parallel_calls = 0;
+    int spmd = 0;
+    int n_jobs = 4;
+    // a generated program terminates, the limit only guards against a broken engine
+    cvm_config.max_steps = 10000000;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--first") == 0 && i + 1 < argc) {
+            first = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--seeds") == 0 && i + 1 < argc) {
+            n_seeds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = 1;
+        } else if (strcmp(argv[i], "-O0") == 0 || strcmp(argv[i], "-O1") == 0 ||
+                   strcmp(argv[i], "-O2") == 0) {
+            cvm_config.opt_level = argv[i][2] - '0';
+        } else if (strcmp(argv[i], "--checked") == 0) {
+            cvm_config.checked = 1;
+        } else if (strcmp(argv[i], "--eager-logic") == 0) {
+            cvm_config.eager_logic = 1;
+        } else if (strcmp(argv[i], "--parallel-calls") == 0) {
+            parallel_calls = 1;
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            n_jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pipelined-io") == 0) {
+            cvm_config.pipelined_io = 1;
+        } else if (strcmp(argv[i], "--ir") == 0) {
+            cvm_config.ir = 1;
+        } else if (strcmp(argv[i], "--ir-passes") == 0 && i + 1 < argc) {
+            cvm_config.ir_passes = argv[++i];
+        } else if (strcmp(argv[i], "--spmd") == 0) {
+            spmd = 1;
+        } else {
+            printf("Usage: %s [--first <seed>] [--seeds <n>] [--verbose] [-O0|-O1|-O2] [--checked] "
+                   "[--eager-logic] [--parallel-calls] [--jobs <n>] [--pipelined-io] [--ir] [--ir-passes <list>] [--spmd]\n", argv[0]);
+            return 1;
+        }
+    }
+    // the limits would turn parallel calls and the IR off
+    if (parallel_calls) cvm_config.parallel_calls = n_jobs;
+    if (parallel_calls || cvm_config.ir) cvm_config.max_steps = 0;
+
+    int n_diverged = 0, n_broken = 0;
+    for (int i = 0; i < n_seeds; ++i) {
+        int status = diff_seed(first + i, verbose, spmd);
+        n_diverged += status == 1;
+        n_broken += status == 2;
+        fflush(stdout);
+    }
+    printf("%d programs, %d diverged, %d did not build\n", n_seeds, n_diverged, n_broken);
+    return n_diverged || n_broken;
+}
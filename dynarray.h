@@ -30,6 +30,7 @@ static const size_t DA_INIT_CAP = 2; // lots of binary operations
 #define da_free(da)                             \
     do {                                        \
         free((da)->items);                      \
+        (da)->items = NULL;                     \
         (da)->count = 0;                        \
         (da)->capacity = 0;                     \
     } while (0)
@@ -0,0 +1,264 @@
+#include <stdio.h> // vsnprintf
+#include <stddef.h> // size_t
+#include <stdint.h>
+#include <stdlib.h> // memory
+#include <stdarg.h>
+
+#include "gen.h"
+
+#define GEN_ARRAY_ELEMENTS 4096
+#define GEN_STMTS 3 // plain statements per block
+
+typedef struct {
+    char * items;
+    size_t count;
+    size_t capacity;
+} Gen_Text;
+
+typedef struct {
+    const Gen_Config * config;
+    uint64_t state; // splitmix64
+    Gen_Text text;
+    int dim; // size of each array dimension
+    int func; // index of the function being generated
+    int level; // loop nesting in the function, `k<level>` are the counters
+} Gen;
+
+static uint64_t gen_next(Gen * gen) {
+    uint64_t z = (gen->state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+// in [0, n)
+static int gen_below(Gen * gen, int n) {
+    return (int)(gen_next(gen) % (uint64_t)n);
+}
+
+static void gen_printf(Gen * gen, const char * fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (gen->text.capacity < gen->text.count + len + 1) {
+        size_t capacity = 2 * gen->text.capacity;
+        if (capacity < gen->text.count + len + 1) capacity = gen->text.count + len + 1;
+        gen->text.items = (char *)realloc(gen->text.items, capacity);
+        gen->text.capacity = capacity;
+    }
+    va_start(args, fmt);
+    vsnprintf(gen->text.items + gen->text.count, len + 1, fmt, args);
+    va_end(args);
+    gen->text.count += len;
+}
+
+static void gen_indent(Gen * gen, int depth) {
+    gen_printf(gen, "%*s", 4 * depth, "");
+}
+
+static void gen_expr(Gen * gen, int depth);
+
+// a subscript in [0, dim)
+static void gen_subscript(Gen * gen) {
+    gen_printf(gen, "[((");
+    if (gen->level && gen_below(gen, 2)) gen_printf(gen, "k%d", gen_below(gen, gen->level));
+    else gen_printf(gen, "v%d", gen_below(gen, 3));
+    gen_printf(gen, ") %% %d + %d) %% %d]", gen->dim, gen->dim, gen->dim);
+}
+
+// with quirks: `!`, and calls of the previous function where `gen_func` may
+static void gen_leaf(Gen * gen) {
+    int calls = gen->level == 0 && gen->func % 4;
+    switch (gen_below(gen, gen->config->quirks ? 7 : 5)) {
+    case 0: gen_printf(gen, "%d", gen_below(gen, 100)); break;
+    case 1: gen_printf(gen, "x"); break;
+    case 2: gen_printf(gen, "g"); break;
+    case 3: {
+        gen_printf(gen, "arr");
+        for (int i = 0; i < gen->config->n_dims; ++i) gen_subscript(gen);
+    } break;
+    case 5: gen_printf(gen, "!v%d", gen_below(gen, 3)); break;
+    case 6: {
+        if (calls) gen_printf(gen, "f%d(v%d)", gen->func - 1, gen_below(gen, 3));
+        else gen_printf(gen, "g");
+    } break;
+    default: gen_printf(gen, "v%d", gen_below(gen, 3));
+    }
+}
+
+// a chain of `depth` operators, the deep side chosen at random
+static void gen_expr(Gen * gen, int depth) {
+    // the last three with quirks only
+    static const char * ops[] = {"+", "-", "*", "<", "==", "!=", "&&", "||", "^", "/", "%"};
+    if (depth == 0) {
+        gen_leaf(gen);
+        return;
+    }
+    const char * op = ops[gen_below(gen, sizeof(ops) / sizeof(*ops) - (gen->config->quirks ? 0 : 3))];
+    int wrap = depth % 3 == 0; // keeps values below 997 * 9^3
+    gen_printf(gen, wrap ? "((" : "(");
+    if (op[0] == '*' || op[0] == '/' || op[0] == '%') { // by a small literal only
+        gen_expr(gen, depth - 1);
+        gen_printf(gen, " %s %d", op, 1 + gen_below(gen, 9));
+    } else if (gen_below(gen, 2)) {
+        gen_expr(gen, depth - 1);
+        gen_printf(gen, " %s ", op);
+        gen_leaf(gen);
+    } else {
+        gen_leaf(gen);
+        gen_printf(gen, " %s ", op);
+        gen_expr(gen, depth - 1);
+    }
+    gen_printf(gen, wrap ? ") %% 997)" : ")");
+}
+
+static void gen_assign(Gen * gen, int indent) {
+    gen_indent(gen, indent);
+    if (gen_below(gen, 3) == 0) {
+        gen_printf(gen, "arr");
+        for (int i = 0; i < gen->config->n_dims; ++i) gen_subscript(gen);
+    } else {
+        gen_printf(gen, "v%d", gen_below(gen, 3));
+    }
+    gen_printf(gen, " = ");
+    gen_expr(gen, gen->config->expr_depth);
+    gen_printf(gen, " %% 997;\n");
+}
+
+// `nesting` levels below, alternating loops and branches
+static void gen_block(Gen * gen, int nesting, int indent) {
+    for (int i = 0; i < GEN_STMTS; ++i) gen_assign(gen, indent);
+    if (nesting == 0) return;
+    if (nesting % 2 == gen->config->nesting % 2) {
+        int k = gen->level++;
+        gen_indent(gen, indent);
+        gen_printf(gen, "k%d = 0;\n", k);
+        gen_indent(gen, indent);
+        gen_printf(gen, "while (k%d < %d) {\n", k, gen->config->loop_count);
+        if (gen->config->quirks) {
+            // declared on every iteration, the first declaration is the one in use
+            gen_indent(gen, indent + 1);
+            gen_printf(gen, "int t%d;\n", k);
+            gen_indent(gen, indent + 1);
+            gen_printf(gen, "t%d = t%d + k%d + 1;\n", k, k, k);
+        }
+        gen_block(gen, nesting - 1, indent + 1);
+        gen_indent(gen, indent + 1);
+        gen_printf(gen, "k%d = k%d + 1;\n", k, k);
+        gen_indent(gen, indent);
+        gen_printf(gen, "}\n");
+        gen->level -= 1;
+        if (gen->config->quirks) { // locals outlive their block
+            gen_indent(gen, indent);
+            gen_printf(gen, "v%d = (v%d + t%d) %% 997;\n", gen_below(gen, 3), gen_below(gen, 3), k);
+        }
+    } else {
+        gen_indent(gen, indent);
+        gen_printf(gen, "if (");
+        gen_expr(gen, gen->config->expr_depth);
+        gen_printf(gen, ") {\n");
+        gen_block(gen, nesting - 1, indent + 1);
+        gen_indent(gen, indent);
+        gen_printf(gen, "} else {\n");
+        gen_block(gen, nesting - 1, indent + 1);
+        gen_indent(gen, indent);
+        gen_printf(gen, "}\n");
+    }
+}
+
+// `arr[..][i]`, the other subscripts invariant
+static void gen_row(Gen * gen) {
+    gen_printf(gen, "arr");
+    for (int i = 1; i < gen->config->n_dims; ++i) gen_subscript(gen);
+    gen_printf(gen, "[i]");
+}
+
+// a loop in the shape of a kernel of kernels.h: fill, sum or map a row
+static void gen_kernel_loop(Gen * gen) {
+    gen_printf(gen, "    i = 0;\n    while (i < %d) {\n        ", gen->dim);
+    int kind = gen_below(gen, 3);
+    if (kind == 0) {
+        gen_row(gen);
+        gen_printf(gen, " = v%d;\n", gen_below(gen, 3));
+    } else if (kind == 1) {
+        gen_printf(gen, "v2 = v2 + ");
+        gen_row(gen);
+        gen_printf(gen, ";\n");
+    } else {
+        // no `*`: values would grow with each call
+        gen_row(gen);
+        gen_printf(gen, " = ");
+        gen_row(gen);
+        gen_printf(gen, " %s v%d;\n", gen_below(gen, 2) ? "+" : "-", gen_below(gen, 2));
+    }
+    gen_printf(gen, "        i = i + 1;\n    }\n");
+    if (kind == 1) gen_printf(gen, "    v2 = v2 %% 997;\n");
+}
+
+static void gen_func(Gen * gen) {
+    const Gen_Config * config = gen->config;
+    gen_printf(gen, "int f%d(int x) {\n", gen->func);
+    gen_printf(gen, "    int v0;\n    int v1;\n    int v2;\n");
+    for (int i = 0; i < (config->nesting + 1) / 2; ++i) gen_printf(gen, "    int k%d;\n", i);
+    if (config->quirks) gen_printf(gen, "    int i;\n");
+    gen_printf(gen, "    v0 = x %% 997;\n    v1 = %d;\n    v2 = 0;\n", gen->func % 997);
+    // a call chain at most 4 deep: the interpreter recurses on the C stack
+    if (gen->func % 4) gen_printf(gen, "    v2 = f%d(v0) %% 997;\n", gen->func - 1);
+    gen_block(gen, config->nesting, 1);
+    if (config->quirks && gen->func % 3 == 0) {
+        // declared in one branch only, the local then hides `g` for the rest of the call
+        gen_printf(gen, "    if (x %% 2) {\n        int g;\n        g = v1;\n"
+                   "        v0 = (v0 + g) %% 997;\n    }\n");
+    }
+    if (config->quirks) gen_kernel_loop(gen);
+    // `return` followed by a parenthesis does not parse, the sum goes through v0
+    gen_printf(gen, "    v0 = (v0 + v1 + v2) %% 997;\n");
+    gen_printf(gen, "    g = (g + v0) %% 997;\n");
+    if (config->quirks && gen->func % 3 == 1) gen_printf(gen, "    cout << v0 << endl << v1 << endl;\n");
+    if (config->quirks && gen->func % 5 == 4) {
+        gen_printf(gen, "}\n"); // returns 0
+    } else if (config->quirks && gen->func % 5 == 2 && gen->func % 4) {
+        gen_printf(gen, "    return f%d(v0);\n}\n", gen->func - 1);
+    } else {
+        gen_printf(gen, "    return v0;\n}\n");
+    }
+}
+
+char * gen_program(const Gen_Config * config) {
+    Gen gen = {config, config->seed};
+    // the largest size with dim^n_dims <= GEN_ARRAY_ELEMENTS, at least 2
+    for (gen.dim = 2; gen.dim < GEN_ARRAY_ELEMENTS; ++gen.dim) {
+        long long elements = 1;
+        for (int i = 0; i < config->n_dims; ++i) elements *= gen.dim + 1;
+        if (elements > GEN_ARRAY_ELEMENTS) break;
+    }
+
+    gen_printf(&gen, "int g;\nint arr");
+    for (int i = 0; i < config->n_dims; ++i) gen_printf(&gen, "[%d]", gen.dim);
+    gen_printf(&gen, ";\n");
+    for (gen.func = 0; gen.func < config->n_funcs; ++gen.func) gen_func(&gen);
+
+    if (!config->quirks) {
+        gen_printf(&gen, "int main() {\n    int s;\n    s = 0;\n");
+        for (int i = 0; i < config->n_funcs; ++i) {
+            gen_printf(&gen, "    s = (s + f%d(%d)) %% 10007;\n", i, i);
+        }
+        gen_printf(&gen, "    cout << s << endl;\n    cout << g << endl;\n    return 0;\n}\n");
+        return gen.text.items;
+    }
+
+    // the calls of `p` can run in parallel, `r` reuses its frame
+    gen_printf(&gen, "int p(int x) {\n    int y;\n    if (x < 2) return x;\n"
+               "    y = p(x - 1) + p(x - 2);\n    return y %% 997;\n}\n");
+    gen_printf(&gen, "int r(int x) {\n    if (x < 1) return g;\n"
+               "    g = (g + x * 3) %% 997;\n    return r(x - 1);\n}\n");
+    gen_printf(&gen, "int main() {\n    int s;\n    int n;\n    cin >> n;\n    s = 0;\n");
+    for (int i = 0; i < config->n_funcs; ++i) {
+        gen_printf(&gen, "    s = (s + f%d(%d + n)) %% 10007;\n", i, i);
+    }
+    gen_printf(&gen, "    s = (s + p(n %% 6 + 10)) %% 10007;\n");
+    gen_printf(&gen, "    s = (s + r(n %% 500 + 500)) %% 10007;\n");
+    gen_printf(&gen, "    cout << s << endl << g << endl << (s ^ n) << endl;\n}\n");
+    return gen.text.items;
+}
@@ -0,0 +1,49 @@
+#ifndef GEN_H_
+#define GEN_H_
+
+#include <stdint.h>
+
+/*
+  @def Program generator
+
+  Deterministic synthetic programs for scaling benchmarks: the same
+  config gives the same text on every platform (own PRNG, no `rand`).
+
+  int g; int arr[s]..[s];          -- `n_dims` dimensions of size s, about 4096 elements
+  int f<i>(int x) { ... }          -- `n_funcs` functions
+  int main() { ... }               -- calls every function once, prints a checksum
+
+  A function body is a block of statements nested `nesting` deep, the
+  nesting alternating between `while` loops of `loop_count` iterations and
+  `if`/`else`; both branches are generated, so the text grows as
+  2^(nesting / 2). Every expression is a chain of `expr_depth` binary
+  operators; values are kept small with `% 997` so nothing overflows.
+  A function may call the previous one outside of its loops.
+
+  With `quirks`, the programs also exercise the corners of the dialect
+  and of the optimizers, for differential testing (see diff.h) rather
+  than for timing: logical `^`, `/` and `%`, `!`, calls in expressions
+  (short-circuited or not), a local declared in a loop body and used
+  after it, a local declared in one branch that hides the global `g`
+  for the rest of the call, functions that fall off their end (implicit `return 0`) or
+  end in a tail call, `cout` chains, loops in the shape of the `-O2`
+  kernels, a pure recursive function `p` and a tail recursive one `r`.
+  `main` reads one integer with `cin` and has no `return`.
+*/
+
+typedef struct {
+    uint64_t seed;
+    int n_funcs;
+    int expr_depth;
+    int nesting;
+    int n_dims;
+    int loop_count;
+    int quirks;
+} Gen_Config;
+
+#define GEN_DEFAULTS ((Gen_Config) {1, 16, 4, 2, 2, 8, 0})
+
+// the program text, heap alloc'ed
+char * gen_program(const Gen_Config * config);
+
+#endif // GEN_H_
@@ -0,0 +1,44 @@
+// prints a synthetic program, see gen.h
+
+#include <stdio.h>
+#include <stdlib.h> // strtoull
+#include <string.h> // strcmp
+
+#include "gen.h"
+
+int main(int argc, char ** argv) {
+    Gen_Config config = GEN_DEFAULTS;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            config.seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--funcs") == 0 && i + 1 < argc) {
+            config.n_funcs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+            config.expr_depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--nesting") == 0 && i + 1 < argc) {
+            config.nesting = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--dims") == 0 && i + 1 < argc) {
+            config.n_dims = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--loops") == 0 && i + 1 < argc) {
+            config.loop_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--quirks") == 0) {
+            config.quirks = 1;
+        } else {
+            printf("Usage: %s [--seed <n>] [--funcs <n>] [--depth <n>] [--nesting <n>] "
+                   "[--dims <n>] [--loops <n>] [--quirks]\n", argv[0]);
+            printf("Defaults: --seed %llu --funcs %d --depth %d --nesting %d --dims %d --loops %d\n",
+                   (unsigned long long)config.seed, config.n_funcs, config.expr_depth,
+                   config.nesting, config.n_dims, config.loop_count);
+            return 1;
+        }
+    }
+    if (config.n_funcs < 1 || config.expr_depth < 0 || config.nesting < 0 ||
+        config.n_dims < 1 || config.loop_count < 0) {
+        printf("ERROR: --funcs and --dims must be at least 1, the others at least 0.\n");
+        return 1;
+    }
+    char * text = gen_program(&config);
+    fputs(text, stdout);
+    free(text);
+    return 0;
+}
@@ -0,0 +1,1109 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h> // SIZE_MAX
+#include <stdlib.h> // memory
+#include <string.h>
+
+#include "ir.h"
+#include "cvm.h"
+#include "dynarray.h"
+#include "tokenizer.h"
+#include "ast_builder.h"
+
+// @desc
+// lowering from the AST, the verifier and the printer, see ir.h
+// the passes are in ir_pass.c, the interpreter in ir_exec.c
+
+const char * ir_errmsg = NULL;
+static char ir_errbuf[256];
+
+#define tokstrcmp(tok, str) (strlen(str) != (tok)->len || strncmp(str, (tok)->begin, (tok)->len))
+static int ir_tokcmp(const Token * l, const Token * r) {
+    if (l->len != r->len) return 1;
+    return strncmp(l->begin, r->begin, l->len);
+}
+
+// @return 1
+static int ir_error(const char * what, const Token * name) {
+    snprintf(ir_errbuf, sizeof(ir_errbuf), what, (int)name->len, name->begin);
+    ir_errmsg = ir_errbuf;
+    return 1;
+}
+
+// instructions and blocks
+
+int ir_is_terminator(int op) {
+    return op == IR_JUMP || op == IR_BRANCH || op == IR_RETURN || op == IR_FAIL;
+}
+
+int ir_has_value(int op) {
+    switch (op) {
+    case IR_CONST: case IR_PARAM: case IR_PHI: case IR_COPY: case IR_BINOP: case IR_NOT:
+    case IR_LOAD: case IR_ALOAD: case IR_CALL: case IR_IN: return 1;
+    default: return 0;
+    }
+}
+
+int ir_new_inst(IR_Func * f, int op) {
+    IR_Inst inst = {.op = op, .block = -1, .local = -1, .global = -1};
+    da_append(&f->insts, inst);
+    return (int)f->insts.count - 1;
+}
+
+size_t ir_n_phis(IR_Func * f, int block) {
+    IR_Ids * insts = &f->blocks.items[block].insts;
+    size_t n = 0;
+    while (n < insts->count && f->insts.items[insts->items[n]].op == IR_PHI) ++n;
+    return n;
+}
+
+void ir_insert(IR_Func * f, int block, size_t pos, int id) {
+    IR_Ids * insts = &f->blocks.items[block].insts;
+    da_append(insts, 0);
+    memmove(insts->items + pos + 1, insts->items + pos, (insts->count - 1 - pos) * sizeof(int));
+    insts->items[pos] = id;
+    f->insts.items[id].block = block;
+}
+
+void ir_remove_inst(IR_Func * f, int id) {
+    IR_Inst * inst = f->insts.items + id;
+    IR_Ids * insts = &f->blocks.items[inst->block].insts;
+    size_t pos = 0;
+    while (insts->items[pos] != id) ++pos;
+    memmove(insts->items + pos, insts->items + pos + 1, (insts->count - 1 - pos) * sizeof(int));
+    insts->count -= 1;
+    inst->block = -1;
+}
+
+int ir_insert_const(IR_Func * f, int block, int value) {
+    int id = ir_new_inst(f, IR_CONST);
+    f->insts.items[id].imm = value;
+    ir_insert(f, block, ir_n_phis(f, block), id);
+    return id;
+}
+
+void ir_remove_pred(IR_Func * f, int block, int pred) {
+    IR_Block * b = f->blocks.items + block;
+    size_t pos = 0;
+    while (b->preds.items[pos] != pred) ++pos;
+    memmove(b->preds.items + pos, b->preds.items + pos + 1, (b->preds.count - 1 - pos) * sizeof(int));
+    b->preds.count -= 1;
+    for (size_t i = 0; i < ir_n_phis(f, block); ++i) {
+        IR_Ids * args = &f->insts.items[b->insts.items[i]].args;
+        memmove(args->items + pos, args->items + pos + 1, (args->count - 1 - pos) * sizeof(int));
+        args->count -= 1;
+    }
+}
+
+// lowering
+
+// a name declared in the function being lowered
+typedef struct {
+    const Token * iden;
+    int array; // index in the arrays of the function, -1 for an int
+    int param;
+} IR_Local;
+
+typedef struct {
+    IR_Program * prog;
+    IR_Func * f;
+    int block; // being filled, -1 after a terminator until the next instruction
+    struct {
+        IR_Local * items;
+        size_t count;
+        size_t capacity;
+    } locals;
+    // SSA construction on the fly (Braun et al.): local k is variable k,
+    // whether it is declared yet is variable `locals.count + k`
+    size_t n_vars;
+    IR_Ids defs; // defs[block * n_vars + var]: its value at the end of the block so far, -1 if none
+    IR_Ids sealed; // per block: all predecessors are known
+    IR_Ids incomplete; // (block, var, phi) triples, operands added when the block is sealed
+    IR_Ids forward; // per instruction: the value a trivial phi was replaced with, -1 if none
+    // whether each local is surely / possibly declared at this point of the
+    // source, so that most names resolve at lowering time
+    IR_Ids surely;
+    IR_Ids possibly;
+} IR_Lower;
+
+static int ir_block(IR_Lower * L);
+
+static int ir_emit(IR_Lower * L, int op) {
+    int block = ir_block(L);
+    int id = ir_new_inst(L->f, op);
+    da_append(&L->f->blocks.items[block].insts, id);
+    L->f->insts.items[id].block = block;
+    return id;
+}
+
+static int ir_emit1(IR_Lower * L, int op, int arg) {
+    int id = ir_emit(L, op);
+    da_append(&L->f->insts.items[id].args, arg);
+    return id;
+}
+
+static int ir_const(IR_Lower * L, int value) {
+    int id = ir_emit(L, IR_CONST);
+    L->f->insts.items[id].imm = value;
+    return id;
+}
+
+static int ir_binop(IR_Lower * L, int bop, int l, int r) {
+    int id = ir_emit1(L, IR_BINOP, l);
+    da_append(&L->f->insts.items[id].args, r);
+    L->f->insts.items[id].bop = bop;
+    return id;
+}
+
+static int ir_new_block(IR_Lower * L, int sealed) {
+    IR_Block block = {.succs = {-1, -1}};
+    da_append(&L->f->blocks, block);
+    da_append(&L->sealed, sealed);
+    for (size_t i = 0; i < L->n_vars; ++i) da_append(&L->defs, -1);
+    return (int)L->f->blocks.count - 1;
+}
+
+// the block being filled; code after a `return` goes to an unreachable block
+static int ir_block(IR_Lower * L) {
+    if (L->block < 0) L->block = ir_new_block(L, 1);
+    return L->block;
+}
+
+static void ir_edge(IR_Lower * L, int from, int slot, int to) {
+    L->f->blocks.items[from].succs[slot] = to;
+    da_append(&L->f->blocks.items[to].preds, from);
+}
+
+static void ir_jump(IR_Lower * L, int to) {
+    if (L->block < 0) return; // unreachable
+    ir_emit(L, IR_JUMP);
+    ir_edge(L, L->block, 0, to);
+    L->block = -1;
+}
+
+static void ir_branch(IR_Lower * L, int cond, int t, int e) {
+    ir_emit1(L, IR_BRANCH, cond);
+    ir_edge(L, L->block, 0, t);
+    ir_edge(L, L->block, 1, e);
+    L->block = -1;
+}
+
+// the walker's status 1, after which only unreachable code follows
+// @return a placeholder value for the expression that failed
+static int ir_fail(IR_Lower * L) {
+    ir_emit(L, IR_FAIL);
+    L->block = -1;
+    return ir_const(L, 0);
+}
+
+// a phi in `block` of the value each predecessor `ends[i]` has, `values[i]`
+static int ir_join(IR_Lower * L, int block, int n, const int * ends, const int * values) {
+    IR_Func * f = L->f;
+    int id = ir_new_inst(f, IR_PHI);
+    for (size_t i = 0; i < f->blocks.items[block].preds.count; ++i) {
+        int pred = f->blocks.items[block].preds.items[i];
+        int k = 0;
+        while (k < n - 1 && ends[k] != pred) ++k;
+        da_append(&f->insts.items[id].args, values[k]);
+    }
+    ir_insert(f, block, ir_n_phis(f, block), id);
+    return id;
+}
+
+static int ir_resolve(IR_Lower * L, int v) {
+    while ((size_t)v < L->forward.count && L->forward.items[v] >= 0) v = L->forward.items[v];
+    return v;
+}
+
+static void ir_write_var(IR_Lower * L, size_t var, int block, int v) {
+    L->defs.items[block * L->n_vars + var] = v;
+}
+
+static int ir_read_var_recursive(IR_Lower * L, size_t var, int block);
+
+static int ir_read_var(IR_Lower * L, size_t var, int block) {
+    int v = L->defs.items[block * L->n_vars + var];
+    if (v >= 0) return ir_resolve(L, v);
+    return ir_read_var_recursive(L, var, block);
+}
+
+static int ir_new_phi(IR_Lower * L, int block) {
+    int id = ir_new_inst(L->f, IR_PHI);
+    ir_insert(L->f, block, ir_n_phis(L->f, block), id);
+    return id;
+}
+
+// a phi whose operands are itself or one other value is that value
+static int ir_try_remove_trivial_phi(IR_Lower * L, int phi) {
+    IR_Func * f = L->f;
+    int same = -1;
+    for (size_t i = 0; i < f->insts.items[phi].args.count; ++i) {
+        int v = ir_resolve(L, f->insts.items[phi].args.items[i]);
+        if (v == same || v == phi) continue;
+        if (same >= 0) return phi;
+        same = v;
+    }
+    // no operand but itself: an unreachable block
+    if (same < 0) same = ir_insert_const(f, f->insts.items[phi].block, 0);
+    while (L->forward.count < f->insts.count) da_append(&L->forward, -1);
+    L->forward.items[phi] = same;
+    ir_remove_inst(f, phi);
+    return same;
+}
+
+static int ir_add_phi_operands(IR_Lower * L, size_t var, int phi) {
+    int block = L->f->insts.items[phi].block;
+    for (size_t i = 0; i < L->f->blocks.items[block].preds.count; ++i) {
+        int v = ir_read_var(L, var, L->f->blocks.items[block].preds.items[i]);
+        da_append(&L->f->insts.items[phi].args, v);
+    }
+    return ir_try_remove_trivial_phi(L, phi);
+}
+
+static int ir_read_var_recursive(IR_Lower * L, size_t var, int block) {
+    IR_Block * b = L->f->blocks.items + block;
+    int v;
+    if (!L->sealed.items[block]) {
+        v = ir_new_phi(L, block);
+        da_append(&L->incomplete, block);
+        da_append(&L->incomplete, (int)var);
+        da_append(&L->incomplete, v);
+    } else if (b->preds.count == 0) {
+        v = ir_insert_const(L->f, block, 0); // unreachable
+    } else if (b->preds.count == 1) {
+        v = ir_read_var(L, var, b->preds.items[0]);
+    } else {
+        // breaks cycles through loops
+        v = ir_new_phi(L, block);
+        ir_write_var(L, var, block, v);
+        v = ir_add_phi_operands(L, var, v);
+    }
+    ir_write_var(L, var, block, v);
+    return v;
+}
+
+static void ir_seal(IR_Lower * L, int block) {
+    // by index: completing a phi may leave other blocks incomplete
+    for (size_t i = 0; i < L->incomplete.count; i += 3) {
+        if (L->incomplete.items[i] != block) continue;
+        L->incomplete.items[i] = -1;
+        ir_add_phi_operands(L, L->incomplete.items[i + 1], L->incomplete.items[i + 2]);
+    }
+    L->sealed.items[block] = 1;
+}
+
+// names
+
+static int ir_find_local(IR_Lower * L, const Token * iden) {
+    for (size_t i = 0; i < L->locals.count; ++i) {
+        if (ir_tokcmp(iden, L->locals.items[i].iden) == 0) return (int)i;
+    }
+    return -1;
+}
+
+static int ir_find_global(IR_Program * prog, const Token * iden) {
+    for (size_t i = 0; i < prog->globals.count; ++i) {
+        if (ir_tokcmp(iden, &prog->globals.items[i].iden) == 0) return (int)i;
+    }
+    return -1;
+}
+
+static int ir_find_func(IR_Program * prog, const Token * iden) {
+    for (size_t i = 0; i < prog->funcs.count; ++i) {
+        if (ir_tokcmp(iden, &prog->funcs.items[i].iden) == 0) return (int)i;
+    }
+    return -1;
+}
+
+static IR_Array ir_array_of(AST_Node * decl) {
+    IR_Array array = {*decl->items[0].token, .n_values = 1};
+    for (size_t i = 1; i < decl->count; ++i) {
+        size_t dim;
+        // @assert the literal is followed by a non-digit char
+        sscanf(decl->items[i].token->begin, "%zu", &dim);
+        da_append(&array.dims, dim);
+        // saturated: `ir_alloc` fails on it rather than on a wrapped size
+        if (__builtin_mul_overflow(array.n_values, dim, &array.n_values)) array.n_values = SIZE_MAX;
+    }
+    return array;
+}
+
+// every 'DECL' of a body, one local per name
+static int ir_collect_locals(IR_Lower * L, AST_Node * node) {
+    if (node->type == 'IFEL' || node->type == 'WHIL' || node->type == 'BLCK') {
+        for (size_t i = 0; i < node->count; ++i) {
+            if (ir_collect_locals(L, node->items + i)) return 1;
+        }
+        return 0;
+    }
+    if (node->type != 'DECL') return 0;
+    const Token * iden = node->items[0].token;
+    int k = ir_find_local(L, iden);
+    if (k < 0) {
+        IR_Local local = {iden, -1};
+        if (node->count > 1) {
+            local.array = (int)L->f->arrays.count;
+            da_append(&L->f->arrays, ir_array_of(node));
+        }
+        da_append(&L->locals, local);
+        return 0;
+    }
+    IR_Local * local = L->locals.items + k;
+    if ((local->array >= 0) != (node->count > 1)) {
+        return ir_error("`%.*s` is declared both as an int and as an array", iden);
+    }
+    if (local->array < 0) return 0;
+    IR_Array array = ir_array_of(node);
+    IR_Dims * dims = &L->f->arrays.items[local->array].dims;
+    int same = array.dims.count == dims->count &&
+        memcmp(array.dims.items, dims->items, dims->count * sizeof(size_t)) == 0;
+    da_free(&array.dims);
+    if (!same) return ir_error("`%.*s` is declared with different dimensions", iden);
+    return 0;
+}
+
+// locals declared in a loop may be declared at any point of it, on the next iteration
+static void ir_mark_possible(IR_Lower * L, AST_Node * node) {
+    if (node->type == 'DECL') {
+        L->possibly.items[ir_find_local(L, node->items[0].token)] = 1;
+        return;
+    }
+    if (node->type != 'IFEL' && node->type != 'WHIL' && node->type != 'BLCK') return;
+    for (size_t i = 0; i < node->count; ++i) ir_mark_possible(L, node->items + i);
+}
+
+// expressions
+
+enum {
+    IR_READ, // the value of an int or an element
+    IR_ASSIGN, // `=`, the value of the right operand
+    IR_INPUT, // `cin >>`, the value read
+};
+
+static int ir_value(IR_Lower * L, AST_Node * node, int * v);
+
+// the access to an int at one place: local `k`, else global `g`, else none
+static void ir_int_access_at(IR_Lower * L, int k, int g, int mode, int rhs, int * v) {
+    if (k < 0 && g < 0) {
+        *v = ir_fail(L);
+        return;
+    }
+    if (mode == IR_ASSIGN) {
+        *v = rhs;
+    } else {
+        *v = k >= 0 ? ir_read_var(L, k, ir_block(L)) : ir_emit(L, IR_LOAD);
+        if (k < 0) L->f->insts.items[*v].imm = g;
+        if (mode == IR_INPUT) *v = ir_emit1(L, IR_IN, *v);
+    }
+    if (mode == IR_READ) return;
+    if (k >= 0) ir_write_var(L, k, ir_block(L), *v);
+    else {
+        int store = ir_emit1(L, IR_STORE, *v);
+        L->f->insts.items[store].imm = g;
+    }
+}
+
+// an int: a local once declared, else the global, else an error, in the
+// walker resolved before the right operand of `=` is evaluated
+static int ir_int_access(IR_Lower * L, AST_Node * varr, int mode, AST_Node * rhs, int * v) {
+    const Token * iden = varr->items[0].token;
+    int k = ir_find_local(L, iden);
+    int g = ir_find_global(L->prog, iden);
+    if (k >= 0 && L->locals.items[k].array >= 0) return ir_error("Array `%.*s` is used as an int", iden);
+    if (g >= 0 && L->prog->globals.items[g].dims.count) {
+        if (k < 0 || !L->surely.items[k]) return ir_error("Array `%.*s` is used as an int", iden);
+        g = -1; // never reached
+    }
+    int r = 0;
+    if (k >= 0 && L->surely.items[k]) {
+        if (mode == IR_ASSIGN && ir_value(L, rhs, &r)) return 1;
+        ir_int_access_at(L, k, -1, mode, r, v);
+        return 0;
+    }
+    if (k < 0 || !L->possibly.items[k]) {
+        if (mode == IR_ASSIGN && g >= 0 && ir_value(L, rhs, &r)) return 1;
+        ir_int_access_at(L, -1, g, mode, r, v);
+        return 0;
+    }
+    // declared on some paths only
+    int declared = ir_read_var(L, L->locals.count + k, ir_block(L));
+    int local = ir_new_block(L, 0);
+    int global = ir_new_block(L, 0);
+    if (mode == IR_ASSIGN && g < 0) {
+        ir_branch(L, declared, local, global);
+        ir_seal(L, local);
+        ir_seal(L, global);
+        L->block = global;
+        ir_fail(L);
+        L->block = local;
+        if (ir_value(L, rhs, &r)) return 1;
+        ir_int_access_at(L, k, -1, mode, r, v);
+        return 0;
+    }
+    if (mode == IR_ASSIGN && ir_value(L, rhs, &r)) return 1;
+    ir_branch(L, declared, local, global);
+    ir_seal(L, local);
+    ir_seal(L, global);
+    int join = ir_new_block(L, 0);
+    int ends[2], values[2];
+    L->block = local;
+    ir_int_access_at(L, k, -1, mode, r, values + 0);
+    ends[0] = L->block;
+    ir_jump(L, join);
+    L->block = global;
+    ir_int_access_at(L, -1, g, mode, r, values + 1);
+    ends[1] = L->block;
+    ir_jump(L, join);
+    ir_seal(L, join);
+    L->block = join;
+    *v = ir_join(L, join, 2, ends, values);
+    return 0;
+}
+
+// an element: of the local array once declared, else of the global one;
+// whether it exists with as many dimensions as subscripts is checked before
+// the subscripts are evaluated, each subscript right after it is
+static int ir_array_access(IR_Lower * L, AST_Node * varr, int mode, AST_Node * rhs, int * v) {
+    const Token * iden = varr->items[0].token;
+    size_t n_subs = varr->count - 1;
+    int k = ir_find_local(L, iden);
+    int g = ir_find_global(L->prog, iden);
+    int local = -1;
+    if (k >= 0 && L->locals.items[k].array < 0) {
+        if (L->surely.items[k]) {
+            *v = ir_fail(L); // an int has no subscripts
+            return 0;
+        }
+        if (L->possibly.items[k]) return ir_error("`%.*s` is subscripted before its declaration", iden);
+    } else if (k >= 0) {
+        local = L->locals.items[k].array;
+    }
+    if (g >= 0 && L->prog->globals.items[g].dims.count != n_subs) g = -1;
+    if (local < 0 && g < 0) {
+        *v = ir_fail(L);
+        return 0;
+    }
+    // only the global is sure to fit, and it is there
+    if (local >= 0 && (g < 0 || L->f->arrays.items[local].dims.count != n_subs)) {
+        int check = ir_emit(L, IR_ACHECK);
+        L->f->insts.items[check].imm = (int)n_subs;
+        L->f->insts.items[check].local = local;
+        L->f->insts.items[check].global = g;
+        L->f->insts.items[check].tok = iden;
+    }
+
+    int subs[n_subs + 1];
+    for (int i = (int)n_subs - 1; i >= 0; --i) {
+        if (ir_value(L, varr->items + i + 1, subs + i)) return 1;
+        if (!cvm_config.checked) continue;
+        int bound = ir_emit1(L, IR_BOUND, subs[i]);
+        L->f->insts.items[bound].imm = i;
+        L->f->insts.items[bound].local = local;
+        L->f->insts.items[bound].global = g;
+        L->f->insts.items[bound].tok = iden;
+    }
+    int r = 0;
+    if (mode == IR_ASSIGN && ir_value(L, rhs, &r)) return 1;
+    if (mode != IR_ASSIGN) {
+        r = ir_emit(L, IR_ALOAD);
+        for (size_t i = 0; i < n_subs; ++i) da_append(&L->f->insts.items[r].args, subs[i]);
+        L->f->insts.items[r].local = local;
+        L->f->insts.items[r].global = g;
+        L->f->insts.items[r].tok = iden;
+        if (mode == IR_INPUT) r = ir_emit1(L, IR_IN, r);
+    }
+    *v = r;
+    if (mode == IR_READ) return 0;
+    int store = ir_emit(L, IR_ASTORE);
+    for (size_t i = 0; i < n_subs; ++i) da_append(&L->f->insts.items[store].args, subs[i]);
+    da_append(&L->f->insts.items[store].args, r);
+    L->f->insts.items[store].local = local;
+    L->f->insts.items[store].global = g;
+    L->f->insts.items[store].tok = iden;
+    return 0;
+}
+
+static int ir_access(IR_Lower * L, AST_Node * varr, int mode, AST_Node * rhs, int * v) {
+    if (varr->count == 1) return ir_int_access(L, varr, mode, rhs, v);
+    return ir_array_access(L, varr, mode, rhs, v);
+}
+
+static int ir_call(IR_Lower * L, AST_Node * node, int * v) {
+    int callee = ir_find_func(L->prog, node->items[0].token);
+    // node: iden expr .. expr, def: iden iden .. iden blck
+    if (callee < 0 || node->count + 1 != L->prog->funcs.items[callee].def->count) {
+        *v = ir_fail(L);
+        return 0;
+    }
+    int args[node->count];
+    for (size_t i = 1; i < node->count; ++i) {
+        if (ir_value(L, node->items + i, args + i - 1)) return 1;
+    }
+    *v = ir_emit(L, IR_CALL);
+    L->f->insts.items[*v].imm = callee;
+    for (size_t i = 1; i < node->count; ++i) da_append(&L->f->insts.items[*v].args, args[i - 1]);
+    return 0;
+}
+
+// `a && b`, `a || b`: the right operand in a block of its own
+static int ir_short_circuit(IR_Lower * L, AST_Node * node, int * v) {
+    int is_and = node->token->begin[0] == '&';
+    int l;
+    if (ir_value(L, node->items + 0, &l)) return 1;
+    int ends[2], values[2];
+    values[0] = ir_const(L, !is_and);
+    ends[0] = L->block;
+    int right = ir_new_block(L, 0);
+    int join = ir_new_block(L, 0);
+    if (is_and) ir_branch(L, l, right, join);
+    else ir_branch(L, l, join, right);
+    ir_seal(L, right);
+    L->block = right;
+    int r;
+    if (ir_value(L, node->items + 1, &r)) return 1;
+    values[1] = ir_binop(L, IR_NE, r, ir_const(L, 0));
+    ends[1] = L->block;
+    ir_jump(L, join);
+    ir_seal(L, join);
+    L->block = join;
+    *v = ir_join(L, join, 2, ends, values);
+    return 0;
+}
+
+static const char * ir_bops[] = {
+    [IR_MUL] = "*", [IR_DIV] = "/", [IR_MOD] = "%", [IR_ADD] = "+", [IR_SUB] = "-",
+    [IR_LE] = "<=", [IR_GE] = ">=", [IR_LT] = "<", [IR_GT] = ">", [IR_EQ] = "==", [IR_NE] = "!=",
+    [IR_XOR] = "^", [IR_AND] = "&&", [IR_OR] = "||",
+};
+
+// the first child of `node` is the token `name`, as the walker tests for cout, cin and endl
+static int ir_is_stream(AST_Node * node, const char * name) {
+    return node->count && node->items[0].token && tokstrcmp(node->items[0].token, name) == 0;
+}
+
+// `kind`: 0 for an int, 2 for cout, 3 for cin, as the walker's status
+static int ir_expr(IR_Lower * L, AST_Node * node, int * kind, int * v) {
+    *kind = 0;
+    switch (node->type) {
+    case 'EXPR': return ir_expr(L, node->items + 0, kind, v);
+    case 'VARR': return ir_access(L, node, IR_READ, NULL, v);
+    case 'CALL': return ir_call(L, node, v);
+    case 'INTG': {
+        int value;
+        // @assert the literal is followed by a non-digit char
+        sscanf(node->items[node->count - 1].token->begin, "%d", &value);
+        if (node->count == 2 && node->items[0].token->begin[0] == '-') value *= -1;
+        *v = ir_const(L, value);
+        return 0;
+    }
+    case 'UPOP': {
+        // @assert node->token is "!"
+        int operand;
+        if (ir_value(L, node->items + 0, &operand)) return 1;
+        *v = ir_emit1(L, IR_NOT, operand);
+        return 0;
+    }
+    case 'BIOP': break;
+    default: return ir_error("Unexpected node in expression at `%.*s`", node->token);
+    }
+
+    AST_Node * left = node->items + 0;
+    AST_Node * right = node->items + 1;
+    int l, r;
+    if (tokstrcmp(node->token, "<<") == 0) {
+        if (!ir_is_stream(left, "cout")) {
+            int left_kind;
+            if (ir_expr(L, left, &left_kind, &l)) return 1;
+            if (left_kind != 2) ir_fail(L);
+        }
+        *kind = 2;
+        *v = -1;
+        if (ir_is_stream(right, "endl")) {
+            ir_emit(L, IR_ENDL);
+            return 0;
+        }
+        if (ir_value(L, right, &r)) return 1;
+        ir_emit1(L, IR_OUT, r);
+        return 0;
+    }
+    if (tokstrcmp(node->token, ">>") == 0) {
+        *kind = 3;
+        *v = -1;
+        // the walker tests the right operand of a chained `>>`, and fails
+        if (!ir_is_stream(left, "cin")) {
+            int right_kind;
+            if (ir_expr(L, right, &right_kind, &r)) return 1;
+            if (right_kind == 3) return ir_error("Chained `%.*s`", node->token);
+            ir_fail(L);
+            return 0;
+        }
+        if (right->type != 'VARR') return ir_error("Reading into a non-variable with `%.*s`", node->token);
+        return ir_access(L, right, IR_INPUT, NULL, v);
+    }
+    if (tokstrcmp(node->token, "=") == 0) {
+        if (left->type != 'VARR') {
+            *v = ir_fail(L);
+            return 0;
+        }
+        return ir_access(L, left, IR_ASSIGN, right, v);
+    }
+    if (!cvm_config.eager_logic && (tokstrcmp(node->token, "&&") == 0 || tokstrcmp(node->token, "||") == 0)) {
+        return ir_short_circuit(L, node, v);
+    }
+    int bop = 0;
+    while (bop <= IR_OR && tokstrcmp(node->token, ir_bops[bop]) != 0) ++bop;
+    if (bop > IR_OR) return ir_error("Unknown operator `%.*s`", node->token);
+    if (ir_value(L, left, &l) || ir_value(L, right, &r)) return 1;
+    *v = ir_binop(L, bop, l, r);
+    return 0;
+}
+
+static int ir_value(IR_Lower * L, AST_Node * node, int * v) {
+    int kind;
+    if (ir_expr(L, node, &kind, v)) return 1;
+    if (kind == 0) return 0;
+    return ir_error("`%.*s` is used as a value", kind == 2 ? &(Token) {"cout", 4} : &(Token) {"cin", 3});
+}
+
+// statements
+
+static int ir_stmt(IR_Lower * L, AST_Node * node);
+
+static int ir_body(IR_Lower * L, AST_Node * node) {
+    if (node->type != 'BLCK') return ir_stmt(L, node);
+    for (size_t i = 0; i < node->count; ++i) {
+        if (ir_stmt(L, node->items + i)) return 1;
+    }
+    return 0;
+}
+
+static void ir_step(IR_Lower * L) {
+    int step = ir_emit(L, IR_STEP);
+    L->f->insts.items[step].imm = 1;
+}
+
+// a copy of what is surely declared, to be restored or merged
+static IR_Ids ir_save_surely(IR_Lower * L) {
+    IR_Ids saved = {};
+    for (size_t i = 0; i < L->surely.count; ++i) da_append(&saved, L->surely.items[i]);
+    return saved;
+}
+
+static void ir_decl(IR_Lower * L, AST_Node * node) {
+    int k = ir_find_local(L, node->items[0].token);
+    if (L->locals.items[k].array >= 0) {
+        int alloc = ir_emit(L, IR_ALLOC);
+        L->f->insts.items[alloc].local = L->locals.items[k].array;
+        return;
+    }
+    // the walker appends a new variable, which an older one shadows
+    size_t flag = L->locals.count + k;
+    if (!L->surely.items[k] && !L->possibly.items[k]) {
+        ir_write_var(L, k, ir_block(L), ir_const(L, 0));
+    } else if (!L->surely.items[k]) {
+        // 0 unless already declared, the flag is 0 or 1
+        int declared = ir_read_var(L, flag, ir_block(L));
+        int value = ir_binop(L, IR_MUL, ir_read_var(L, k, L->block), declared);
+        ir_write_var(L, k, L->block, value);
+    }
+    ir_write_var(L, flag, ir_block(L), ir_const(L, 1));
+    L->surely.items[k] = 1;
+    L->possibly.items[k] = 1;
+}
+
+static int ir_stmt(IR_Lower * L, AST_Node * node) {
+    ir_step(L);
+    int v;
+    switch (node->type) {
+    case 'DECL': {
+        ir_decl(L, node);
+    } break;
+    case 'EXPS': {
+        int kind;
+        if (ir_expr(L, node->items + 0, &kind, &v)) return 1;
+    } break;
+    case 'IFEL': {
+        if (ir_value(L, node->items + 0, &v)) return 1;
+        int then = ir_new_block(L, 0);
+        int join = ir_new_block(L, 0);
+        int other = node->count == 3 ? ir_new_block(L, 0) : join;
+        ir_branch(L, v, then, other);
+        ir_seal(L, then);
+        if (other != join) ir_seal(L, other);
+
+        IR_Ids before = ir_save_surely(L);
+        L->block = then;
+        if (ir_body(L, node->items + 1)) return 1;
+        // a branch that returned declares everything as far as the join is concerned
+        IR_Ids after_then = ir_save_surely(L);
+        if (L->block < 0) for (size_t i = 0; i < after_then.count; ++i) after_then.items[i] = 1;
+        ir_jump(L, join);
+        memcpy(L->surely.items, before.items, before.count * sizeof(int));
+        if (other != join) {
+            L->block = other;
+            if (ir_body(L, node->items + 2)) return 1;
+            if (L->block < 0) memcpy(L->surely.items, after_then.items, after_then.count * sizeof(int));
+            ir_jump(L, join);
+        }
+        for (size_t i = 0; i < L->surely.count; ++i) L->surely.items[i] &= after_then.items[i];
+        da_free(&before);
+        da_free(&after_then);
+        ir_seal(L, join);
+        L->block = join;
+    } break;
+    case 'WHIL': {
+        ir_mark_possible(L, node->items + 1);
+        int header = ir_new_block(L, 0);
+        ir_jump(L, header);
+        L->block = header;
+        if (ir_value(L, node->items + 0, &v)) return 1;
+        int body = ir_new_block(L, 0);
+        int exit = ir_new_block(L, 0);
+        ir_branch(L, v, body, exit);
+        ir_seal(L, body);
+        ir_seal(L, exit);
+
+        IR_Ids before = ir_save_surely(L);
+        L->block = body;
+        ir_step(L); // the iteration
+        if (ir_body(L, node->items + 1)) return 1;
+        ir_jump(L, header);
+        memcpy(L->surely.items, before.items, before.count * sizeof(int));
+        da_free(&before);
+        ir_seal(L, header);
+        L->block = exit;
+    } break;
+    case 'RETN': {
+        AST_Node * expr = node->items + 0;
+        while (expr->type == 'EXPR') expr = expr->items + 0;
+        if (ir_value(L, node->items + 0, &v)) return 1;
+        // made in the frame of this function, as the walker does from -O1 on
+        if (expr->type == 'CALL' && L->f->insts.items[v].op == IR_CALL) L->f->insts.items[v].tail = 1;
+        ir_emit1(L, IR_RETURN, v);
+        L->block = -1;
+    } break;
+    default: return ir_error("Unexpected statement at `%.*s`", node->token);
+    }
+    return 0;
+}
+
+static int ir_lower_func(IR_Program * prog, IR_Func * f) {
+    IR_Lower L = {prog, f};
+    AST_Node * def = f->def;
+    AST_Node * body = def->items + def->count - 1;
+    if (body->type == 'LAZY') return ir_error("Function `%.*s` is not parsed yet", &f->iden);
+    f->n_params = def->count - 2;
+    for (size_t i = 1; i + 1 < def->count; ++i) {
+        if (ir_find_local(&L, def->items[i].token) >= 0) continue; // the first one is found
+        da_append(&L.locals, ((IR_Local) {def->items[i].token, -1, 1}));
+    }
+    int status = ir_collect_locals(&L, body);
+
+    L.n_vars = 2 * L.locals.count;
+    for (size_t i = 0; i < L.locals.count; ++i) {
+        da_append(&L.surely, L.locals.items[i].param);
+        da_append(&L.possibly, L.locals.items[i].param);
+    }
+    L.block = ir_new_block(&L, 1);
+    for (size_t i = 1; i + 1 < def->count; ++i) {
+        int param = ir_emit(&L, IR_PARAM);
+        f->insts.items[param].imm = (int)i - 1;
+        da_append(&f->params, param);
+        int k = ir_find_local(&L, def->items[i].token);
+        if (L.defs.items[k] < 0) ir_write_var(&L, k, 0, param);
+    }
+    for (size_t k = 0; k < L.locals.count; ++k) {
+        if (!L.locals.items[k].param) ir_write_var(&L, k, 0, ir_const(&L, 0));
+        ir_write_var(&L, L.locals.count + k, 0, ir_const(&L, L.locals.items[k].param));
+    }
+
+    if (!status) status = ir_body(&L, body);
+    if (!status && L.block >= 0) ir_emit1(&L, IR_RETURN, ir_const(&L, 0));
+
+    // operands that name removed phis
+    for (size_t i = 0; i < f->insts.count; ++i) {
+        IR_Ids * args = &f->insts.items[i].args;
+        for (size_t j = 0; j < args->count; ++j) args->items[j] = ir_resolve(&L, args->items[j]);
+    }
+    da_free(&L.locals);
+    da_free(&L.defs);
+    da_free(&L.sealed);
+    da_free(&L.incomplete);
+    da_free(&L.forward);
+    da_free(&L.surely);
+    da_free(&L.possibly);
+    return status;
+}
+
+int ir_lower(IR_Program * prog, AST_Node * ast) {
+    *prog = (IR_Program) {.entry = -1};
+    ir_errmsg = NULL;
+    for (AST_Node * node = ast->items; node < ast->items + ast->count; ++node) {
+        if (node->type == 'DECL') da_append(&prog->globals, ir_array_of(node));
+        if (node->type == 'FUNC') da_append(&prog->funcs, ((IR_Func) {*node->items[0].token, node}));
+    }
+    prog->entry = ir_find_func(prog, &(Token) {"main", 4});
+    if (prog->entry >= 0 && prog->funcs.items[prog->entry].def->count > 2) {
+        return ir_error("`%.*s` has parameters", &prog->funcs.items[prog->entry].iden);
+    }
+    for (size_t i = 0; i < prog->funcs.count; ++i) {
+        if (ir_lower_func(prog, prog->funcs.items + i)) return 1;
+    }
+    return 0;
+}
+
+void ir_free(IR_Program * prog) {
+    for (size_t i = 0; i < prog->funcs.count; ++i) {
+        IR_Func * f = prog->funcs.items + i;
+        for (size_t j = 0; j < f->insts.count; ++j) da_free(&f->insts.items[j].args);
+        for (size_t j = 0; j < f->blocks.count; ++j) {
+            da_free(&f->blocks.items[j].insts);
+            da_free(&f->blocks.items[j].preds);
+        }
+        for (size_t j = 0; j < f->arrays.count; ++j) da_free(&f->arrays.items[j].dims);
+        da_free(&f->insts);
+        da_free(&f->blocks);
+        da_free(&f->params);
+        da_free(&f->arrays);
+    }
+    da_free(&prog->funcs);
+    for (size_t i = 0; i < prog->globals.count; ++i) da_free(&prog->globals.items[i].dims);
+    da_free(&prog->globals);
+}
+
+// verifier
+
+static int ir_broken(IR_Func * f, const char * what, int id) {
+    snprintf(ir_errbuf, sizeof(ir_errbuf), "In `%.*s`: %s (%%%d)", (int)f->iden.len, f->iden.begin, what, id);
+    ir_errmsg = ir_errbuf;
+    return 1;
+}
+
+static int ir_count_of(IR_Ids * ids, int id) {
+    int n = 0;
+    for (size_t i = 0; i < ids->count; ++i) n += ids->items[i] == id;
+    return n;
+}
+
+// `dom[b]`: the immediate dominator of each block reachable from the entry, -1 for the others
+// (Cooper, Harvey and Kennedy: iterate over reverse postorder until nothing changes)
+static void ir_dominators(IR_Func * f, int * dom) {
+    size_t n = f->blocks.count;
+    int order[n], rpo_index[n], stack[n], next[n];
+    for (size_t i = 0; i < n; ++i) dom[i] = rpo_index[i] = -1;
+    size_t n_order = 0, top = 0;
+    stack[top++] = 0;
+    next[0] = 0;
+    rpo_index[0] = 0;
+    while (top) {
+        int b = stack[top - 1];
+        if (next[b] < 2) {
+            int s = f->blocks.items[b].succs[next[b]++];
+            if (s >= 0 && rpo_index[s] < 0) {
+                rpo_index[s] = 0;
+                next[s] = 0;
+                stack[top++] = s;
+            }
+            continue;
+        }
+        order[n_order++] = b; // postorder
+        top -= 1;
+    }
+    for (size_t i = 0; i < n_order; ++i) rpo_index[order[i]] = (int)(n_order - 1 - i);
+    dom[0] = 0;
+    for (int changed = 1; changed; ) {
+        changed = 0;
+        for (int i = (int)n_order - 2; i >= 0; --i) {
+            int b = order[i];
+            int idom = -1;
+            IR_Ids * preds = &f->blocks.items[b].preds;
+            for (size_t j = 0; j < preds->count; ++j) {
+                int p = preds->items[j];
+                if (dom[p] < 0) continue;
+                if (idom < 0) {
+                    idom = p;
+                    continue;
+                }
+                int x = p, y = idom;
+                while (x != y) {
+                    while (rpo_index[x] > rpo_index[y]) x = dom[x];
+                    while (rpo_index[y] > rpo_index[x]) y = dom[y];
+                }
+                idom = x;
+            }
+            if (idom != dom[b]) {
+                dom[b] = idom;
+                changed = 1;
+            }
+        }
+    }
+}
+
+static int ir_dominates(const int * dom, int a, int b) {
+    while (b != a && b != 0) b = dom[b];
+    return b == a;
+}
+
+int ir_verify_func(IR_Program * prog, IR_Func * f) {
+    size_t n = f->blocks.count;
+    if (n == 0 || f->blocks.items[0].removed) return ir_broken(f, "no entry block", 0);
+    if (f->blocks.items[0].preds.count) return ir_broken(f, "the entry block has predecessors", 0);
+    // where each instruction is in its block
+    int pos[f->insts.count];
+    for (size_t i = 0; i < f->insts.count; ++i) pos[i] = -1;
+    for (size_t b = 0; b < n; ++b) {
+        IR_Block * block = f->blocks.items + b;
+        if (block->removed) continue;
+        if (block->insts.count == 0) return ir_broken(f, "empty block", -1);
+        int n_succs = 0;
+        for (size_t i = 0; i < block->insts.count; ++i) {
+            int id = block->insts.items[i];
+            IR_Inst * inst = f->insts.items + id;
+            if (inst->block != (int)b || pos[id] >= 0) return ir_broken(f, "misplaced instruction", id);
+            pos[id] = (int)i;
+            int last = i + 1 == block->insts.count;
+            if (ir_is_terminator(inst->op) != last) return ir_broken(f, "terminator not last", id);
+            if (inst->op == IR_PHI && i && f->insts.items[block->insts.items[i - 1]].op != IR_PHI) {
+                return ir_broken(f, "phi after other instructions", id);
+            }
+            if (inst->op == IR_PHI && inst->args.count != block->preds.count) {
+                return ir_broken(f, "phi operands do not match the predecessors", id);
+            }
+            if (inst->op == IR_JUMP) n_succs = 1;
+            if (inst->op == IR_BRANCH) n_succs = 2;
+        }
+        for (int s = 0; s < 2; ++s) {
+            int succ = block->succs[s];
+            if ((succ >= 0) != (s < n_succs)) return ir_broken(f, "successors do not match the terminator", -1);
+            if (succ < 0) continue;
+            if (succ >= (int)n || f->blocks.items[succ].removed) return ir_broken(f, "jump to a removed block", -1);
+            int edges = (block->succs[0] == succ) + (block->succs[1] == succ);
+            if (ir_count_of(&f->blocks.items[succ].preds, (int)b) != edges) {
+                return ir_broken(f, "edge missing from the predecessors", -1);
+            }
+        }
+        for (size_t i = 0; i < block->preds.count; ++i) {
+            int pred = block->preds.items[i];
+            if (pred < 0 || pred >= (int)n || f->blocks.items[pred].removed ||
+                (f->blocks.items[pred].succs[0] != (int)b && f->blocks.items[pred].succs[1] != (int)b)) {
+                return ir_broken(f, "predecessor without the edge", -1);
+            }
+        }
+    }
+
+    int dom[n];
+    ir_dominators(f, dom);
+    for (size_t id = 0; id < f->insts.count; ++id) {
+        IR_Inst * inst = f->insts.items + id;
+        if (inst->block < 0) continue;
+        if (pos[id] < 0) return ir_broken(f, "instruction missing from its block", (int)id);
+        size_t n_args = inst->args.count;
+        int arity = -1;
+        switch (inst->op) {
+        case IR_CONST: case IR_PARAM: case IR_LOAD: case IR_ACHECK: case IR_ALLOC: case IR_ENDL:
+        case IR_STEP: case IR_JUMP: case IR_FAIL: arity = 0; break;
+        case IR_COPY: case IR_NOT: case IR_STORE: case IR_BOUND: case IR_IN: case IR_OUT:
+        case IR_BRANCH: case IR_RETURN: arity = 1; break;
+        case IR_BINOP: arity = 2; break;
+        case IR_CALL: arity = (int)prog->funcs.items[inst->imm].n_params; break;
+        }
+        if (arity >= 0 && n_args != (size_t)arity) return ir_broken(f, "wrong number of operands", (int)id);
+        if (inst->op == IR_ALOAD && n_args == 0) return ir_broken(f, "element without subscripts", (int)id);
+        if (inst->op == IR_ASTORE && n_args < 2) return ir_broken(f, "element without subscripts", (int)id);
+        if (dom[inst->block] < 0) continue; // unreachable, nothing dominates it
+        for (size_t j = 0; j < n_args; ++j) {
+            int arg = inst->args.items[j];
+            if (arg < 0 || arg >= (int)f->insts.count || f->insts.items[arg].block < 0 ||
+                !ir_has_value(f->insts.items[arg].op)) {
+                return ir_broken(f, "operand is not a value", (int)id);
+            }
+            int def = f->insts.items[arg].block;
+            // a phi operand is used at the end of its predecessor
+            int use = inst->op == IR_PHI ? f->blocks.items[inst->block].preds.items[j] : inst->block;
+            if (dom[use] < 0) continue;
+            int ok = def == use && inst->op != IR_PHI ? pos[arg] < pos[id] : ir_dominates(dom, def, use);
+            if (!ok) return ir_broken(f, "operand does not dominate its use", (int)id);
+        }
+    }
+    return 0;
+}
+
+int ir_verify(IR_Program * prog) {
+    for (size_t i = 0; i < prog->funcs.count; ++i) {
+        if (ir_verify_func(prog, prog->funcs.items + i)) return 1;
+    }
+    return 0;
+}
+
+// printer
+
+static const char * ir_op_names[] = {
+    [IR_CONST] = "const", [IR_PARAM] = "param", [IR_PHI] = "phi", [IR_COPY] = "copy",
+    [IR_BINOP] = "binop", [IR_NOT] = "not", [IR_LOAD] = "load", [IR_STORE] = "store",
+    [IR_ALOAD] = "aload", [IR_ASTORE] = "astore", [IR_ACHECK] = "acheck", [IR_BOUND] = "bound",
+    [IR_ALLOC] = "alloc", [IR_CALL] = "call", [IR_IN] = "in", [IR_OUT] = "out", [IR_ENDL] = "endl",
+    [IR_STEP] = "step", [IR_JUMP] = "jump", [IR_BRANCH] = "branch", [IR_RETURN] = "return",
+    [IR_FAIL] = "fail",
+};
+
+static void ir_print_array(IR_Inst * inst, FILE * out) {
+    fprintf(out, " %.*s", (int)inst->tok->len, inst->tok->begin);
+    if (inst->local >= 0) fprintf(out, " local %d", inst->local);
+    if (inst->global >= 0) fprintf(out, " @%d", inst->global);
+}
+
+void ir_print(IR_Program * prog, FILE * out) {
+    for (size_t i = 0; i < prog->globals.count; ++i) {
+        IR_Array * global = prog->globals.items + i;
+        fprintf(out, "global @%zu %.*s", i, (int)global->iden.len, global->iden.begin);
+        for (size_t j = 0; j < global->dims.count; ++j) fprintf(out, "[%zu]", global->dims.items[j]);
+        fprintf(out, "\n");
+    }
+    for (size_t i = 0; i < prog->funcs.count; ++i) {
+        IR_Func * f = prog->funcs.items + i;
+        fprintf(out, "\nfunc @%zu %.*s(%zu)\n", i, (int)f->iden.len, f->iden.begin, f->n_params);
+        for (size_t j = 0; j < f->arrays.count; ++j) {
+            IR_Array * array = f->arrays.items + j;
+            fprintf(out, "  array %zu %.*s", j, (int)array->iden.len, array->iden.begin);
+            for (size_t k = 0; k < array->dims.count; ++k) fprintf(out, "[%zu]", array->dims.items[k]);
+            fprintf(out, "\n");
+        }
+        for (size_t b = 0; b < f->blocks.count; ++b) {
+            IR_Block * block = f->blocks.items + b;
+            if (block->removed) continue;
+            fprintf(out, "b%zu:", b);
+            for (size_t j = 0; j < block->preds.count; ++j) {
+                fprintf(out, "%s b%d", j ? "," : " ; preds", block->preds.items[j]);
+            }
+            fprintf(out, "\n");
+            for (size_t j = 0; j < block->insts.count; ++j) {
+                int id = block->insts.items[j];
+                IR_Inst * inst = f->insts.items + id;
+                fprintf(out, "  ");
+                if (ir_has_value(inst->op)) fprintf(out, "%%%d = ", id);
+                fprintf(out, "%s", inst->op == IR_BINOP ? ir_bops[inst->bop] : ir_op_names[inst->op]);
+                switch (inst->op) {
+                case IR_CONST: case IR_PARAM: case IR_STEP: fprintf(out, " %d", inst->imm); break;
+                case IR_LOAD: case IR_STORE: fprintf(out, " @%d", inst->imm); break;
+                case IR_CALL: {
+                    IR_Func * callee = prog->funcs.items + inst->imm;
+                    fprintf(out, "%s @%d %.*s", inst->tail ? " tail" : "", inst->imm,
+                            (int)callee->iden.len, callee->iden.begin);
+                } break;
+                case IR_ALLOC: fprintf(out, " %d", inst->local); break;
+                case IR_ALOAD: case IR_ASTORE: case IR_ACHECK: case IR_BOUND: {
+                    ir_print_array(inst, out);
+                    if (inst->op == IR_ACHECK || inst->op == IR_BOUND) fprintf(out, " %d", inst->imm);
+                } break;
+                }
+                for (size_t k = 0; k < inst->args.count; ++k) {
+                    fprintf(out, "%s%%%d", k ? ", " : " ", inst->args.items[k]);
+                }
+                for (int s = 0; s < 2 && block->succs[s] >= 0 && ir_is_terminator(inst->op); ++s) {
+                    fprintf(out, "%sb%d", inst->args.count || s ? ", " : " ", block->succs[s]);
+                }
+                fprintf(out, "\n");
+            }
+        }
+    }
+}
@@ -0,0 +1,193 @@
+#ifndef IR_H_
+#define IR_H_
+
+#include <stdio.h> // FILE
+#include <stddef.h> // size_t
+
+#include "tokenizer.h"
+#include "ast_builder.h"
+
+/*
+  @def SSA IR
+
+  A mid-level form between the AST and execution. Each function is a
+  control flow graph of basic blocks, and each instruction defines at most
+  one value, once (static single assignment):
+
+  - `if` and `while` become branches between blocks, and so do `&&` and
+    `||` unless `--eager-logic`
+  - locals and parameters are values, merged by phis where paths join
+  - globals and array elements are reached by explicit loads and stores,
+    calls and `cin`/`cout` are instructions of their own
+  - a `step` instruction counts the statements and loop iterations the
+    walker would count
+
+  Lowering keeps the meaning the tree walker gives a program (see cvm.c),
+  quirks included: a local only exists once its declaration ran, until
+  then its name is the global's, so a name declared on some paths only is
+  resolved at run time by a hidden "declared" value; subscripts are
+  evaluated last first; `!` is the only unary operator. What the IR does
+  not model (an array name used as an int, `cin`/`cout` as operands of
+  arithmetic, lazily parsed bodies, `main` with parameters) is not
+  lowered, and such programs run on the walker.
+
+  Passes rewrite the IR in place, the verifier checks it after lowering
+  and after each pass:
+
+  - constprop: folds operators on constants, and branches on them
+  - copyprop:  forwards copies and phis whose operands are all the same
+  - dce:       removes unreachable blocks and unused side-effect free values
+  - steps:     adds up the step counts of a block between instructions that
+               may fail, so that an error still reports the walker's count
+
+  `ir_run` is what `cvm_run` uses with `--ir`: it lowers, optimizes and
+  interprets the program, with the same output, errors, return value,
+  globals and statement count as the walker. The limits, traces and
+  profiles belong to the walker, which runs the program when any is on.
+*/
+
+typedef struct {
+    int * items;
+    size_t count;
+    size_t capacity;
+} IR_Ids;
+
+enum {
+    // values
+    IR_CONST, // imm
+    IR_PARAM, // parameter imm, set by the caller
+    IR_PHI, // one operand per predecessor of the block, in order
+    IR_COPY, // of operand 0, removed by copyprop
+    IR_BINOP, // `bop` of operands 0 and 1
+    IR_NOT, // !operand 0
+    IR_LOAD, // global int imm
+    IR_STORE, // global int imm = operand 0
+    IR_ALOAD, // element of an array, operands: the subscripts
+    IR_ASTORE, // element of an array, operands: the subscripts, then the value
+    IR_ACHECK, // fails unless the array exists with imm subscripts
+    IR_BOUND, // `--checked`: operand 0 is within dimension imm of the array
+    IR_ALLOC, // declares local array `local`, unless it already is
+    IR_CALL, // function imm, operands: the arguments
+    IR_IN, // `cin >>`: the value read, or operand 0 if none
+    IR_OUT, // `cout << operand 0`
+    IR_ENDL, // `cout << endl`
+    IR_STEP, // imm statements executed
+    // terminators, the last instruction of each block
+    IR_JUMP, // to successor 0
+    IR_BRANCH, // to successor 0 if operand 0, else to successor 1
+    IR_RETURN, // operand 0
+    IR_FAIL, // an error without message, status 1 as in the walker
+};
+
+// binary operators, `&&` and `||` only with `--eager-logic`
+enum {
+    IR_MUL, IR_DIV, IR_MOD, IR_ADD, IR_SUB,
+    IR_LE, IR_GE, IR_LT, IR_GT, IR_EQ, IR_NE,
+    IR_XOR, IR_AND, IR_OR,
+};
+
+typedef struct {
+    int op;
+    int bop; // IR_BINOP
+    int block; // -1 once removed
+    int imm;
+    // array instructions: the local array of the function, -1 if the name has
+    // none or it is not declared yet at run time, then the global, -1 if none
+    int local;
+    int global;
+    int tail; // IR_CALL whose value is returned right away
+    IR_Ids args; // operands, ids of the values
+    const Token * tok; // array instructions: the name, for errors
+} IR_Inst;
+
+typedef struct {
+    IR_Ids insts; // phis first, a terminator last
+    IR_Ids preds;
+    int succs[2]; // -1 if none
+    int removed;
+} IR_Block;
+
+typedef struct {
+    size_t * items;
+    size_t count;
+    size_t capacity;
+} IR_Dims;
+
+// an array, local to a function or global
+typedef struct {
+    Token iden;
+    IR_Dims dims; // empty for a global int
+    size_t n_values; // elements
+} IR_Array;
+
+typedef struct {
+    IR_Array * items;
+    size_t count;
+    size_t capacity;
+} IR_Arrays;
+
+typedef struct {
+    Token iden;
+    AST_Node * def;
+    size_t n_params;
+    // all instructions ever created, a value is the index of its instruction
+    struct {
+        IR_Inst * items;
+        size_t count;
+        size_t capacity;
+    } insts;
+    struct {
+        IR_Block * items; // block 0 is the entry
+        size_t count;
+        size_t capacity;
+    } blocks;
+    IR_Ids params; // the IR_PARAM of each parameter
+    IR_Arrays arrays; // local arrays, one per name
+} IR_Func;
+
+typedef struct {
+    struct {
+        IR_Func * items;
+        size_t count;
+        size_t capacity;
+    } funcs;
+    IR_Arrays globals; // in order of declaration, a name resolves to its first
+    int entry; // `main`, -1 if none
+} IR_Program;
+
+// `ir_run` status when the program is not lowered, the walker runs it then
+#define IR_STATUS_FALLBACK -1
+
+extern const char * ir_errmsg; // not heap alloc'ed
+
+// @return 1 if the program uses something the IR does not model, see `ir_errmsg`
+int ir_lower(IR_Program * prog, AST_Node * ast);
+// @return 1 if the IR is malformed, see `ir_errmsg`
+int ir_verify(IR_Program * prog);
+int ir_verify_func(IR_Program * prog, IR_Func * f);
+// runs the comma separated `passes` (NULL for the default pipeline) until
+// none changes anything, verifying after each
+// @return 1 if a pass is unknown or the verifier fails, see `ir_errmsg`
+int ir_optimize(IR_Program * prog, const char * passes);
+void ir_print(IR_Program * prog, FILE * out);
+void ir_free(IR_Program * prog);
+
+// the IR engine: as `cvm_run`, or IR_STATUS_FALLBACK
+int ir_run(int * ret_val, AST_Node * ast, FILE * is, FILE * os);
+
+// helpers shared by the IR modules
+int ir_is_terminator(int op);
+int ir_has_value(int op);
+// @return the id of a new instruction, in no block yet
+int ir_new_inst(IR_Func * f, int op);
+// the phis of a block are its first instructions
+size_t ir_n_phis(IR_Func * f, int block);
+void ir_insert(IR_Func * f, int block, size_t pos, int id);
+// takes an instruction out of its block, its id stays unused
+void ir_remove_inst(IR_Func * f, int id);
+// @return the id of a new IR_CONST, right after the phis of `block`
+int ir_insert_const(IR_Func * f, int block, int value);
+// drops an edge from `pred` to `block`, and the operand of each phi for it
+void ir_remove_pred(IR_Func * f, int block, int pred);
+
+#endif // IR_H_
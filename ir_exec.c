@@ -0,0 +1,345 @@
+#include <stdio.h> // io stream
+#include <stddef.h>
+#include <stdlib.h> // memory
+#include <string.h>
+#include <time.h> // clock_gettime
+
+#include "ir.h"
+#include "cvm.h"
+#include "dynarray.h"
+#include "pipeio.h"
+
+// @desc
+// the interpreter of the SSA IR, see ir.h: a frame holds one int per
+// instruction of its function, and entering a block by an edge sets its
+// phis to their operands for that edge, all at once
+
+// an array at run time, or a global int as an array of one
+typedef struct {
+    int * values; // NULL until declared
+    IR_Array * type;
+    size_t bytes;
+} IR_Memory;
+
+static _Thread_local IR_Program * prog = NULL;
+static _Thread_local IR_Memory * globals = NULL;
+// the frames of the calls in progress, one after the other
+static _Thread_local struct {
+    int * items;
+    size_t count;
+    size_t capacity;
+} stack = {};
+static _Thread_local struct {
+    IR_Memory * items; // the local arrays of each frame
+    size_t count;
+    size_t capacity;
+} arrays = {};
+static _Thread_local size_t depth = 0;
+static _Thread_local char ir_exec_errbuf[256];
+
+static _Thread_local FILE * is = NULL;
+static _Thread_local FILE * os = NULL;
+static _Thread_local int pipeio_on = 0;
+
+static double ir_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// @return 1 if it cannot be mapped, as the walker's `cvm_declare`
+static int ir_alloc(IR_Memory * memory) {
+    memory->values = NULL;
+    if (!__builtin_mul_overflow(memory->type->n_values, sizeof(int), &memory->bytes)) {
+        memory->values = cvm_alloc_values(memory->bytes);
+    }
+    if (!memory->values) {
+        cvm_errmsg = "Out of memory";
+        return 1;
+    }
+    if (memory->type->dims.count == 0) return 0; // a global int
+    cvm_stats.memory += memory->bytes;
+    if (cvm_stats.memory > cvm_stats.memory_max) cvm_stats.memory_max = cvm_stats.memory;
+    return 0;
+}
+
+static void ir_release(IR_Memory * memory) {
+    if (!memory->values) return;
+    if (memory->type->dims.count) cvm_stats.memory -= memory->bytes;
+    cvm_free_values(memory->values, memory->bytes);
+    memory->values = NULL;
+}
+
+// a frame for `f` on top of the stack, its values undefined until set
+static void ir_push_frame(IR_Func * f) {
+    size_t n = f->insts.count;
+    if (stack.count + n > stack.capacity) {
+        while (stack.count + n > stack.capacity) stack.capacity = stack.capacity ? stack.capacity * 2 : 1024;
+        stack.items = (int *)realloc(stack.items, stack.capacity * sizeof(int));
+    }
+    stack.count += n;
+    for (size_t i = 0; i < f->arrays.count; ++i) {
+        da_append(&arrays, ((IR_Memory) {NULL, f->arrays.items + i}));
+    }
+}
+
+static void ir_pop_frame(size_t base, size_t abase) {
+    for (size_t i = abase; i < arrays.count; ++i) ir_release(arrays.items + i);
+    stack.count = base;
+    arrays.count = abase;
+}
+
+// the local array once declared, else the global one, NULL if neither
+static IR_Memory * ir_array(IR_Inst * inst, size_t abase) {
+    if (inst->local >= 0 && arrays.items[abase + inst->local].values) return arrays.items + abase + inst->local;
+    return inst->global >= 0 ? globals + inst->global : NULL;
+}
+
+// row-major, as the walker
+static int * ir_element(IR_Memory * memory, const int * subs, const int * v) {
+    IR_Dims * dims = &memory->type->dims;
+    size_t index = 0;
+    size_t postfix_hypervolume = 1;
+    for (int i = (int)dims->count - 1; i >= 0; --i) {
+        index += postfix_hypervolume * (size_t)v[subs[i]];
+        postfix_hypervolume *= dims->items[i];
+    }
+    return memory->values + index;
+}
+
+static int ir_index_error(IR_Memory * memory, IR_Inst * inst, int index) {
+    IR_Array * type = memory->type;
+    snprintf(ir_exec_errbuf, sizeof(ir_exec_errbuf),
+             "Index %d out of range [0, %zu) in subscript %d of `%.*s`",
+             index, type->dims.items[inst->imm], inst->imm + 1,
+             (int)type->iden.len, type->iden.begin);
+    cvm_errmsg = ir_exec_errbuf;
+    cvm_errtok = inst->tok;
+    return 1;
+}
+
+static int ir_eval_binop(int bop, int l, int r) {
+    switch (bop) {
+    case IR_MUL: return l * r;
+    case IR_DIV: return l / r;
+    case IR_MOD: return l % r;
+    case IR_ADD: return l + r;
+    case IR_SUB: return l - r;
+    case IR_LE: return l <= r;
+    case IR_GE: return l >= r;
+    case IR_LT: return l < r;
+    case IR_GT: return l > r;
+    case IR_EQ: return l == r;
+    case IR_NE: return l != r;
+    case IR_XOR: return (l != 0) != (r != 0);
+    case IR_AND: return l && r;
+    case IR_OR: return l || r;
+    }
+    return 0; // @assert unreachable
+}
+
+static int ir_call(int * ret_val, IR_Func * f, size_t base, size_t abase);
+
+// runs the frame at `base`, whose parameters are set
+// a tail call replaces the frame, the same loop runs the callee
+// @return 0 if returned, else as `cvm_run`
+static int ir_exec(int * ret_val, IR_Func * f, size_t base, size_t abase) {
+    int b = 0;
+    for (;;) {
+        IR_Block * block = f->blocks.items + b;
+        int * v = stack.items + base;
+        int * ids = block->insts.items;
+        size_t i = 0;
+        while (f->insts.items[ids[i]].op == IR_PHI) ++i; // set on the way in
+        int next = -1;
+        int tail_call = 0;
+        for (; next < 0; ++i) {
+            int id = ids[i];
+            IR_Inst * inst = f->insts.items + id;
+            int * a = inst->args.items;
+            switch (inst->op) {
+            case IR_CONST: v[id] = inst->imm; break;
+            case IR_PARAM: break; // set by the caller
+            case IR_COPY: v[id] = v[a[0]]; break;
+            case IR_BINOP: v[id] = ir_eval_binop(inst->bop, v[a[0]], v[a[1]]); break;
+            case IR_NOT: v[id] = !v[a[0]]; break;
+            case IR_LOAD: v[id] = globals[inst->imm].values[0]; break;
+            case IR_STORE: globals[inst->imm].values[0] = v[a[0]]; break;
+            case IR_ALOAD: {
+                IR_Memory * memory = ir_array(inst, abase);
+                if (!memory) return 1;
+                v[id] = *ir_element(memory, a, v);
+            } break;
+            case IR_ASTORE: {
+                IR_Memory * memory = ir_array(inst, abase);
+                if (!memory) return 1;
+                *ir_element(memory, a, v) = v[a[inst->args.count - 1]];
+            } break;
+            case IR_ACHECK: {
+                IR_Memory * memory = ir_array(inst, abase);
+                if (!memory || memory->type->dims.count != (size_t)inst->imm) return 1;
+            } break;
+            case IR_BOUND: {
+                IR_Memory * memory = ir_array(inst, abase);
+                if (!memory) return 1;
+                int index = v[a[0]];
+                if (index < 0 || (size_t)index >= memory->type->dims.items[inst->imm]) {
+                    return ir_index_error(memory, inst, index);
+                }
+            } break;
+            case IR_ALLOC: {
+                IR_Memory * memory = arrays.items + abase + inst->local;
+                // a second declaration is shadowed by the first in the walker
+                if (!memory->values && ir_alloc(memory)) return CVM_STATUS_LIMIT;
+            } break;
+            case IR_CALL: {
+                IR_Func * callee = prog->funcs.items + inst->imm;
+                size_t n_args = inst->args.count;
+                IR_Inst * after = f->insts.items + ids[i + 1];
+                if (inst->tail && after->op == IR_RETURN && after->args.items[0] == id) {
+                    // the arguments may be parameters of this very frame
+                    int args[n_args + 1];
+                    for (size_t k = 0; k < n_args; ++k) args[k] = v[a[k]];
+                    ir_pop_frame(base, abase);
+                    ir_push_frame(callee);
+                    v = stack.items + base;
+                    for (size_t k = 0; k < n_args; ++k) v[callee->params.items[k]] = args[k];
+                    f = callee;
+                    tail_call = 1;
+                    next = 0;
+                    break;
+                }
+                size_t callee_base = stack.count;
+                size_t callee_abase = arrays.count;
+                ir_push_frame(callee);
+                v = stack.items + base; // may have moved
+                for (size_t k = 0; k < n_args; ++k) stack.items[callee_base + callee->params.items[k]] = v[a[k]];
+                int r;
+                int status = ir_call(&r, callee, callee_base, callee_abase);
+                if (status) return status;
+                v = stack.items + base;
+                v[id] = r;
+            } break;
+            case IR_IN: {
+                int value = v[a[0]];
+                if (pipeio_on) pipeio_read_int(&value);
+                else fscanf(is, "%d", &value);
+                v[id] = value;
+            } break;
+            case IR_OUT: {
+                if (pipeio_on) pipeio_write_int(v[a[0]]);
+                else fprintf(os, "%d", v[a[0]]);
+            } break;
+            case IR_ENDL: {
+                if (pipeio_on) pipeio_write_endl();
+                else fprintf(os, "\n");
+            } break;
+            case IR_STEP: cvm_stats.steps += inst->imm; break;
+            case IR_JUMP: next = block->succs[0]; break;
+            case IR_BRANCH: next = block->succs[v[a[0]] ? 0 : 1]; break;
+            case IR_RETURN: {
+                *ret_val = v[a[0]];
+                return 0;
+            } break;
+            case IR_FAIL: return 1;
+            default: return -1; // @assert unreachable
+            }
+        }
+        if (tail_call) {
+            b = 0;
+            continue;
+        }
+
+        // the phis of the next block, from the values of this one
+        IR_Block * succ = f->blocks.items + next;
+        size_t pred = 0;
+        while (succ->preds.items[pred] != b) ++pred;
+        size_t n_phis = 0;
+        while (n_phis < succ->insts.count && f->insts.items[succ->insts.items[n_phis]].op == IR_PHI) ++n_phis;
+        if (n_phis) {
+            int values[n_phis];
+            for (size_t k = 0; k < n_phis; ++k) {
+                values[k] = v[f->insts.items[succ->insts.items[k]].args.items[pred]];
+            }
+            for (size_t k = 0; k < n_phis; ++k) v[succ->insts.items[k]] = values[k];
+        }
+        b = next;
+    }
+}
+
+// a call, with its frame pushed and its parameters set, pops the frame
+static int ir_call(int * ret_val, IR_Func * f, size_t base, size_t abase) {
+    depth += 1;
+    if (depth > cvm_stats.depth_max) cvm_stats.depth_max = depth;
+    int status = ir_exec(ret_val, f, base, abase);
+    ir_pop_frame(base, abase);
+    depth -= 1;
+    return status;
+}
+
+static void ir_copy_globals(CVM_Globals * out) {
+    for (size_t i = 0; i < prog->globals.count; ++i) {
+        IR_Memory * memory = globals + i;
+        IR_Array * type = memory->type;
+        CVM_Global copy = {type->iden, .n_dims = type->dims.count, .n_values = type->n_values};
+        copy.values = (int *)malloc(copy.n_values * sizeof(int));
+        if (memory->values) memcpy(copy.values, memory->values, copy.n_values * sizeof(int));
+        else memset(copy.values, 0, copy.n_values * sizeof(int));
+        if (copy.n_dims) {
+            copy.dims = (size_t *)malloc(copy.n_dims * sizeof(size_t));
+            memcpy(copy.dims, type->dims.items, copy.n_dims * sizeof(size_t));
+        }
+        da_append(out, copy);
+    }
+}
+
+int ir_run(int * ret_val, AST_Node * ast, FILE * is_, FILE * os_) {
+    IR_Program program;
+    if (ir_lower(&program, ast)) {
+        ir_free(&program);
+        return IR_STATUS_FALLBACK;
+    }
+    // a malformed IR is a bug of a pass, or of lowering
+    if (ir_verify(&program) || ir_optimize(&program, cvm_config.ir_passes)) {
+        cvm_errmsg = ir_errmsg;
+        ir_free(&program);
+        return 1;
+    }
+    prog = &program;
+    is = is_;
+    os = os_;
+    double start_time = ir_now();
+    pipeio_on = cvm_config.pipelined_io && !pipeio_start(is, os);
+
+    int status = 0;
+    globals = (IR_Memory *)calloc(prog->globals.count + 1, sizeof(IR_Memory));
+    for (size_t i = 0; i < prog->globals.count && !status; ++i) {
+        globals[i].type = prog->globals.items + i;
+        if (ir_alloc(globals + i)) status = CVM_STATUS_LIMIT;
+    }
+    if (status) {
+        // a global could not be mapped
+    } else if (prog->entry >= 0) {
+        IR_Func * entry_point = prog->funcs.items + prog->entry;
+        ir_push_frame(entry_point);
+        status = ir_call(ret_val, entry_point, 0, 0);
+    } else {
+        status = 1;
+    }
+
+    if (pipeio_on) pipeio_stop();
+    pipeio_on = 0;
+    cvm_stats.time = ir_now() - start_time;
+    if (cvm_globals_out) ir_copy_globals(cvm_globals_out);
+    for (size_t i = 0; i < prog->globals.count; ++i) {
+        if (globals[i].type) ir_release(globals + i);
+    }
+    free(globals);
+    globals = NULL;
+    da_free(&stack);
+    da_free(&arrays);
+    depth = 0;
+    ir_free(&program);
+    prog = NULL;
+    return status;
+}
@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h> // memory
+#include <string.h>
+#include <limits.h> // INT_MIN
+
+#include "ir.h"
+#include "dynarray.h"
+
+// @desc
+// the passes over the SSA IR and the pass manager, see ir.h
+// a pass rewrites one function, and returns 1 if it changed anything
+
+static char ir_pass_errbuf[320];
+
+// division by 0 and INT_MIN / -1 trap at run time, as in the walker
+static int ir_may_trap(IR_Func * f, IR_Inst * inst) {
+    if (inst->op != IR_BINOP || (inst->bop != IR_DIV && inst->bop != IR_MOD)) return 0;
+    IR_Inst * r = f->insts.items + inst->args.items[1];
+    return r->op != IR_CONST || r->imm == 0 || r->imm == -1;
+}
+
+// `l op r` as the walker computes it, wrapping around on overflow
+static int ir_fold(int bop, int l, int r) {
+    unsigned ul = (unsigned)l, ur = (unsigned)r;
+    switch (bop) {
+    case IR_MUL: return (int)(ul * ur);
+    case IR_DIV: return l / r;
+    case IR_MOD: return l % r;
+    case IR_ADD: return (int)(ul + ur);
+    case IR_SUB: return (int)(ul - ur);
+    case IR_LE: return l <= r;
+    case IR_GE: return l >= r;
+    case IR_LT: return l < r;
+    case IR_GT: return l > r;
+    case IR_EQ: return l == r;
+    case IR_NE: return l != r;
+    case IR_XOR: return (l != 0) != (r != 0);
+    case IR_AND: return l && r;
+    case IR_OR: return l || r;
+    }
+    return 0; // @assert unreachable
+}
+
+static int ir_is_const(IR_Func * f, int id) {
+    return f->insts.items[id].op == IR_CONST;
+}
+
+// a phi becoming a constant moves after the phis of its block
+static void ir_make_const(IR_Func * f, int id, int value) {
+    IR_Inst * inst = f->insts.items + id;
+    int block = inst->block;
+    int was_phi = inst->op == IR_PHI;
+    inst->op = IR_CONST;
+    inst->imm = value;
+    inst->args.count = 0;
+    if (!was_phi) return;
+    ir_remove_inst(f, id);
+    ir_insert(f, block, ir_n_phis(f, block), id);
+}
+
+static int ir_constprop(IR_Func * f) {
+    int changed = 0;
+    for (size_t id = 0; id < f->insts.count; ++id) {
+        IR_Inst * inst = f->insts.items + id;
+        if (inst->block < 0) continue;
+        int * args = inst->args.items;
+        switch (inst->op) {
+        case IR_BINOP: {
+            if (!ir_is_const(f, args[0]) || !ir_is_const(f, args[1]) || ir_may_trap(f, inst)) break;
+            ir_make_const(f, id, ir_fold(inst->bop, f->insts.items[args[0]].imm, f->insts.items[args[1]].imm));
+            changed = 1;
+        } break;
+        case IR_NOT: {
+            if (!ir_is_const(f, args[0])) break;
+            ir_make_const(f, id, !f->insts.items[args[0]].imm);
+            changed = 1;
+        } break;
+        case IR_PHI: {
+            // the same constant on every edge, itself aside
+            size_t n = 0, j;
+            int value = 0;
+            for (j = 0; j < inst->args.count; ++j) {
+                if (args[j] == (int)id) continue;
+                if (!ir_is_const(f, args[j]) || (n++ && f->insts.items[args[j]].imm != value)) break;
+                value = f->insts.items[args[j]].imm;
+            }
+            if (j < inst->args.count || n == 0) break;
+            ir_make_const(f, id, value);
+            changed = 1;
+        } break;
+        case IR_BRANCH: {
+            if (!ir_is_const(f, args[0])) break;
+            IR_Block * block = f->blocks.items + inst->block;
+            int taken = block->succs[f->insts.items[args[0]].imm ? 0 : 1];
+            int other = block->succs[f->insts.items[args[0]].imm ? 1 : 0];
+            inst->op = IR_JUMP;
+            inst->args.count = 0;
+            block->succs[0] = taken;
+            block->succs[1] = -1;
+            ir_remove_pred(f, other, inst->block);
+            changed = 1;
+        } break;
+        }
+    }
+    return changed;
+}
+
+static int ir_copyprop(IR_Func * f) {
+    size_t n = f->insts.count;
+    int * repl = (int *)malloc(n * sizeof(int) + 1);
+    for (size_t id = 0; id < n; ++id) repl[id] = -1;
+    int changed = 0;
+    // phis of phis settle over rounds
+    for (int again = 1; again; ) {
+        again = 0;
+        for (size_t id = 0; id < n; ++id) {
+            IR_Inst * inst = f->insts.items + id;
+            if (inst->block < 0 || repl[id] >= 0 || (inst->op != IR_COPY && inst->op != IR_PHI)) continue;
+            int same = -1;
+            size_t j;
+            for (j = 0; j < inst->args.count; ++j) {
+                int v = inst->args.items[j];
+                while (repl[v] >= 0) v = repl[v];
+                if (v == (int)id || v == same) continue;
+                if (same >= 0) break;
+                same = v;
+            }
+            // a phi only of itself is in an unreachable loop, left to dce
+            if (j < inst->args.count || same < 0) continue;
+            repl[id] = same;
+            again = 1;
+        }
+    }
+    for (size_t id = 0; id < n; ++id) {
+        IR_Inst * inst = f->insts.items + id;
+        if (inst->block < 0) continue;
+        if (repl[id] >= 0) {
+            ir_remove_inst(f, id);
+            changed = 1;
+            continue;
+        }
+        for (size_t j = 0; j < inst->args.count; ++j) {
+            int v = inst->args.items[j];
+            while (repl[v] >= 0) v = repl[v];
+            inst->args.items[j] = v;
+        }
+    }
+    free(repl);
+    return changed;
+}
+
+static int ir_has_effect(IR_Func * f, IR_Inst * inst) {
+    switch (inst->op) {
+    case IR_CONST: case IR_PARAM: case IR_PHI: case IR_COPY: case IR_NOT: case IR_LOAD: case IR_ALOAD:
+        return 0;
+    case IR_BINOP: return ir_may_trap(f, inst);
+    default: return 1;
+    }
+}
+
+static int ir_dce(IR_Func * f) {
+    int changed = 0;
+    size_t n_blocks = f->blocks.count;
+    char * reached = (char *)calloc(n_blocks + 1, 1);
+    int * stack = (int *)malloc(n_blocks * sizeof(int) + 1);
+    size_t top = 0;
+    stack[top++] = 0;
+    reached[0] = 1;
+    while (top) {
+        IR_Block * block = f->blocks.items + stack[--top];
+        for (int s = 0; s < 2; ++s) {
+            int succ = block->succs[s];
+            if (succ < 0 || reached[succ]) continue;
+            reached[succ] = 1;
+            stack[top++] = succ;
+        }
+    }
+    for (size_t b = 0; b < n_blocks; ++b) {
+        IR_Block * block = f->blocks.items + b;
+        if (reached[b] || block->removed) continue;
+        for (int s = 0; s < 2; ++s) {
+            if (block->succs[s] >= 0 && reached[block->succs[s]]) ir_remove_pred(f, block->succs[s], b);
+        }
+        for (size_t i = 0; i < block->insts.count; ++i) f->insts.items[block->insts.items[i]].block = -1;
+        block->insts.count = 0;
+        block->preds.count = 0;
+        block->succs[0] = block->succs[1] = -1;
+        block->removed = 1;
+        changed = 1;
+    }
+    free(reached);
+    free(stack);
+
+    // mark what the instructions with effects use, transitively
+    size_t n = f->insts.count;
+    char * live = (char *)calloc(n + 1, 1);
+    int * work = (int *)malloc(n * sizeof(int) + 1);
+    top = 0;
+    for (size_t id = 0; id < n; ++id) {
+        if (f->insts.items[id].block < 0 || !ir_has_effect(f, f->insts.items + id)) continue;
+        live[id] = 1;
+        work[top++] = (int)id;
+    }
+    while (top) {
+        IR_Inst * inst = f->insts.items + work[--top];
+        for (size_t j = 0; j < inst->args.count; ++j) {
+            int arg = inst->args.items[j];
+            if (live[arg]) continue;
+            live[arg] = 1;
+            work[top++] = arg;
+        }
+    }
+    for (size_t id = 0; id < n; ++id) {
+        if (f->insts.items[id].block < 0 || live[id]) continue;
+        ir_remove_inst(f, id);
+        changed = 1;
+    }
+    free(live);
+    free(work);
+    return changed;
+}
+
+// the count of a step moves up to the previous one, unless something that
+// may end the run is in between
+static int ir_merge_steps(IR_Func * f) {
+    int changed = 0;
+    for (size_t b = 0; b < f->blocks.count; ++b) {
+        IR_Ids * insts = &f->blocks.items[b].insts;
+        int last = -1;
+        for (size_t i = 0; i < insts->count; ) {
+            int id = insts->items[i];
+            IR_Inst * inst = f->insts.items + id;
+            if (inst->op == IR_STEP && last >= 0) {
+                f->insts.items[last].imm += inst->imm;
+                ir_remove_inst(f, id);
+                changed = 1;
+                continue;
+            }
+            if (inst->op == IR_STEP) last = id;
+            if (inst->op == IR_CALL || inst->op == IR_ACHECK || inst->op == IR_BOUND) last = -1;
+            ++i;
+        }
+    }
+    return changed;
+}
+
+typedef struct {
+    const char * name;
+    int (*run)(IR_Func * f);
+} IR_Pass;
+
+static const IR_Pass ir_passes[] = {
+    {"constprop", ir_constprop},
+    {"copyprop", ir_copyprop},
+    {"dce", ir_dce},
+    {"steps", ir_merge_steps},
+};
+static const char * IR_DEFAULT_PASSES = "constprop,copyprop,dce,steps";
+static const int IR_MAX_PASSES = 16; // in a pipeline
+static const int IR_MAX_ROUNDS = 16; // of a pipeline over a function
+
+int ir_optimize(IR_Program * prog, const char * passes) {
+    ir_errmsg = NULL;
+    if (!passes) passes = IR_DEFAULT_PASSES;
+    if (strcmp(passes, "none") == 0) passes = "";
+    const IR_Pass * pipeline[IR_MAX_PASSES];
+    int n_passes = 0;
+    for (const char * p = passes; *p; ) {
+        size_t len = strcspn(p, ",");
+        size_t k = 0;
+        while (k < sizeof(ir_passes) / sizeof(ir_passes[0]) &&
+               (strlen(ir_passes[k].name) != len || strncmp(ir_passes[k].name, p, len) != 0)) ++k;
+        if (k == sizeof(ir_passes) / sizeof(ir_passes[0]) || n_passes == IR_MAX_PASSES) {
+            snprintf(ir_pass_errbuf, sizeof(ir_pass_errbuf), "Unknown pass `%.*s`, or more than %d",
+                     (int)len, p, IR_MAX_PASSES);
+            ir_errmsg = ir_pass_errbuf;
+            return 1;
+        }
+        pipeline[n_passes++] = ir_passes + k;
+        p += len;
+        if (*p == ',') ++p;
+    }
+
+    for (size_t i = 0; i < prog->funcs.count; ++i) {
+        IR_Func * f = prog->funcs.items + i;
+        int changed = 1;
+        for (int round = 0; round < IR_MAX_ROUNDS && changed; ++round) {
+            changed = 0;
+            for (int k = 0; k < n_passes; ++k) {
+                if (!pipeline[k]->run(f)) continue;
+                changed = 1;
+                if (ir_verify_func(prog, f)) {
+                    snprintf(ir_pass_errbuf, sizeof(ir_pass_errbuf), "After %s: %s", pipeline[k]->name, ir_errmsg);
+                    ir_errmsg = ir_pass_errbuf;
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include <stddef.h> // size_t
+
+#include "kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNELS_X86
+#endif
+
+// scalar fallback, unsigned so that overflow wraps around
+
+static int scalar_op(int l, char op, int r) {
+    unsigned ul = l, ur = r;
+    switch (op) {
+    case '+': return (int)(ul + ur);
+    case '-': return (int)(ul - ur);
+    default: return (int)(ul * ur); // '*'
+    }
+}
+
+static int operand_at(Kernel_Operand o, size_t k) {
+    return o.row ? o.row[k] : o.value;
+}
+
+#ifdef KERNELS_X86
+
+// AVX2: 8 ints at a time
+
+__attribute__((target("avx2")))
+static size_t fill_avx2(int * dst, int value, size_t n) {
+    __m256i v = _mm256_set1_epi32(value);
+    size_t k = 0;
+    for (; k + 8 <= n; k += 8) _mm256_storeu_si256((__m256i *)(dst + k), v);
+    return k;
+}
+
+__attribute__((target("avx2")))
+static size_t sum_avx2(const int * src, size_t n, unsigned * sum) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t k = 0;
+    for (; k + 8 <= n; k += 8) {
+        acc = _mm256_add_epi32(acc, _mm256_loadu_si256((const __m256i *)(src + k)));
+    }
+    unsigned lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    for (int i = 0; i < 8; ++i) *sum += lanes[i];
+    return k;
+}
+
+__attribute__((target("avx2")))
+static __m256i load_avx2(Kernel_Operand o, size_t k) {
+    if (!o.row) return _mm256_set1_epi32(o.value);
+    return _mm256_loadu_si256((const __m256i *)(o.row + k));
+}
+
+__attribute__((target("avx2")))
+static size_t map_avx2(int * dst, Kernel_Operand l, char op, Kernel_Operand r, size_t n) {
+    size_t k = 0;
+    for (; k + 8 <= n; k += 8) {
+        __m256i a = load_avx2(l, k), b = load_avx2(r, k), c;
+        switch (op) {
+        case '+': c = _mm256_add_epi32(a, b); break;
+        case '-': c = _mm256_sub_epi32(a, b); break;
+        default: c = _mm256_mullo_epi32(a, b); break;
+        }
+        _mm256_storeu_si256((__m256i *)(dst + k), c);
+    }
+    return k;
+}
+
+// SSE2: 4 ints at a time, SSE4.1 for multiplication
+
+static size_t fill_sse2(int * dst, int value, size_t n) {
+    __m128i v = _mm_set1_epi32(value);
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) _mm_storeu_si128((__m128i *)(dst + k), v);
+    return k;
+}
+
+static size_t sum_sse2(const int * src, size_t n, unsigned * sum) {
+    __m128i acc = _mm_setzero_si128();
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        acc = _mm_add_epi32(acc, _mm_loadu_si128((const __m128i *)(src + k)));
+    }
+    unsigned lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    for (int i = 0; i < 4; ++i) *sum += lanes[i];
+    return k;
+}
+
+__attribute__((target("sse4.1")))
+static size_t map_sse4(int * dst, Kernel_Operand l, char op, Kernel_Operand r, size_t n) {
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        __m128i a = l.row ? _mm_loadu_si128((const __m128i *)(l.row + k)) : _mm_set1_epi32(l.value);
+        __m128i b = r.row ? _mm_loadu_si128((const __m128i *)(r.row + k)) : _mm_set1_epi32(r.value);
+        __m128i c;
+        switch (op) {
+        case '+': c = _mm_add_epi32(a, b); break;
+        case '-': c = _mm_sub_epi32(a, b); break;
+        default: c = _mm_mullo_epi32(a, b); break;
+        }
+        _mm_storeu_si128((__m128i *)(dst + k), c);
+    }
+    return k;
+}
+
+#endif // KERNELS_X86
+
+void kernel_fill(int * dst, int value, size_t n) {
+    size_t k = 0;
+#ifdef KERNELS_X86
+    if (__builtin_cpu_supports("avx2")) k = fill_avx2(dst, value, n);
+    else k = fill_sse2(dst, value, n);
+#endif
+    for (; k < n; ++k) dst[k] = value;
+}
+
+int kernel_sum(const int * src, size_t n) {
+    unsigned sum = 0;
+    size_t k = 0;
+#ifdef KERNELS_X86
+    if (__builtin_cpu_supports("avx2")) k = sum_avx2(src, n, &sum);
+    else k = sum_sse2(src, n, &sum);
+#endif
+    for (; k < n; ++k) sum += (unsigned)src[k];
+    return (int)sum;
+}
+
+void kernel_map(int * dst, Kernel_Operand l, char op, Kernel_Operand r, size_t n) {
+    size_t k = 0;
+#ifdef KERNELS_X86
+    if (__builtin_cpu_supports("avx2")) k = map_avx2(dst, l, op, r, n);
+    else if (__builtin_cpu_supports("sse4.1")) k = map_sse4(dst, l, op, r, n);
+#endif
+    for (; k < n; ++k) dst[k] = scalar_op(operand_at(l, k), op, operand_at(r, k));
+}
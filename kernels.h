@@ -0,0 +1,27 @@
+#ifndef KERNELS_H_
+#define KERNELS_H_
+
+#include <stddef.h> // size_t
+
+/*
+  @def Array kernels
+
+  Loop idioms recognized by the cvm loop optimizer, run over contiguous
+  rows of int arrays. AVX2 or SSE is picked at run time, with a scalar
+  fallback. All of them wrap around on overflow like the scalar `int`
+  arithmetic of the cvm.
+*/
+
+// one side of a binary kernel: a row, or a value broadcast to every element
+typedef struct {
+    const int * row; // NULL for broadcast
+    int value;
+} Kernel_Operand;
+
+void kernel_fill(int * dst, int value, size_t n);
+int kernel_sum(const int * src, size_t n);
+// dst[k] = l[k] op r[k], op is one of + - *
+// dst may be l.row or r.row, but must not overlap them otherwise
+void kernel_map(int * dst, Kernel_Operand l, char op, Kernel_Operand r, size_t n);
+
+#endif // KERNELS_H_
@@ -0,0 +1,72 @@
+#include <stdio.h> // snprintf
+#include <stddef.h> // size_t
+#include <string.h>
+
+#include "link.h"
+#include "dynarray.h"
+
+const char * link_errmsg = NULL;
+static char link_errbuf[256];
+
+// 'FUNC' and 'DECL' name their function or global first
+static const Token * defined_name(AST_Node * item) {
+    if (item->type != 'FUNC' && item->type != 'DECL') return NULL;
+    return item->items[0].token;
+}
+
+// the first item of a unit before `last` defining `name` as `type`
+static AST_Node * find_definition(Units * units, Unit * last, uint32_t type, const Token * name) {
+    for (Unit * unit = units->items; unit < last; ++unit) {
+        for (size_t i = 0; i < unit->ast.count; ++i) {
+            AST_Node * item = unit->ast.items + i;
+            const Token * other = defined_name(item);
+            if (item->type == type && other && other->len == name->len &&
+                memcmp(other->begin, name->begin, name->len) == 0) return item;
+        }
+    }
+    return NULL;
+}
+
+int link_units(AST_Node * program, Units * units) {
+    link_errmsg = NULL;
+    for (Unit * unit = units->items; unit < units->items + units->count; ++unit) {
+        for (size_t i = 0; i < unit->ast.count; ++i) {
+            AST_Node * item = unit->ast.items + i;
+            const Token * name = defined_name(item);
+            AST_Node * other = name ? find_definition(units, unit, item->type, name) : NULL;
+            if (!other) continue;
+            Unit * first = link_unit_of(units, other->items[0].token->begin);
+            snprintf(link_errbuf, sizeof(link_errbuf), "%s `%.*s` is defined in both %s and %s",
+                     item->type == 'FUNC' ? "Function" : "Global", (int)name->len, name->begin,
+                     first->path, unit->path);
+            link_errmsg = link_errbuf;
+            return 1;
+        }
+    }
+
+    *program = (AST_Node) {'TOP'};
+    for (Unit * unit = units->items; unit < units->items + units->count; ++unit) {
+        for (size_t i = 0; i < unit->ast.count; ++i) da_append(program, unit->ast.items[i]);
+        // the array stays with the unit: a cached unit keeps all of its nodes in it
+        unit->ast.count = 0;
+    }
+    return 0;
+}
+
+Unit * link_unit_of(Units * units, const char * p) {
+    for (Unit * unit = units->items; unit < units->items + units->count; ++unit) {
+        const char * buffer = unit->tok.buffer;
+        if (buffer && p >= buffer && p <= buffer + strlen(buffer)) return unit;
+    }
+    return NULL;
+}
+
+void link_free(AST_Node * program, Units * units) {
+    // first: the items of cached units live in the arrays of the units
+    ast_free_node(program);
+    for (Unit * unit = units->items; unit < units->items + units->count; ++unit) {
+        ast_free_node(&unit->ast);
+        Tokenizer_free(&unit->tok);
+    }
+    da_free(units);
+}
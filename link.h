@@ -0,0 +1,45 @@
+#ifndef LINK_H_
+#define LINK_H_
+
+#include <stddef.h> // size_t
+
+#include "tokenizer.h"
+#include "ast_builder.h"
+
+/*
+  @def Linking
+
+  A program may be split into units: the libraries given with `--lib`,
+  then the main source. Each unit is tokenized and parsed on its own, or
+  loaded from the cache (see cache.h) by the hash of its own text, so a
+  library shared by many programs is parsed once for all of them.
+
+  Linking puts the top level items of the units, in order, into one
+  'TOP'. The cvm resolves names over the whole of it at run time, so the
+  linker only has to check that no function, and no global, is defined
+  by two units.
+*/
+
+typedef struct {
+    const char * path;
+    Tokenizer tok; // the tokens of all nodes of the unit point into `tok.buffer`
+    AST_Node ast; // 'TOP', its items are moved to the program by `link_units`
+} Unit;
+
+typedef struct {
+    Unit * items;
+    size_t count;
+    size_t capacity;
+} Units;
+
+extern const char * link_errmsg; // not heap alloc'ed
+
+// `program` takes the top level items of every unit
+// return 1 if a name is defined by two units, see `link_errmsg`
+int link_units(AST_Node * program, Units * units);
+// the unit whose source holds `p`, NULL if none
+Unit * link_unit_of(Units * units, const char * p);
+// frees the program, then the units
+void link_free(AST_Node * program, Units * units);
+
+#endif // LINK_H_
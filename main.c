@@ -3,11 +3,23 @@
 #include <stdio.h>
 #include <stddef.h> // size_t
 #include <stdlib.h> // memory
+#include <string.h> // strcmp
+#include <unistd.h> // sysconf
 
 #include "dynarray.h"
 #include "tokenizer.h"
 #include "ast_builder.h"
 #include "cvm.h"
+#include "cache.h"
+#include "trace.h"
+#include "sample.h"
+#include "repl.h"
+#include "server.h"
+#include "profile.h"
+#include "spmd.h"
+#include "link.h"
+#include "diff.h"
+#include "ir.h"
 
 void print_tokens(Tokenizer * t) {
     printf("Parsed %zu tokens: ", t->count);
@@ -17,76 +29,473 @@ void print_tokens(Tokenizer * t) {
     }
 }
 
-int main(int argc, char ** argv) {
-    int status = 0;
-    
-    if (argc == 1) {
-        printf("ERROR: No input file provided.\n");
-        printf("Usage: %s <c-code-file> [<input-file> [<output file>]]\n", argv[0]);
-        printf("       If no in/out file is provided, stdin/out "
-               "will be used, respectively.\n");
+void print_stats() {
+    printf("Statements: %zu, max call depth: %zu, max array memory: %zu bytes, time: %.3f s\n",
+           cvm_stats.steps, cvm_stats.depth_max, cvm_stats.memory_max, cvm_stats.time);
+}
+
+void print_usage(const char * prog) {
+    printf("Usage: %s [<options>] [--lib <c-code-file>]... <c-code-file> [<input-file> [<output file>]]\n", prog);
+    printf("       %s --repl [<options>] [<c-code-file> [<input-file> [<output file>]]]\n", prog);
+    printf("       %s --serve <socket> [<options>]\n", prog);
+    printf("       %s --client <socket> <c-code-file> [<input-file> [<output file>]]\n", prog);
+    printf("       %s --spmd <input-list> [<options>] <c-code-file>\n", prog);
+    printf("       If no in/out file is provided, stdin/out "
+           "will be used, respectively.\n");
+    printf("Options:\n");
+    printf("  --repl             read definitions and statements interactively\n");
+    printf("  --serve <socket>   run requests from a Unix domain socket on --jobs workers\n");
+    printf("  --server-cache <n> compiled programs kept by --serve (default: 64)\n");
+    printf("  --sessions         serve each connection as a coroutine, --jobs threads for all of them\n");
+    printf("  --client <socket>  run the program on a server\n");
+    printf("  --interactive      with --client, send input as it is typed, see server.h\n");
+    printf("  --spmd <list>      run over each input listed in <list>, %d in lockstep, into <input>.out\n",
+           SPMD_LANES);
+    printf("  --lib <file>       link the functions and globals of <file>, see link.h\n");
+    printf("  --cache <dir>      reuse compiled programs stored in <dir>\n");
+    printf("  --result-cache <dir> replay the output of a run of the same program on the same input\n");
+    printf("  --diff             compare the run with the options to one with -O0, see diff.h\n");
+    printf("  --jobs <n>         parse with <n> threads (default: number of CPUs)\n");
+    printf("  --lazy-parse       parse function bodies on their first call\n");
+    printf("  --eager-logic      always evaluate both operands of && and ||\n");
+    printf("  --checked          check array subscripts against their bounds\n");
+    printf("  -O0, -O1, -O2      optimization level (default: -O2)\n");
+    printf("  --ir               lower to the SSA IR and run that, see ir.h\n");
+    printf("  --ir-passes <list> comma separated IR passes, or none (default: constprop,copyprop,dce,steps)\n");
+    printf("  --ir-dump          print the optimized IR instead of running\n");
+    printf("  --parallel-calls   run pure calls like `f(a) + f(b)` on --jobs threads\n");
+    printf("  --pipelined-io     read input and write output on background threads\n");
+    printf("  --huge-pages       back large arrays with transparent huge pages\n");
+    printf("  --max-steps <n>    abort after <n> executed statements\n");
+    printf("  --max-depth <n>    abort beyond <n> nested calls\n");
+    printf("  --max-memory <n>   abort beyond <n> bytes of arrays\n");
+    printf("  --max-time <s>     abort after <s> seconds\n");
+    printf("  --stats            print execution counters\n");
+    printf("  --trace <file>     record calls and cin/cout into <file>, see trace2json\n");
+    printf("  --trace-loops      record loop iterations too\n");
+    printf("  --trace-events <n> keep the last <n> events (default: 65536)\n");
+    printf("  --profile-out <f>  count branches, loop iterations and calls into <f>\n");
+    printf("  --profile-in <f>   optimize with a profile of the same source\n");
+    printf("  --sample-profile <f> sample the call stack on a CPU timer, collapsed stacks into <f>\n");
+    printf("  --sample-interval <us> between samples (default: 10000)\n");
+}
+
+// `cin` and `cout` from the positional args, stdin/out if not provided
+int open_streams(char ** args, int n_args, FILE ** is, FILE ** os) {
+    *is = stdin;
+    *os = stdout;
+    if (n_args >= 2) {
+        *is = fopen(args[1], "r");
+        if (!*is) {
+            printf("ERROR: Open input file %s failed.\n", args[1]);
+            return 1;
+        }
+    }
+    if (n_args >= 3) {
+        *os = fopen(args[2], "w");
+        if (!*os) {
+            printf("ERROR: Open output file %s failed.\n", args[2]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// what is printed after a run, to stdout or for a result cache entry
+static void print_result(FILE * out, int status, int ret_val, Units * units) {
+    if (status == CVM_STATUS_LIMIT) {
+        fprintf(out, "CVM aborted: %s\n", cvm_errmsg);
+    } else if (status && cvm_errmsg) {
+        fprintf(out, "CVM runtime error: %s", cvm_errmsg);
+        Unit * unit = cvm_errtok ? link_unit_of(units, cvm_errtok->begin) : NULL;
+        if (unit == units->items + units->count - 1) fprintf(out, " (line %zu)", Tokenizer_line_of(&unit->tok, cvm_errtok->begin));
+        else if (unit) fprintf(out, " (%s line %zu)", unit->path, Tokenizer_line_of(&unit->tok, cvm_errtok->begin));
+        fprintf(out, "\n");
+    } else if (status) {
+        fprintf(out, "CVM exited abnormally. Syntax error in source file.\n");
+    } else {
+        fprintf(out, "CVM exited successfully with return value %d\n", ret_val);
+    }
+}
+
+// `--result-cache`: a run is a function of the sources, the input and the
+// options that change the meaning of a program, so a run of the same is
+// replayed from `dir`. The input is read to its end first, and the output
+// of a miss comes at the end of the run.
+// @return the status of the run
+static int run_with_result_cache(AST_Node * ast, Units * units, const char * dir, int lazy_parse,
+                                 FILE * is, FILE * os, int show_stats) {
+    struct {
+        char * items;
+        size_t count;
+        size_t capacity;
+    } input = {};
+    for (int c; (c = fgetc(is)) != EOF; ) da_append(&input, (char)c);
+    const char flags[3] = {'0' + cvm_config.checked, '0' + cvm_config.eager_logic, '0' + lazy_parse};
+    uint64_t key = cache_hash(flags, sizeof(flags));
+    for (size_t i = 0; i < units->count; ++i) {
+        // the path of a `--lib` is in its error messages
+        Unit * unit = units->items + i;
+        const char * path = i + 1 < units->count ? unit->path : "";
+        size_t len = strlen(unit->tok.buffer);
+        key = cache_hash_add(key, path, strlen(path) + 1);
+        key = cache_hash_add(key, (const char *)&len, sizeof(len));
+        key = cache_hash_add(key, unit->tok.buffer, len);
+    }
+    key = cache_hash_add(key, input.items, input.count);
+
+    Cache_Result result;
+    if (!cache_load_result(&result, key, dir)) {
+        // the run may not fit in the limits of this one, run it then
+        if ((!cvm_config.max_steps || result.steps <= cvm_config.max_steps) &&
+            (!cvm_config.max_depth || result.depth_max <= cvm_config.max_depth) &&
+            (!cvm_config.max_memory || result.memory_max <= cvm_config.max_memory) &&
+            (cvm_config.max_time <= 0 || result.time <= cvm_config.max_time)) {
+            fwrite(result.output, 1, result.output_len, os);
+            fwrite(result.message, 1, result.message_len, stdout);
+            cvm_stats = (CVM_Stats) {.steps = result.steps, .depth_max = result.depth_max,
+                                     .memory_max = result.memory_max, .time = result.time};
+            if (result.status == 0 && show_stats) print_stats();
+            int status = result.status;
+            cache_result_free(&result);
+            da_free(&input);
+            return status;
+        }
+        cache_result_free(&result);
+    }
+
+    // a miss: the input is replayed from a file, which --pipelined-io can read
+    FILE * run_is = tmpfile();
+    FILE * run_os = tmpfile();
+    if (!run_is || !run_os || fwrite(input.items, 1, input.count, run_is) != input.count ||
+        fseek(run_is, 0, SEEK_SET)) {
+        printf("ERROR: Cannot open temporary files.\n");
+        if (run_is) fclose(run_is);
+        if (run_os) fclose(run_os);
+        da_free(&input);
         return 1;
     }
-    
-    // tokenize
-    Tokenizer tok = {};
-    status = Tokenizer_read_file(&tok, argv[1]);
+    da_free(&input);
+    int ret_val = -1;
+    result.status = cvm_run(&ret_val, ast, run_is, run_os);
+    fclose(run_is);
+    fflush(run_os);
+    long len = ftell(run_os);
+    result.output = (char *)malloc(len > 0 ? len : 1);
+    rewind(run_os);
+    result.output_len = len > 0 ? fread(result.output, 1, len, run_os) : 0;
+    fclose(run_os);
+    FILE * message = open_memstream(&result.message, &result.message_len);
+    if (message) {
+        print_result(message, result.status, ret_val, units);
+        fclose(message);
+    }
+    fwrite(result.output, 1, result.output_len, os);
+    print_result(stdout, result.status, ret_val, units);
+    if (result.status == CVM_STATUS_LIMIT || (result.status == 0 && show_stats)) print_stats();
+    // an aborted run depends on the limits, not only on the key
+    if (result.status != CVM_STATUS_LIMIT && message) {
+        result.steps = cvm_stats.steps;
+        result.depth_max = cvm_stats.depth_max;
+        result.memory_max = cvm_stats.memory_max;
+        result.time = cvm_stats.time;
+        cache_store_result(&result, key, dir); // a failed store is not an error
+    }
+    int status = result.status;
+    cache_result_free(&result);
+    return status;
+}
+
+// for `sample_write`: the line of `p`, and the path of its unit if a `--lib`
+static Units * sampled_units = NULL;
+static size_t sample_where(const char * p, const char ** lib) {
+    Unit * unit = link_unit_of(sampled_units, p);
+    if (!unit) return 0;
+    if (unit != sampled_units->items + sampled_units->count - 1) *lib = unit->path;
+    return Tokenizer_line_of(&unit->tok, p);
+}
+
+// tokenize and parse one source file, or load it from the cache
+// @return 0, or the status of the failed stage, whose error is printed
+int compile_unit(Unit * unit, int name_file, const char * cache_dir, int lazy_parse, int n_jobs) {
+    int status = Tokenizer_read_file(&unit->tok, unit->path);
     if (status) return status;
-    
-    status = Tokenizer_tokenize(&tok);
+    if (cache_dir && !cache_load(&unit->ast, &unit->tok, cache_dir, lazy_parse)) return 0;
+
+    status = Tokenizer_tokenize(&unit->tok);
     if (status) {
-        printf("Tokenizer error: %s\nAt: ", tok.errmsg);
-        Tokenizer_print_around(&tok, tok.errind, 5);
+        if (name_file) printf("In %s:\n", unit->path);
+        printf("Tokenizer error: %s\nAt: ", unit->tok.errmsg);
+        Tokenizer_print_around(&unit->tok, unit->tok.errind, 5);
         return status;
     }
-    //print_tokens(&tok);
-    
+    //print_tokens(&unit->tok);
+
     // ast
-    AST_Node ast = {};
-    status = ast_build(&ast, &tok);
+    // the lazy top level is mostly brace matching, not worth threads
+    if (lazy_parse) status = ast_build_lazy(&unit->ast, &unit->tok);
+    else status = ast_build_parallel(&unit->ast, &unit->tok, n_jobs);
     /*
     printf("Generated AST:\n");
     ast_print_node(ast, 0);
     */
     if (status) {
+        if (name_file) printf("In %s:\n", unit->path);
         printf("AST Builder Error: %s\n", ast_builder_errmsg);
         // currently, all error messages will be overwritten by "Invalid top level code"
         // error system TBD
         return status;
     }
+    if (cache_dir) cache_store(&unit->ast, &unit->tok, cache_dir, lazy_parse); // a miss is not an error
+    return 0;
+}
+
+int main(int argc, char ** argv) {
+    int status = 0;
+
+    // options can appear anywhere, everything else is positional
+    const char * cache_dir = NULL;
+    const char * result_dir = NULL;
+    Units units = {}; // `--lib`s, then the main source
+    int n_jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int show_stats = 0;
+    int repl = 0;
+    int lazy_parse = 0;
+    int parallel_calls = 0;
+    int diff = 0;
+    int ir_dump = 0;
+    Server_Config server = {.cache_capacity = 64};
+    const char * client_socket = NULL;
+    int interactive = 0;
+    const char * spmd_list = NULL;
+    const char * trace_path = NULL;
+    int trace_loops = 0;
+    size_t trace_events = 65536;
+    const char * profile_out = NULL;
+    const char * profile_in = NULL;
+    const char * sample_path = NULL;
+    long sample_interval = 10000; // us, 100 Hz
+    char * args[3] = {};
+    int n_args = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--repl") == 0) {
+            repl = 1;
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            server.socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--server-cache") == 0 && i + 1 < argc) {
+            server.cache_capacity = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--sessions") == 0) {
+            server.sessions = 1;
+        } else if (strcmp(argv[i], "--client") == 0 && i + 1 < argc) {
+            client_socket = argv[++i];
+        } else if (strcmp(argv[i], "--interactive") == 0) {
+            interactive = 1;
+        } else if (strcmp(argv[i], "--spmd") == 0 && i + 1 < argc) {
+            spmd_list = argv[++i];
+        } else if (strcmp(argv[i], "--lib") == 0 && i + 1 < argc) {
+            da_append(&units, ((Unit) {.path = argv[++i]}));
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--result-cache") == 0 && i + 1 < argc) {
+            result_dir = argv[++i];
+        } else if (strcmp(argv[i], "--diff") == 0) {
+            diff = 1;
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            n_jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--lazy-parse") == 0) {
+            lazy_parse = 1;
+        } else if (strcmp(argv[i], "--eager-logic") == 0) {
+            cvm_config.eager_logic = 1;
+        } else if (strcmp(argv[i], "--checked") == 0) {
+            cvm_config.checked = 1;
+        } else if (strcmp(argv[i], "-O0") == 0 || strcmp(argv[i], "-O1") == 0 ||
+                   strcmp(argv[i], "-O2") == 0) {
+            cvm_config.opt_level = argv[i][2] - '0';
+        } else if (strcmp(argv[i], "--ir") == 0) {
+            cvm_config.ir = 1;
+        } else if (strcmp(argv[i], "--ir-passes") == 0 && i + 1 < argc) {
+            cvm_config.ir_passes = argv[++i];
+        } else if (strcmp(argv[i], "--ir-dump") == 0) {
+            ir_dump = 1;
+        } else if (strcmp(argv[i], "--parallel-calls") == 0) {
+            parallel_calls = 1;
+        } else if (strcmp(argv[i], "--pipelined-io") == 0) {
+            cvm_config.pipelined_io = 1;
+        } else if (strcmp(argv[i], "--huge-pages") == 0) {
+            cvm_config.huge_pages = 1;
+        } else if (strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc) {
+            cvm_config.max_steps = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--max-depth") == 0 && i + 1 < argc) {
+            cvm_config.max_depth = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--max-memory") == 0 && i + 1 < argc) {
+            cvm_config.max_memory = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--max-time") == 0 && i + 1 < argc) {
+            cvm_config.max_time = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            show_stats = 1;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--trace-loops") == 0) {
+            trace_loops = 1;
+        } else if (strcmp(argv[i], "--trace-events") == 0 && i + 1 < argc) {
+            trace_events = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--profile-out") == 0 && i + 1 < argc) {
+            profile_out = argv[++i];
+        } else if (strcmp(argv[i], "--profile-in") == 0 && i + 1 < argc) {
+            profile_in = argv[++i];
+        } else if (strcmp(argv[i], "--sample-profile") == 0 && i + 1 < argc) {
+            sample_path = argv[++i];
+        } else if (strcmp(argv[i], "--sample-interval") == 0 && i + 1 < argc) {
+            sample_interval = atol(argv[++i]);
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            printf("ERROR: Unknown option %s.\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        } else if (n_args < 3) {
+            args[n_args++] = argv[i];
+        }
+    }
+    
+    if (parallel_calls) cvm_config.parallel_calls = n_jobs;
+
+    if (server.socket_path) {
+        server.n_workers = n_jobs;
+        server.cache_dir = cache_dir;
+        return server_run(&server);
+    }
+
+    if (repl) {
+        // `cin` shares stdin with the entries unless an input file is given
+        FILE * is, * os;
+        if (open_streams(args, n_args, &is, &os)) return 1;
+        status = repl_run(n_args ? args[0] : NULL, is, os);
+        if (is != stdin) fclose(is);
+        if (os != stdout) fclose(os);
+        return status;
+    }
+
+    if (n_args == 0) {
+        printf("ERROR: No input file provided.\n");
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (client_socket) {
+        FILE * is, * os;
+        if (open_streams(args, n_args, &is, &os)) return 1;
+        status = client_run(client_socket, args[0], is, os, interactive);
+        if (is != stdin) fclose(is);
+        if (os != stdout) fclose(os);
+        return status;
+    }
+    
+    // profiles and loop events are offsets into one source
+    if (units.count && (profile_out || profile_in || trace_loops)) {
+        printf("ERROR: --profile-out, --profile-in and --trace-loops take a single source file.\n");
+        return 1;
+    }
+
+    // compile each unit, then link
+    da_append(&units, ((Unit) {.path = args[0]}));
+    for (size_t i = 0; i < units.count; ++i) {
+        status = compile_unit(units.items + i, units.count > 1, cache_dir, lazy_parse, n_jobs);
+        if (status) return status;
+    }
+    Tokenizer * tok = &units.items[units.count - 1].tok;
+    AST_Node ast = {};
+    if (link_units(&ast, &units)) {
+        printf("Link error: %s\n", link_errmsg);
+        return 1;
+    }
     
     
     // vm
 
+    if (spmd_list) {
+        status = spmd_run_files(&ast, spmd_list);
+        link_free(&ast, &units);
+        return status;
+    }
+
+    if (ir_dump) {
+        IR_Program prog;
+        if ((status = ir_lower(&prog, &ast))) printf("Not lowered to the IR: %s\n", ir_errmsg);
+        else if ((status = ir_verify(&prog) || ir_optimize(&prog, cvm_config.ir_passes))) printf("IR error: %s\n", ir_errmsg);
+        else ir_print(&prog, stdout);
+        ir_free(&prog);
+        link_free(&ast, &units);
+        return status;
+    }
+
     // open files
-    FILE * is = stdin;
-    FILE * os = stdout;
-    if (argc >= 3) {
-        is = fopen(argv[2], "r");
-        if (!is) {
-            printf("ERROR: Open input file %s failed.\n", argv[2]);
-            return 1;
-        }
+    FILE * is, * os;
+    if (open_streams(args, n_args, &is, &os)) return 1;
+
+    if (diff) {
+        // both runs read the same input, so it is read ahead
+        struct {
+            char * items;
+            size_t count;
+            size_t capacity;
+        } input = {};
+        for (int c; (c = fgetc(is)) != EOF; ) da_append(&input, (char)c);
+        status = diff_run(&ast, input.items, input.count, os);
+        da_free(&input);
+        link_free(&ast, &units);
+        if (is != stdin) fclose(is);
+        if (os != stdout) fclose(os);
+        return status;
+    }
+    
+    if (trace_path && trace_open(trace_events, trace_loops, tok->buffer)) {
+        printf("ERROR: Cannot allocate %zu trace events.\n", trace_events);
+        return 1;
     }
-    if (argc >= 4) {
-        os = fopen(argv[3], "w");
-        if (!os) {
-            printf("ERROR: Open output file %s failed.\n", argv[3]);
+    if (profile_out || profile_in) {
+        profile_open(tok->buffer, profile_out != NULL);
+        // with both, the counts of this run are added to the loaded ones
+        if (profile_in && profile_read(profile_in)) {
+            printf("ERROR: Read profile %s failed, or it is for another source.\n", profile_in);
             return 1;
         }
     }
-    
+    if (sample_path && sample_start(sample_interval)) {
+        printf("ERROR: Cannot start the sampling profiler.\n");
+        return 1;
+    }
+    // traces and profiles record a run, a replay has nothing to show them
+    if (result_dir && !trace_path && !profile_out && !sample_path) {
+        status = run_with_result_cache(&ast, &units, result_dir, lazy_parse, is, os, show_stats);
+        profile_close();
+        link_free(&ast, &units);
+        if (is != stdin) fclose(is);
+        if (os != stdout) fclose(os);
+        return status;
+    }
     int ret_val = -1;
     status = cvm_run(&ret_val, &ast, is, os);
-    if (status) {
-        printf("CVM exited abnormally. Syntax error in source file.\n");
-        return status;
+    if (sample_path) {
+        // a profile of a failed run is still a profile
+        sample_stop();
+        sampled_units = &units;
+        if (sample_write(sample_path, sample_where)) printf("ERROR: Write sample profile %s failed.\n", sample_path);
+        sample_close();
+    }
+    if (trace_path) {
+        // also, and most of all, when the run failed
+        if (trace_write(trace_path)) printf("ERROR: Write trace file %s failed.\n", trace_path);
+        trace_close();
     }
-    printf("CVM exited successfully with return value %d\n", ret_val);
+    if (profile_out && profile_write(profile_out)) {
+        printf("ERROR: Write profile %s failed.\n", profile_out);
+    }
+    profile_close();
+    print_result(stdout, status, ret_val, &units);
+    if (status == CVM_STATUS_LIMIT || (status == 0 && show_stats)) print_stats();
+    if (status) return status;
     
     // cleanup
-    Tokenizer_free(&tok);
-    ast_free_node(&ast);
+    link_free(&ast, &units);
     if (is && is != stdin) fclose(is);
     if (os && os != stdout) fclose(os);
     
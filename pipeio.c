@@ -0,0 +1,274 @@
+#include <stdio.h> // file
+#include <stddef.h> // size_t
+#include <stdlib.h> // memory
+#include <limits.h> // LONG_MAX
+#include <ctype.h> // isspace, isdigit
+#include <pthread.h>
+#include <sched.h> // sched_yield
+#include <stdatomic.h>
+#include <unistd.h> // read
+
+#include "pipeio.h"
+
+#define PIPEIO_INTS (1 << 16) // values parsed ahead
+#define PIPEIO_CHUNK (1 << 16) // bytes per read() and per output block
+#define PIPEIO_BLOCKS 8 // output blocks in flight
+#define PIPEIO_INT_LEN 12 // "-2147483648"
+#define PIPEIO_SPINS 64 // yields on a full or empty ring before sleeping
+
+// a side that waits on the other spins for a while, then sleeps until the
+// other side moves an index, so that waiting on a slow pipe takes no core
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    atomic_int sleepers;
+} Pipeio_Wait;
+
+// the indices only grow, slot = index % capacity
+// producer and consumer each own one index, the other side only reads it
+static struct {
+    int fd;
+    pthread_t thread;
+    int values[PIPEIO_INTS];
+    atomic_size_t head; // next value to consume, owned by the interpreter
+    atomic_size_t tail; // next value to produce, owned by the reader
+    atomic_int done; // no value will come after `tail`
+    Pipeio_Wait wait; // either side, the ring cannot be full and empty at once
+} reader = {.wait = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER}};
+
+static struct {
+    FILE * os;
+    pthread_t thread;
+    char * blocks[PIPEIO_BLOCKS];
+    size_t lens[PIPEIO_BLOCKS];
+    atomic_size_t head; // next block to write, owned by the writer
+    atomic_size_t tail; // block being filled, owned by the interpreter
+    atomic_int done; // no block will come after `tail`
+    size_t len; // of the block being filled
+    Pipeio_Wait wait;
+} writer = {.wait = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER}};
+
+// waiting
+
+static void pipeio_unlock(void * arg) {
+    Pipeio_Wait * wait = (Pipeio_Wait *)arg;
+    atomic_fetch_sub(&wait->sleepers, 1);
+    pthread_mutex_unlock(&wait->lock);
+}
+
+// yield first, then sleep until `ready()`, checked again once the sleeper
+// is counted: a `pipeio_wake` after that sees it
+static void pipeio_backoff(Pipeio_Wait * wait, int * fails, int (*ready)()) {
+    if (++*fails < PIPEIO_SPINS) {
+        sched_yield();
+        return;
+    }
+    pthread_mutex_lock(&wait->lock);
+    atomic_fetch_add(&wait->sleepers, 1);
+    atomic_thread_fence(memory_order_seq_cst); // the count before the indices
+    // the reader is cancelled in its wait, which leaves with the lock held
+    pthread_cleanup_push(pipeio_unlock, wait);
+    while (!ready()) pthread_cond_wait(&wait->cond, &wait->lock);
+    pthread_cleanup_pop(1);
+}
+
+// after an index or `done` moved
+static void pipeio_wake(Pipeio_Wait * wait) {
+    atomic_thread_fence(memory_order_seq_cst); // the index before the count
+    if (!atomic_load_explicit(&wait->sleepers, memory_order_relaxed)) return;
+    pthread_mutex_lock(&wait->lock);
+    pthread_cond_broadcast(&wait->cond);
+    pthread_mutex_unlock(&wait->lock);
+}
+
+static int pipeio_reader_room() {
+    return atomic_load(&reader.tail) - atomic_load(&reader.head) != PIPEIO_INTS;
+}
+
+static int pipeio_reader_ready() {
+    return atomic_load(&reader.head) != atomic_load(&reader.tail) || atomic_load(&reader.done);
+}
+
+static int pipeio_writer_room() {
+    return atomic_load(&writer.tail) - atomic_load(&writer.head) != PIPEIO_BLOCKS;
+}
+
+static int pipeio_writer_ready() {
+    return atomic_load(&writer.head) != atomic_load(&writer.tail) || atomic_load(&writer.done);
+}
+
+// reader
+
+typedef struct {
+    char buffer[PIPEIO_CHUNK];
+    size_t len;
+    size_t pos;
+} Pipeio_Input;
+
+static int pipeio_getc(Pipeio_Input * in) {
+    if (in->pos == in->len) {
+        ssize_t len = read(reader.fd, in->buffer, sizeof(in->buffer));
+        if (len <= 0) return EOF;
+        in->len = len;
+        in->pos = 0;
+    }
+    return (unsigned char)in->buffer[in->pos++];
+}
+
+// the integer syntax of `%d`: strtol saturates to `long`, then the value is truncated to int
+// @return 1 at end of input or if no integer follows
+static int pipeio_parse_int(Pipeio_Input * in, int * value) {
+    int c = pipeio_getc(in);
+    while (c != EOF && isspace(c)) c = pipeio_getc(in);
+    int negative = c == '-';
+    if (c == '-' || c == '+') c = pipeio_getc(in);
+    if (c == EOF || !isdigit(c)) return 1;
+    unsigned long magnitude = 0;
+    unsigned long limit = negative ? (unsigned long)LONG_MAX + 1 : LONG_MAX;
+    for (; c != EOF && isdigit(c); c = pipeio_getc(in)) {
+        unsigned long digit = c - '0';
+        magnitude = magnitude > (limit - digit) / 10 ? limit : magnitude * 10 + digit;
+    }
+    if (c != EOF) in->pos -= 1; // not part of the number, read it again
+    long res = negative ? (long)(0 - magnitude) : (long)magnitude;
+    *value = (int)res;
+    return 0;
+}
+
+static void * pipeio_reader(void * arg) {
+    Pipeio_Input * in = (Pipeio_Input *)malloc(sizeof(Pipeio_Input));
+    in->len = in->pos = 0;
+    pthread_cleanup_push(free, in);
+    size_t tail = atomic_load_explicit(&reader.tail, memory_order_relaxed);
+    int value;
+    while (!pipeio_parse_int(in, &value)) {
+        int fails = 0;
+        while (tail - atomic_load_explicit(&reader.head, memory_order_acquire) == PIPEIO_INTS) {
+            pthread_testcancel();
+            pipeio_backoff(&reader.wait, &fails, pipeio_reader_room); // full
+        }
+        reader.values[tail % PIPEIO_INTS] = value;
+        atomic_store_explicit(&reader.tail, ++tail, memory_order_release);
+        pipeio_wake(&reader.wait);
+    }
+    atomic_store_explicit(&reader.done, 1, memory_order_release);
+    pipeio_wake(&reader.wait);
+    pthread_cleanup_pop(1);
+    return NULL;
+}
+
+int pipeio_read_int(int * value) {
+    size_t head = atomic_load_explicit(&reader.head, memory_order_relaxed);
+    int fails = 0;
+    while (head == atomic_load_explicit(&reader.tail, memory_order_acquire)) {
+        // `tail` is final once `done` is set, look at it once more
+        if (atomic_load_explicit(&reader.done, memory_order_acquire) &&
+            head == atomic_load_explicit(&reader.tail, memory_order_acquire)) return 1;
+        pipeio_backoff(&reader.wait, &fails, pipeio_reader_ready); // empty
+    }
+    *value = reader.values[head % PIPEIO_INTS];
+    atomic_store_explicit(&reader.head, head + 1, memory_order_release);
+    pipeio_wake(&reader.wait);
+    return 0;
+}
+
+// writer
+
+static void * pipeio_writer(void * arg) {
+    size_t head = atomic_load_explicit(&writer.head, memory_order_relaxed);
+    int fails = 0;
+    while (1) {
+        if (head == atomic_load_explicit(&writer.tail, memory_order_acquire)) {
+            if (atomic_load_explicit(&writer.done, memory_order_acquire) &&
+                head == atomic_load_explicit(&writer.tail, memory_order_acquire)) break;
+            pipeio_backoff(&writer.wait, &fails, pipeio_writer_ready); // nothing handed over
+            continue;
+        }
+        fails = 0;
+        size_t slot = head % PIPEIO_BLOCKS;
+        fwrite(writer.blocks[slot], 1, writer.lens[slot], writer.os);
+        atomic_store_explicit(&writer.head, ++head, memory_order_release);
+        pipeio_wake(&writer.wait);
+    }
+    fflush(writer.os);
+    return NULL;
+}
+
+// hand the block being filled over to the writer, then wait for a free one
+static void pipeio_hand_over() {
+    size_t tail = atomic_load_explicit(&writer.tail, memory_order_relaxed);
+    writer.lens[tail % PIPEIO_BLOCKS] = writer.len;
+    atomic_store_explicit(&writer.tail, ++tail, memory_order_release);
+    pipeio_wake(&writer.wait);
+    writer.len = 0;
+    int fails = 0;
+    while (tail - atomic_load_explicit(&writer.head, memory_order_acquire) == PIPEIO_BLOCKS) {
+        pipeio_backoff(&writer.wait, &fails, pipeio_writer_room); // all blocks in flight
+    }
+}
+
+static char * pipeio_reserve(size_t len) {
+    if (writer.len + len > PIPEIO_CHUNK) pipeio_hand_over();
+    size_t tail = atomic_load_explicit(&writer.tail, memory_order_relaxed);
+    return writer.blocks[tail % PIPEIO_BLOCKS] + writer.len;
+}
+
+void pipeio_write_int(int value) {
+    char * p = pipeio_reserve(PIPEIO_INT_LEN);
+    // digits backwards, the magnitude as unsigned for INT_MIN
+    char digits[PIPEIO_INT_LEN];
+    size_t n = 0;
+    unsigned magnitude = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+    do {
+        digits[n++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude);
+    size_t len = 0;
+    if (value < 0) p[len++] = '-';
+    while (n) p[len++] = digits[--n];
+    writer.len += len;
+}
+
+void pipeio_write_endl() {
+    *pipeio_reserve(1) = '\n';
+    writer.len += 1;
+}
+
+int pipeio_start(FILE * is, FILE * os) {
+    reader.fd = fileno(is);
+    atomic_store(&reader.head, 0);
+    atomic_store(&reader.tail, 0);
+    atomic_store(&reader.done, 0);
+    writer.os = os;
+    writer.len = 0;
+    atomic_store(&writer.head, 0);
+    atomic_store(&writer.tail, 0);
+    atomic_store(&writer.done, 0);
+    for (size_t i = 0; i < PIPEIO_BLOCKS; ++i) {
+        writer.blocks[i] = (char *)malloc(PIPEIO_CHUNK);
+    }
+    fflush(os); // anything written before goes first
+    if (pthread_create(&reader.thread, NULL, pipeio_reader, NULL)) goto fail;
+    if (pthread_create(&writer.thread, NULL, pipeio_writer, NULL)) {
+        pthread_cancel(reader.thread);
+        pthread_join(reader.thread, NULL);
+        goto fail;
+    }
+    return 0;
+
+fail:
+    for (size_t i = 0; i < PIPEIO_BLOCKS; ++i) free(writer.blocks[i]);
+    return 1;
+}
+
+void pipeio_stop() {
+    // the reader may be blocked on input nobody will ask for
+    pthread_cancel(reader.thread);
+    pthread_join(reader.thread, NULL);
+
+    if (writer.len) pipeio_hand_over();
+    atomic_store_explicit(&writer.done, 1, memory_order_release);
+    pipeio_wake(&writer.wait);
+    pthread_join(writer.thread, NULL);
+    for (size_t i = 0; i < PIPEIO_BLOCKS; ++i) free(writer.blocks[i]);
+}
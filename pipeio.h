@@ -0,0 +1,32 @@
+#ifndef PIPEIO_H_
+#define PIPEIO_H_
+
+#include <stdio.h> // FILE
+
+/*
+  @def Pipelined I/O
+
+  `cin` and `cout` through two threads, overlapping I/O with execution.
+  A reader thread parses the integers of the input ahead of time into a
+  single-producer/single-consumer ring; `cout` formats into fixed size
+  blocks that a writer thread writes out in order. Both rings are lock
+  free: the interpreter and the I/O threads only share atomic indices. A
+  side that finds its ring full or empty yields for a while, then sleeps
+  on a condition variable until the other side moves an index.
+
+  Output is only written when a block is full or at `pipeio_stop`, so
+  this is not for programs that talk to an interactive peer.
+*/
+
+// `is` is read through its file descriptor from the current offset
+// return 1 on fail, in which case nothing was started
+int pipeio_start(FILE * is, FILE * os);
+// like `fscanf(is, "%d", value) == 1`, `value` is left unchanged on fail
+// @return 0 if read, 1 at end of input or at anything but an integer
+int pipeio_read_int(int * value);
+void pipeio_write_int(int value);
+void pipeio_write_endl();
+// flushes the output and joins both threads
+void pipeio_stop();
+
+#endif // PIPEIO_H_
@@ -0,0 +1,167 @@
+#include <stddef.h> // size_t
+#include <stdlib.h> // memory
+#include <pthread.h>
+#include <sched.h> // sched_yield
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h> // nanosleep
+
+#include "pool.h"
+
+#define POOL_SPINS 64 // failed steals before an idle worker starts sleeping
+
+// indices only grow, slot = index % POOL_DEQUE
+// the owner works at `bottom`, thieves at `top`
+typedef struct {
+    pthread_mutex_t lock;
+    Pool_Task * items[POOL_DEQUE];
+    size_t top;
+    size_t bottom;
+} Pool_Deque;
+
+static struct {
+    int n_workers; // deques, fixed while the pool runs
+    int n_started; // threads, worker 0 included
+    Pool_Deque * deques;
+    pthread_t * threads;
+    void (*init)(void *);
+    void (*fini)(void *);
+    void * arg;
+    atomic_int stopping;
+} pool = {};
+static atomic_int pool_running = 0;
+
+static _Thread_local int pool_self = -1; // worker index, -1 outside of the pool
+static _Thread_local uint32_t pool_seed = 0; // victim choice, xorshift
+
+static Pool_Task * pool_steal() {
+    pool_seed ^= pool_seed << 13;
+    pool_seed ^= pool_seed >> 17;
+    pool_seed ^= pool_seed << 5;
+    for (int i = 0; i < pool.n_workers; ++i) {
+        int victim = (pool_seed + i) % pool.n_workers;
+        if (victim == pool_self) continue;
+        Pool_Deque * d = pool.deques + victim;
+        Pool_Task * task = NULL;
+        pthread_mutex_lock(&d->lock);
+        if (d->top < d->bottom) task = d->items[d->top++ % POOL_DEQUE];
+        pthread_mutex_unlock(&d->lock);
+        if (task) return task;
+    }
+    return NULL;
+}
+
+static void pool_execute(Pool_Task * task) {
+    task->run(task);
+    atomic_store_explicit(&task->done, 1, memory_order_release);
+}
+
+// idle: yield first, then sleep, so that idle workers do not take the CPU
+// from busy ones when there are fewer cores than workers
+static void pool_backoff(int * fails) {
+    if (++*fails < POOL_SPINS) {
+        sched_yield();
+    } else {
+        struct timespec ts = {0, 50000};
+        nanosleep(&ts, NULL);
+    }
+}
+
+static void * pool_worker(void * arg) {
+    pool_self = (int)(intptr_t)arg;
+    pool_seed = 2654435761u * (pool_self + 1);
+    if (pool.init) pool.init(pool.arg);
+    int fails = 0;
+    while (!atomic_load(&pool.stopping)) {
+        Pool_Task * task = pool_steal();
+        if (task) {
+            pool_execute(task);
+            fails = 0;
+        } else {
+            pool_backoff(&fails);
+        }
+    }
+    if (pool.fini) pool.fini(pool.arg);
+    return NULL;
+}
+
+int pool_start(int n_threads, void (*init)(void *), void (*fini)(void *), void * arg) {
+    if (n_threads < 2 || atomic_exchange(&pool_running, 1)) return 1;
+    pool.n_workers = n_threads;
+    pool.deques = (Pool_Deque *)calloc(n_threads, sizeof(Pool_Deque));
+    pool.threads = (pthread_t *)malloc(n_threads * sizeof(pthread_t));
+    pool.init = init;
+    pool.fini = fini;
+    pool.arg = arg;
+    atomic_store(&pool.stopping, 0);
+    for (int i = 0; i < n_threads; ++i) pthread_mutex_init(&pool.deques[i].lock, NULL);
+    pool_self = 0;
+    pool_seed = 2654435761u;
+    int n_started = 1;
+    for (; n_started < n_threads; ++n_started) {
+        if (pthread_create(pool.threads + n_started, NULL, pool_worker, (void *)(intptr_t)n_started)) break;
+    }
+    pool.n_started = n_started; // the deques of the others stay empty
+    if (n_started == 1) {
+        pool_stop();
+        return 1;
+    }
+    return 0;
+}
+
+int pool_should_fork() {
+    if (pool_self < 0) return 0;
+    Pool_Deque * d = pool.deques + pool_self;
+    pthread_mutex_lock(&d->lock);
+    int pending = (int)(d->bottom - d->top);
+    pthread_mutex_unlock(&d->lock);
+    return pending < POOL_SLACK;
+}
+
+int pool_fork(Pool_Task * task) {
+    Pool_Deque * d = pool.deques + pool_self;
+    atomic_init(&task->done, 0);
+    pthread_mutex_lock(&d->lock);
+    int full = d->bottom - d->top >= POOL_DEQUE;
+    if (!full) d->items[d->bottom++ % POOL_DEQUE] = task;
+    pthread_mutex_unlock(&d->lock);
+    return full;
+}
+
+void pool_join(Pool_Task * task) {
+    Pool_Deque * d = pool.deques + pool_self;
+    pthread_mutex_lock(&d->lock);
+    // joins are in reverse order of forks: the task is at the bottom, or stolen
+    int mine = d->top < d->bottom && d->items[(d->bottom - 1) % POOL_DEQUE] == task;
+    if (mine) d->bottom -= 1;
+    pthread_mutex_unlock(&d->lock);
+    if (mine) {
+        task->run(task);
+        return;
+    }
+    // help while the thief runs it
+    int fails = 0;
+    while (!atomic_load_explicit(&task->done, memory_order_acquire)) {
+        Pool_Task * other = pool_steal();
+        if (other) {
+            pool_execute(other);
+            fails = 0;
+        } else {
+            pool_backoff(&fails);
+        }
+    }
+}
+
+void pool_stop() {
+    atomic_store(&pool.stopping, 1);
+    for (int i = 1; i < pool.n_started; ++i) pthread_join(pool.threads[i], NULL);
+    for (int i = 0; i < pool.n_workers; ++i) pthread_mutex_destroy(&pool.deques[i].lock);
+    free(pool.deques);
+    free(pool.threads);
+    pool.deques = NULL;
+    pool.threads = NULL;
+    pool.n_workers = 0;
+    pool.n_started = 0;
+    pool_self = -1;
+    atomic_store(&pool_running, 0);
+}
@@ -0,0 +1,40 @@
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <stdatomic.h>
+
+/*
+  @def Work-stealing pool
+
+  Fork-join tasks on a fixed set of threads. Each worker owns a deque of
+  the tasks it forked: it pushes and pops them at the bottom, while idle
+  workers steal from the top, where the oldest and so usually largest
+  tasks are. The thread that calls `pool_start` is worker 0; other
+  threads cannot fork.
+
+  A task must be joined by the worker that forked it, in the reverse
+  order of the forks. Joining a task that was not stolen runs it in
+  place; joining a stolen one runs other tasks until it is done.
+*/
+
+#define POOL_DEQUE 256 // forked tasks pending per worker
+#define POOL_SLACK 4 // `pool_should_fork` while fewer tasks are pending
+
+typedef struct Pool_Task {
+    void (*run)(struct Pool_Task * task);
+    atomic_int done; // set once run by a thief
+} Pool_Task;
+
+// `init` and `fini` run on each new thread, around its work, with `arg`
+// return 1 if a pool is already running or no thread could be started
+int pool_start(int n_threads, void (*init)(void *), void (*fini)(void *), void * arg);
+// the granularity cutoff: whether the calling thread is a worker whose
+// pending tasks are few enough that a new one may keep a thief busy
+int pool_should_fork();
+// return 1 if the deque is full: the task was not forked, run it in place
+int pool_fork(Pool_Task * task);
+void pool_join(Pool_Task * task);
+// joins the threads, every forked task must have been joined
+void pool_stop();
+
+#endif // POOL_H_
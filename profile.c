@@ -0,0 +1,113 @@
+#include <stdio.h> // file
+#include <stddef.h> // size_t
+#include <stdint.h>
+#include <stdlib.h> // qsort
+#include <string.h> // strlen, strcmp
+
+#include "profile.h"
+#include "dynarray.h"
+#include "cache.h" // cache_hash
+
+Profile profile = {};
+static int sorted = 1; // `profile.items` is sorted and has no duplicate
+
+static int profile_compare(const void * l_, const void * r_) {
+    const Profile_Entry * l = (const Profile_Entry *)l_;
+    const Profile_Entry * r = (const Profile_Entry *)r_;
+    if (l->offset != r->offset) return l->offset < r->offset ? -1 : 1;
+    if (l->type != r->type) return l->type < r->type ? -1 : 1;
+    return 0;
+}
+
+// by offset, the counts of duplicates are added up
+static void profile_sort() {
+    if (sorted) return;
+    qsort(profile.items, profile.count, sizeof(Profile_Entry), profile_compare);
+    size_t n = 0;
+    for (size_t i = 0; i < profile.count; ++i) {
+        Profile_Entry * last = n ? profile.items + n - 1 : NULL;
+        if (last && profile_compare(last, profile.items + i) == 0) {
+            last->counts[0] += profile.items[i].counts[0];
+            last->counts[1] += profile.items[i].counts[1];
+        } else {
+            profile.items[n++] = profile.items[i];
+        }
+    }
+    profile.count = n;
+    sorted = 1;
+}
+
+void profile_open(const char * source, int recording) {
+    profile.source = source;
+    profile.recording = recording;
+}
+
+static uint32_t profile_type(const char * name) {
+    return (uint32_t)name[0] << 24 | (uint32_t)name[1] << 16 | (uint32_t)name[2] << 8 | (uint32_t)name[3];
+}
+
+int profile_read(const char * path) {
+    FILE * fp = fopen(path, "r");
+    if (!fp) return 1;
+    char magic[5];
+    unsigned version;
+    unsigned long long hash;
+    if (fscanf(fp, "%4s %u %llx", magic, &version, &hash) != 3 ||
+        strcmp(magic, PROFILE_MAGIC) || version != PROFILE_VERSION ||
+        hash != cache_hash(profile.source, strlen(profile.source))) {
+        fclose(fp);
+        return 1;
+    }
+    char type[5];
+    size_t line, offset;
+    unsigned long long counts[2];
+    while (fscanf(fp, "%4s %zu %zu %llu %llu", type, &line, &offset, counts, counts + 1) == 5) {
+        if (strlen(type) != 4) break;
+        da_append(&profile, ((Profile_Entry) {profile_type(type), offset, {counts[0], counts[1]}}));
+    }
+    int failed = !feof(fp);
+    fclose(fp);
+    sorted = 0;
+    profile_sort();
+    profile.loaded = !failed;
+    return failed;
+}
+
+int profile_write(const char * path) {
+    profile_sort();
+    FILE * fp = fopen(path, "w");
+    if (!fp) return 1;
+    const char * source = profile.source;
+    fprintf(fp, "%s %d %016llx\n", PROFILE_MAGIC, PROFILE_VERSION,
+            (unsigned long long)cache_hash(source, strlen(source)));
+    // entries are sorted by offset, lines are counted in one pass
+    size_t line = 1, pos = 0;
+    for (size_t i = 0; i < profile.count; ++i) {
+        Profile_Entry * e = profile.items + i;
+        for (; pos < e->offset && source[pos]; ++pos) {
+            if (source[pos] == '\n') line += 1;
+        }
+        fprintf(fp, "%c%c%c%c %zu %zu %llu %llu\n",
+                (char)(e->type >> 24), (char)(e->type >> 16), (char)(e->type >> 8), (char)e->type,
+                line, e->offset, (unsigned long long)e->counts[0], (unsigned long long)e->counts[1]);
+    }
+    return fclose(fp) != 0;
+}
+
+Profile_Entry * profile_find(uint32_t type, size_t offset) {
+    profile_sort();
+    Profile_Entry key = {type, offset};
+    return (Profile_Entry *)bsearch(&key, profile.items, profile.count,
+                                    sizeof(Profile_Entry), profile_compare);
+}
+
+void profile_add(uint32_t type, size_t offset, const uint64_t counts[2]) {
+    da_append(&profile, ((Profile_Entry) {type, offset, {counts[0], counts[1]}}));
+    sorted = 0;
+}
+
+void profile_close() {
+    da_free(&profile);
+    profile = (Profile) {};
+    sorted = 1;
+}
@@ -0,0 +1,57 @@
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stddef.h> // size_t
+#include <stdint.h>
+
+/*
+  @def Execution profile
+
+  `--profile-out` counts, for each node of interest, what it did during
+  the run; `--profile-in` gives the counts of an earlier run of the same
+  source to the optimizer (see `cvm_analyze`). Nodes are identified by
+  their type and the offset of their first token in the source, so a
+  profile only applies to the exact source it was recorded on.
+
+  The file is text, one node per line after the header:
+
+  CVMP <version> <hash of the source>
+  <type> <line> <offset> <count> <count>
+
+  IFEL : times the condition was false, times it was true
+  WHIL : activations, iterations
+  CALL : calls, 0
+*/
+
+#define PROFILE_MAGIC "CVMP"
+#define PROFILE_VERSION 1
+
+typedef struct {
+    uint32_t type; // 'IFEL', 'WHIL' or 'CALL'
+    size_t offset; // of the first token of the node
+    uint64_t counts[2];
+} Profile_Entry;
+
+typedef struct {
+    Profile_Entry * items;
+    size_t count;
+    size_t capacity;
+    const char * source; // offsets are relative to it, NULL when not profiling
+    int recording; // counts of the run are added to the entries
+    int loaded; // the entries come from a file
+} Profile;
+
+extern Profile profile;
+
+// `source` is the program text the AST refers to, it must outlive the profile
+void profile_open(const char * source, int recording);
+// return 1 if the file cannot be read or was recorded on another source
+int profile_read(const char * path);
+// return 1 on fail
+int profile_write(const char * path);
+// NULL if the node has no entry
+Profile_Entry * profile_find(uint32_t type, size_t offset);
+void profile_add(uint32_t type, size_t offset, const uint64_t counts[2]);
+void profile_close();
+
+#endif // PROFILE_H_
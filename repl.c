@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <stddef.h> // size_t
+#include <stdint.h>
+#include <stdlib.h> // memory
+#include <string.h> // strcmp
+#include <ctype.h> // isspace
+#include <unistd.h> // isatty
+
+#include "repl.h"
+#include "dynarray.h"
+#include "tokenizer.h"
+#include "ast_builder.h"
+#include "cvm.h"
+#include "cache.h" // cache_hash
+
+// an entry or a loaded file, kept until the session ends:
+// the cvm refers to its tokens and nodes
+typedef struct {
+    const char * path; // NULL for an entry, heap alloc'ed
+    Tokenizer tok;
+    AST_Node ast;
+} Repl_Unit;
+
+// where the current definition of a name was loaded from
+typedef struct {
+    Token name;
+    uint64_t hash; // of the item text in the file, 0 if defined interactively
+} Repl_Item;
+
+static struct {
+    Repl_Unit ** items; // units don't move, nodes point into them
+    size_t count;
+    size_t capacity;
+} units = {};
+static struct {
+    Repl_Item * items;
+    size_t count;
+    size_t capacity;
+} defined = {};
+static char * last_path = NULL;
+
+static Repl_Unit * repl_new_unit(const char * path) {
+    Repl_Unit * unit = (Repl_Unit *)calloc(1, sizeof(Repl_Unit));
+    if (path) unit->path = strdup(path);
+    unit->ast = (AST_Node) {'TOP'};
+    da_append(&units, unit);
+    return unit;
+}
+
+static Repl_Item * repl_find_item(Token * name) {
+    for (size_t i = 0; i < defined.count; ++i) {
+        Token * other = &defined.items[i].name;
+        if (other->len == name->len && strncmp(other->begin, name->begin, name->len) == 0) {
+            return defined.items + i;
+        }
+    }
+    return NULL;
+}
+
+static void repl_set_item(Token * name, uint64_t hash) {
+    Repl_Item * item = repl_find_item(name);
+    if (item) *item = (Repl_Item) {*name, hash};
+    else da_append(&defined, ((Repl_Item) {*name, hash}));
+}
+
+// " (line N of <file>)" for a char of any unit
+static void repl_print_location(const char * p) {
+    for (size_t i = 0; i < units.count; ++i) {
+        Repl_Unit * unit = units.items[i];
+        if (!unit->tok.buffer || p < unit->tok.buffer ||
+            p >= unit->tok.buffer + strlen(unit->tok.buffer)) continue;
+        printf(" (line %zu", Tokenizer_line_of(&unit->tok, p));
+        if (unit->path) printf(" of %s", unit->path);
+        printf(")");
+        return;
+    }
+}
+
+static void repl_report(int status) {
+    if (status == CVM_STATUS_LIMIT) {
+        printf("aborted: %s\n", cvm_errmsg);
+    } else if (cvm_errmsg) {
+        printf("error: %s", cvm_errmsg);
+        if (cvm_errtok) repl_print_location(cvm_errtok->begin);
+        printf("\n");
+    } else {
+        printf("error: invalid code\n");
+    }
+}
+
+// only the items whose text changed since they were last loaded are parsed
+static void repl_load(const char * path) {
+    Repl_Unit * unit = repl_new_unit(path); // copies `path`, which may be `last_path`
+    free(last_path);
+    last_path = strdup(unit->path);
+    if (Tokenizer_read_file(&unit->tok, unit->path)) {
+        printf("\n");
+        return;
+    }
+    if (Tokenizer_tokenize(&unit->tok)) {
+        printf("error: %s", unit->tok.errmsg);
+        repl_print_location(unit->tok.buffer + unit->tok.errind);
+        printf("\n");
+        return;
+    }
+    struct {
+        uint64_t * items;
+        size_t count;
+        size_t capacity;
+    } hashes = {}; // of each item in `unit->ast`
+    size_t n_unchanged = 0, n_failed = 0;
+    Token * end = unit->tok.items + unit->tok.count;
+    for (Token * begin = unit->tok.items; begin < end; ) {
+        Token * item_end = ast_item_end(begin, end);
+        const char * text = begin->begin;
+        uint64_t hash = cache_hash(text, item_end[-1].begin + item_end[-1].len - text);
+        // `int <name> ...`
+        Repl_Item * item = item_end - begin > 1 ? repl_find_item(begin + 1) : NULL;
+        if (item && item->hash == hash) {
+            n_unchanged += 1;
+        } else {
+            AST_Node top;
+            if (ast_build_items(&top, begin, item_end, 0)) {
+                printf("error: %s", ast_builder_errmsg);
+                repl_print_location(text);
+                printf("\n");
+                n_failed += 1;
+            } else {
+                for (size_t i = 0; i < top.count; ++i) {
+                    da_append(&unit->ast, top.items[i]);
+                    da_append(&hashes, hash);
+                }
+                da_free(&top); // the children moved to `unit->ast`
+            }
+        }
+        begin = item_end;
+    }
+    for (size_t i = 0; i < unit->ast.count; ++i) {
+        AST_Node * node = unit->ast.items + i;
+        int status = cvm_session_define(node);
+        if (status) {
+            repl_report(status);
+            n_failed += 1;
+            continue;
+        }
+        repl_set_item(node->items[0].token, hashes.items[i]);
+    }
+    da_free(&hashes);
+    printf("%s: %zu defined, %zu unchanged, %zu failed\n",
+           unit->path, unit->ast.count, n_unchanged, n_failed);
+}
+
+// an expression statement whose value is worth printing
+static int repl_is_value(AST_Node * node) {
+    if (node->type != 'EXPS') return 0;
+    AST_Node * expr = node->items + 0;
+    while (expr->type == 'EXPR' && expr->count == 1) expr = expr->items + 0;
+    if (expr->type != 'BIOP') return 1;
+    Token * op = expr->token;
+    return !(op->len == 1 && op->begin[0] == '=') &&
+        !(op->len == 2 && (strncmp(op->begin, "<<", 2) == 0 || strncmp(op->begin, ">>", 2) == 0));
+}
+
+static void repl_entry(char * text) {
+    Repl_Unit * unit = repl_new_unit(NULL);
+    unit->tok.buffer = text;
+    if (Tokenizer_tokenize(&unit->tok)) {
+        printf("error: %s\n", unit->tok.errmsg);
+        return;
+    }
+    if (ast_build_items(&unit->ast, unit->tok.items, unit->tok.items + unit->tok.count, 1)) {
+        unit->ast = (AST_Node) {'TOP'};
+        printf("error: %s\n", ast_builder_errmsg);
+        return;
+    }
+    for (size_t i = 0; i < unit->ast.count; ++i) {
+        AST_Node * node = unit->ast.items + i;
+        int status, value;
+        if (node->type == 'DECL' || node->type == 'FUNC') {
+            status = cvm_session_define(node);
+            if (!status) repl_set_item(node->items[0].token, 0);
+        } else if (repl_is_value(node)) {
+            status = cvm_session_eval(&value, node->items + 0);
+            if (status == 0) printf("= %d\n", value);
+            if (status == 2 || status == 3) status = 0; // cout, cin
+        } else {
+            status = cvm_session_exec(&value, node);
+        }
+        if (status) {
+            repl_report(status);
+            break;
+        }
+    }
+}
+
+static void repl_help() {
+    printf("Enter declarations, functions and statements. Commands:\n"
+           "  :load [<file>]  define the items of <file>, skipping unchanged ones\n"
+           "  :help\n"
+           "  :quit\n");
+}
+
+// @return 1 to quit
+static int repl_command(char * line) {
+    char * cmd = strtok(line + 1, " \t\r\n");
+    char * arg = strtok(NULL, " \t\r\n");
+    if (!cmd || strcmp(cmd, "help") == 0) {
+        repl_help();
+    } else if (strcmp(cmd, "quit") == 0 || strcmp(cmd, "q") == 0) {
+        return 1;
+    } else if (strcmp(cmd, "load") == 0) {
+        if (arg) repl_load(arg);
+        else if (last_path) repl_load(last_path);
+        else printf("error: no file to load\n");
+    } else {
+        printf("error: unknown command :%s\n", cmd);
+    }
+    return 0;
+}
+
+int repl_run(const char * code_path, FILE * is, FILE * os) {
+    int interactive = isatty(STDIN_FILENO);
+    cvm_session_begin(is, os);
+    if (code_path) repl_load(code_path);
+    if (interactive) repl_help();
+
+    char * line = NULL;
+    size_t line_cap = 0;
+    struct {
+        char * items;
+        size_t count;
+        size_t capacity;
+    } entry = {};
+    long depth = 0;
+    while (1) {
+        if (interactive) {
+            printf(entry.count ? "... " : "> ");
+            fflush(stdout);
+        }
+        ssize_t len = getline(&line, &line_cap, stdin);
+        if (len < 0) break;
+
+        char last = 0; // last non-blank char
+        for (ssize_t i = 0; i < len; ++i) {
+            if (line[i] == '{') depth += 1;
+            if (line[i] == '}') depth -= 1;
+            if (!isspace((unsigned char)line[i])) last = line[i];
+        }
+        if (entry.count == 0) {
+            if (!last) continue;
+            if (line[0] == ':') {
+                depth = 0;
+                if (repl_command(line)) break;
+                fflush(os);
+                continue;
+            }
+        }
+        for (ssize_t i = 0; i < len; ++i) da_append(&entry, line[i]);
+        if (depth > 0 || (last != ';' && last != '}')) continue;
+
+        da_append(&entry, '\0');
+        repl_entry(strdup(entry.items)); // owned by its unit
+        entry.count = 0;
+        depth = 0;
+        fflush(os);
+    }
+    if (entry.count) printf("error: incomplete entry at end of input\n");
+    free(line);
+    da_free(&entry);
+
+    cvm_session_end();
+    for (size_t i = 0; i < units.count; ++i) {
+        ast_free_node(&units.items[i]->ast);
+        Tokenizer_free(&units.items[i]->tok);
+        free((char *)units.items[i]->path);
+        free(units.items[i]);
+    }
+    da_free(&units);
+    da_free(&defined);
+    free(last_path);
+    last_path = NULL;
+    return 0;
+}
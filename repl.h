@@ -0,0 +1,24 @@
+#ifndef REPL_H_
+#define REPL_H_
+
+#include <stdio.h> // FILE
+
+/*
+  @def REPL
+
+  Reads declarations, function definitions and statements from stdin,
+  one entry at a time, and runs them in a cvm session: globals keep their
+  values between entries, a definition replaces the previous one.
+  An entry ends at a line where braces are balanced and the last
+  character is `;` or `}`. Commands:
+
+  :load [<file>]  define the top level items of <file> (default: the last
+                  one loaded), skipping those whose text did not change
+  :help
+  :quit           or end of input
+*/
+
+// `code_path` may be NULL, `is`/`os` are the streams of `cin`/`cout`
+int repl_run(const char * code_path, FILE * is, FILE * os);
+
+#endif // REPL_H_
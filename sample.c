@@ -0,0 +1,225 @@
+#include <stdio.h> // file
+#include <stddef.h> // size_t
+#include <stdint.h>
+#include <stdlib.h> // memory, qsort
+#include <string.h> // memcmp, strcmp
+#include <signal.h> // sigaction
+#include <sys/time.h> // setitimer
+
+#include "sample.h"
+#include "dynarray.h"
+
+_Thread_local Sample_Stack sample_stack = {};
+
+static const size_t SAMPLE_TABLE = 4096; // distinct stacks, a power of 2
+static const size_t SAMPLE_POOL = 65536; // frames of all of them
+
+typedef struct {
+    uint64_t hash;
+    uint64_t count; // 0 if the slot is free
+    uint32_t first; // in `pool`
+    uint16_t n_frames;
+    uint16_t truncated; // deeper than SAMPLE_MAX_DEPTH
+} Sample_Entry;
+
+// written by the handler only, while the timer is armed
+static struct {
+    Sample_Entry * table;
+    Sample_Frame * pool;
+    size_t n_entries;
+    size_t pool_used;
+    uint64_t vm; // outside of any function
+    atomic_ullong other; // in a thread without a sampled VM, there may be several
+    uint64_t dropped; // the table or the pool was full
+} samples = {};
+
+static uint64_t sample_hash(const Sample_Frame * frames, size_t n, int truncated) {
+    uint64_t hash = 14695981039346656037ull ^ truncated; // FNV-1a over the pointers
+    for (size_t i = 0; i < n; ++i) {
+        hash = (hash ^ (uintptr_t)frames[i].func) * 1099511628211ull;
+        hash = (hash ^ (uintptr_t)frames[i].stmt) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// async-signal-safe: no allocation, no lock, and of the library only
+// memcpy and memcmp, which POSIX lists as safe in a handler
+static void sample_handler(int sig) {
+    if (!sample_stack.on) {
+        atomic_fetch_add_explicit(&samples.other, 1, memory_order_relaxed);
+        return;
+    }
+    size_t depth = sample_stack.depth;
+    atomic_signal_fence(memory_order_acquire);
+    if (depth == 0) {
+        samples.vm += 1;
+        return;
+    }
+    // the innermost frames, outermost first
+    Sample_Frame frames[SAMPLE_MAX_DEPTH];
+    size_t n = depth < SAMPLE_MAX_DEPTH ? depth : SAMPLE_MAX_DEPTH;
+    memcpy(frames, sample_stack.frames + depth - n, n * sizeof(Sample_Frame));
+    int truncated = depth > SAMPLE_MAX_DEPTH;
+    uint64_t hash = sample_hash(frames, n, truncated);
+
+    for (size_t i = hash & (SAMPLE_TABLE - 1); ; i = (i + 1) & (SAMPLE_TABLE - 1)) {
+        Sample_Entry * e = samples.table + i;
+        if (e->count == 0) {
+            // at most half full, so that probes stay short
+            if (samples.n_entries * 2 >= SAMPLE_TABLE || samples.pool_used + n > SAMPLE_POOL) break;
+            memcpy(samples.pool + samples.pool_used, frames, n * sizeof(Sample_Frame));
+            *e = (Sample_Entry) {hash, 1, samples.pool_used, n, truncated};
+            samples.pool_used += n;
+            samples.n_entries += 1;
+            return;
+        }
+        if (e->hash == hash && e->n_frames == n && e->truncated == truncated &&
+            memcmp(samples.pool + e->first, frames, n * sizeof(Sample_Frame)) == 0) {
+            e->count += 1;
+            return;
+        }
+    }
+    samples.dropped += 1;
+}
+
+// the handler runs on this thread: it sees the old array, still valid,
+// or the new one, never a freed one
+void sample_grow() {
+    size_t capacity = sample_stack.capacity ? 2 * sample_stack.capacity : 256;
+    Sample_Frame * frames = (Sample_Frame *)malloc(capacity * sizeof(Sample_Frame));
+    if (!frames) {
+        sample_stack.on = 0;
+        return;
+    }
+    Sample_Frame * old = sample_stack.frames;
+    if (old) memcpy(frames, old, sample_stack.depth * sizeof(Sample_Frame));
+    atomic_signal_fence(memory_order_release);
+    sample_stack.frames = frames;
+    sample_stack.capacity = capacity;
+    atomic_signal_fence(memory_order_release);
+    free(old);
+}
+
+int sample_start(long interval_us) {
+    samples.table = (Sample_Entry *)calloc(SAMPLE_TABLE, sizeof(Sample_Entry));
+    samples.pool = (Sample_Frame *)malloc(SAMPLE_POOL * sizeof(Sample_Frame));
+    sample_stack.depth = 0;
+    sample_stack.on = 1;
+    sample_grow();
+    if (!samples.table || !samples.pool || !sample_stack.on || interval_us <= 0) {
+        sample_close();
+        return 1;
+    }
+    struct sigaction action = {};
+    action.sa_handler = sample_handler;
+    action.sa_flags = SA_RESTART; // reads of the input go on after a tick
+    sigemptyset(&action.sa_mask);
+    struct itimerval timer = {{interval_us / 1000000, interval_us % 1000000},
+                              {interval_us / 1000000, interval_us % 1000000}};
+    if (sigaction(SIGPROF, &action, NULL) || setitimer(ITIMER_PROF, &timer, NULL)) {
+        sample_stop();
+        sample_close();
+        return 1;
+    }
+    return 0;
+}
+
+void sample_stop() {
+    struct itimerval timer = {};
+    setitimer(ITIMER_PROF, &timer, NULL);
+    // a tick already pending would kill the process by default
+    signal(SIGPROF, SIG_IGN);
+    sample_stack.on = 0;
+}
+
+typedef struct {
+    char * stack; // heap alloc'ed
+    uint64_t count;
+} Sample_Line;
+
+static int sample_compare_stacks(const void * l_, const void * r_) {
+    return strcmp(((const Sample_Line *)l_)->stack, ((const Sample_Line *)r_)->stack);
+}
+
+static int sample_compare_counts(const void * l_, const void * r_) {
+    const Sample_Line * l = (const Sample_Line *)l_;
+    const Sample_Line * r = (const Sample_Line *)r_;
+    if (l->count != r->count) return l->count > r->count ? -1 : 1;
+    return strcmp(l->stack, r->stack);
+}
+
+// the first token of a statement, for its line
+static const Token * sample_token(const AST_Node * node) {
+    while (!node->token && node->count) node = node->items;
+    return node->token;
+}
+
+static void sample_frame(FILE * fp, const Sample_Frame * frame,
+                         size_t (*where)(const char * p, const char ** lib)) {
+    const Token * name = frame->func->items[0].token;
+    const Token * tok = frame->stmt ? sample_token(frame->stmt) : NULL;
+    if (!tok) tok = name;
+    const char * lib = NULL;
+    size_t line = where(tok->begin, &lib);
+    if (lib) fprintf(fp, "%.*s:%s:%zu", (int)name->len, name->begin, lib, line);
+    else fprintf(fp, "%.*s:%zu", (int)name->len, name->begin, line);
+}
+
+int sample_write(const char * path, size_t (*where)(const char * p, const char ** lib)) {
+    // stacks of different statements on the same lines print the same
+    struct {
+        Sample_Line * items;
+        size_t count;
+        size_t capacity;
+    } lines = {};
+    for (size_t i = 0; i < SAMPLE_TABLE && samples.table; ++i) {
+        Sample_Entry * e = samples.table + i;
+        if (e->count == 0) continue;
+        char * text = NULL;
+        size_t len = 0;
+        FILE * mem = open_memstream(&text, &len);
+        if (!mem) continue;
+        if (e->truncated) fprintf(mem, "...;");
+        for (size_t j = 0; j < e->n_frames; ++j) {
+            if (j) fputc(';', mem);
+            sample_frame(mem, samples.pool + e->first + j, where);
+        }
+        fclose(mem);
+        da_append(&lines, ((Sample_Line) {text, e->count}));
+    }
+    // no sample: the items are NULL, which qsort does not take even for 0 of them
+    if (lines.count) qsort(lines.items, lines.count, sizeof(Sample_Line), sample_compare_stacks);
+    size_t n = 0;
+    for (size_t i = 0; i < lines.count; ++i) {
+        if (n && strcmp(lines.items[n - 1].stack, lines.items[i].stack) == 0) {
+            lines.items[n - 1].count += lines.items[i].count;
+            free(lines.items[i].stack);
+        } else {
+            lines.items[n++] = lines.items[i];
+        }
+    }
+    lines.count = n;
+    if (lines.count) qsort(lines.items, lines.count, sizeof(Sample_Line), sample_compare_counts);
+
+    FILE * fp = fopen(path, "w");
+    for (size_t i = 0; i < lines.count; ++i) {
+        if (fp) fprintf(fp, "%s %llu\n", lines.items[i].stack, (unsigned long long)lines.items[i].count);
+        free(lines.items[i].stack);
+    }
+    da_free(&lines);
+    if (!fp) return 1;
+    if (samples.vm) fprintf(fp, "[vm] %llu\n", (unsigned long long)samples.vm);
+    unsigned long long other = atomic_load(&samples.other);
+    if (other) fprintf(fp, "[other threads] %llu\n", other);
+    if (samples.dropped) fprintf(fp, "[dropped] %llu\n", (unsigned long long)samples.dropped);
+    return fclose(fp) != 0;
+}
+
+void sample_close() {
+    sample_stack.on = 0;
+    free(sample_stack.frames);
+    sample_stack = (Sample_Stack) {};
+    free(samples.table);
+    free(samples.pool);
+    memset(&samples, 0, sizeof(samples));
+}
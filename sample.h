@@ -0,0 +1,93 @@
+#ifndef SAMPLE_H_
+#define SAMPLE_H_
+
+#include <stddef.h> // size_t
+#include <stdatomic.h> // atomic_signal_fence
+
+#include "ast_builder.h"
+
+/*
+  @def Sampling profiler
+
+  `--sample-profile` arms a SIGPROF timer (`setitimer`, on the CPU time of
+  the process). The VM keeps a shadow stack of the functions it runs and,
+  for each, of the statement being executed; on every tick the handler
+  looks the stack up in a table allocated up front and counts it. A sample
+  neither allocates nor locks, and memory does not grow with the length
+  of the run, so it can stay on for every job.
+
+  `sample_write` prints one line per distinct stack, in the collapsed
+  format of flame graph tools, outermost frame first:
+
+  main:24;fib:5;fib:7 42
+
+  A frame is `<function>:<line>`, the line of its current statement: the
+  call in callers. Functions of a `--lib` are `<function>:<path>:<line>`.
+  Stacks deeper than SAMPLE_MAX_DEPTH keep their innermost frames, under a
+  `...` root. Ticks outside of any function are counted as `[vm]`, ticks
+  in other threads (`--pipelined-io`) as `[other threads]`, and stacks
+  that no longer fit in the table as `[dropped]`.
+*/
+
+#define SAMPLE_MAX_DEPTH 64 // frames of a sample
+
+typedef struct {
+    const AST_Node * func; // 'FUNC'
+    const AST_Node * stmt; // NULL until the first statement
+} Sample_Frame;
+
+typedef struct {
+    Sample_Frame * frames; // the handler reads those below `depth`
+    size_t capacity;
+    volatile size_t depth;
+    int on; // the VM of this thread is sampled
+} Sample_Stack;
+
+extern _Thread_local Sample_Stack sample_stack;
+
+// moves the frames to a larger array, or stops sampling if out of memory
+void sample_grow();
+
+// the hot path: no-ops unless sampling
+static inline void sample_push(const AST_Node * func) {
+    if (!sample_stack.on) return;
+    if (sample_stack.depth == sample_stack.capacity) {
+        sample_grow();
+        if (!sample_stack.on) return;
+    }
+    sample_stack.frames[sample_stack.depth] = (Sample_Frame) {func, NULL};
+    atomic_signal_fence(memory_order_release); // the frame is complete before it is seen
+    sample_stack.depth += 1;
+}
+
+static inline void sample_pop() {
+    if (!sample_stack.on) return;
+    sample_stack.depth -= 1;
+}
+
+// a tail call reuses the frame of the returning function
+static inline void sample_replace(const AST_Node * func) {
+    if (!sample_stack.on) return;
+    Sample_Frame * frame = sample_stack.frames + sample_stack.depth - 1;
+    frame->stmt = NULL;
+    atomic_signal_fence(memory_order_release);
+    frame->func = func;
+}
+
+static inline void sample_stmt(const AST_Node * stmt) {
+    if (!sample_stack.on || !sample_stack.depth) return;
+    sample_stack.frames[sample_stack.depth - 1].stmt = stmt;
+}
+
+// samples the VM of the calling thread every `interval_us` of CPU time
+// return 1 on fail
+int sample_start(long interval_us);
+// disarms the timer, the samples are kept for `sample_write`
+void sample_stop();
+// `where` gives the line of a char of a source, and the path of its
+// `--lib` (NULL for the main source); the AST must still be alive
+// return 1 on fail
+int sample_write(const char * path, size_t (*where)(const char * p, const char ** lib));
+void sample_close();
+
+#endif // SAMPLE_H_
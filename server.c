@@ -0,0 +1,422 @@
+#include <stdio.h>
+#include <stddef.h> // size_t
+#include <stdint.h>
+#include <stdlib.h> // memory
+#include <string.h> // memcmp
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h> // read, write, close
+#include <fcntl.h> // O_NONBLOCK
+#include <poll.h> // the interactive client
+#include <sys/socket.h>
+#include <sys/un.h> // sockaddr_un
+
+#include "server.h"
+#include "dynarray.h"
+#include "tokenizer.h"
+#include "ast_builder.h"
+#include "cvm.h"
+#include "cache.h"
+#include "coro.h"
+
+#define SERVER_HEADER_MAX 64
+#define SERVER_MESSAGE_MAX 512
+
+typedef struct {
+    uint64_t hash;
+    size_t len; // of the source
+    Tokenizer tok; // owns the source
+    AST_Node ast;
+} Server_Program;
+
+// idle compiled programs, least recently used first
+static struct {
+    pthread_mutex_t lock;
+    Server_Program ** items;
+    size_t count;
+    size_t capacity;
+} lru = {PTHREAD_MUTEX_INITIALIZER};
+
+// accepted connections waiting for a worker
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    int * items;
+    size_t count;
+    size_t capacity;
+    int stopping;
+} pending = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+static Server_Config * server_config = NULL;
+static volatile sig_atomic_t stop_requested = 0;
+
+// in a session, these yield instead of blocking
+static int read_full(int fd, char * buf, size_t len) {
+    while (len) {
+        ssize_t n = coro_read(fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int write_full(int fd, const char * buf, size_t len) {
+    while (len) {
+        ssize_t n = coro_write(fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// compiled programs
+
+static void server_free_program(Server_Program * prog) {
+    ast_free_node(&prog->ast);
+    Tokenizer_free(&prog->tok);
+    free(prog);
+}
+
+// @return NULL on a compile error, described in `message`
+static Server_Program * server_compile(const char * source, size_t len, uint64_t hash,
+                                       char * message, size_t size) {
+    Server_Program * prog = (Server_Program *)calloc(1, sizeof(Server_Program));
+    prog->hash = hash;
+    prog->len = len;
+    prog->tok.buffer = (char *)malloc(len + 1);
+    memcpy(prog->tok.buffer, source, len);
+    prog->tok.buffer[len] = '\0';
+    const char * cache_dir = server_config->cache_dir;
+    if (!cache_dir || cache_load(&prog->ast, &prog->tok, cache_dir, 0)) {
+        if (Tokenizer_tokenize(&prog->tok)) {
+            snprintf(message, size, "Tokenizer error: %s", prog->tok.errmsg);
+            server_free_program(prog);
+            return NULL;
+        }
+        // requests are the parallelism, one thread per parse
+        if (ast_build(&prog->ast, &prog->tok)) {
+            snprintf(message, size, "AST Builder Error: %s", ast_builder_errmsg);
+            server_free_program(prog);
+            return NULL;
+        }
+        if (cache_dir) cache_store(&prog->ast, &prog->tok, cache_dir, 0);
+    }
+    return prog;
+}
+
+static Server_Program * server_checkout(const char * source, size_t len, uint64_t hash) {
+    Server_Program * found = NULL;
+    pthread_mutex_lock(&lru.lock);
+    for (size_t i = lru.count; i-- > 0; ) {
+        Server_Program * prog = lru.items[i];
+        if (prog->hash != hash || prog->len != len || memcmp(prog->tok.buffer, source, len)) continue;
+        found = prog;
+        memmove(lru.items + i, lru.items + i + 1, (lru.count - i - 1) * sizeof(*lru.items));
+        lru.count -= 1;
+        break;
+    }
+    pthread_mutex_unlock(&lru.lock);
+    return found;
+}
+
+static void server_checkin(Server_Program * prog) {
+    Server_Program * evicted = NULL;
+    pthread_mutex_lock(&lru.lock);
+    da_append(&lru, prog);
+    if (lru.count > server_config->cache_capacity) {
+        evicted = lru.items[0];
+        memmove(lru.items, lru.items + 1, (lru.count - 1) * sizeof(*lru.items));
+        lru.count -= 1;
+    }
+    pthread_mutex_unlock(&lru.lock);
+    if (evicted) server_free_program(evicted);
+}
+
+// requests
+
+// the lines `main` prints after a run
+static void server_describe(char * message, size_t size, int status, int ret_val,
+                            Server_Program * prog) {
+    if (status == 0) {
+        snprintf(message, size, "CVM exited successfully with return value %d", ret_val);
+    } else if (status == CVM_STATUS_LIMIT) {
+        snprintf(message, size, "CVM aborted: %s", cvm_errmsg);
+    } else if (cvm_errmsg && cvm_errtok) {
+        snprintf(message, size, "CVM runtime error: %s (line %zu)",
+                 cvm_errmsg, Tokenizer_line_of(&prog->tok, cvm_errtok->begin));
+    } else if (cvm_errmsg) {
+        snprintf(message, size, "CVM runtime error: %s", cvm_errmsg);
+    } else {
+        snprintf(message, size, "CVM exited abnormally. Syntax error in source file.");
+    }
+}
+
+static void server_handle(int fd) {
+    char header[SERVER_HEADER_MAX];
+    size_t header_len = 0;
+    while (header_len + 1 < sizeof(header)) {
+        if (read_full(fd, header + header_len, 1)) break;
+        if (header[header_len++] == '\n') break;
+    }
+    header[header_len] = '\0';
+    size_t code_len, input_len = 0;
+    char streamed = 0;
+    if (sscanf(header, "%zu %zu", &code_len, &input_len) != 2 &&
+        (sscanf(header, "%zu %c", &code_len, &streamed) != 2 || streamed != '-')) {
+        close(fd);
+        return;
+    }
+    char * code = (char *)malloc(code_len + 1);
+    // a trailing blank: `cin` sees the same input, and the stream is never empty
+    char * input = streamed ? NULL : (char *)malloc(input_len + 1);
+    if (!code || (!streamed && !input) || read_full(fd, code, code_len) ||
+        (!streamed && read_full(fd, input, input_len))) {
+        free(code);
+        free(input);
+        close(fd);
+        return;
+    }
+    if (input) input[input_len] = ' ';
+
+    char message[SERVER_MESSAGE_MAX];
+    int status = 1, ret_val = -1;
+    uint64_t hash = cache_hash(code, code_len);
+    Server_Program * prog = server_checkout(code, code_len, hash);
+    if (!prog) prog = server_compile(code, code_len, hash, message, sizeof(message));
+
+    FILE * os = coro_fdopen(fd, "w", NULL); // streamed as the buffer fills up
+    if (os && prog) {
+        // streamed: the rest of the connection, output is flushed before each wait
+        FILE * is = streamed ? coro_fdopen(fd, "r", os) : fmemopen(input, input_len + 1, "r");
+        if (is) {
+            status = cvm_run(&ret_val, &prog->ast, is, os);
+            server_describe(message, sizeof(message), status, ret_val, prog);
+            fclose(is);
+        } else {
+            snprintf(message, sizeof(message), "ERROR: Open input failed.");
+        }
+    }
+    if (os) {
+        fputc('\0', os);
+        fprintf(os, "%d %d\n%s\n", status, ret_val, message);
+        fclose(os);
+    }
+    if (prog) server_checkin(prog);
+    free(code);
+    free(input);
+    close(fd);
+}
+
+// a connection in `--sessions` mode
+static void server_session(void * arg) {
+    int fd = (int)(intptr_t)arg;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    server_handle(fd);
+}
+
+static void * server_worker(void * arg) {
+    while (1) {
+        pthread_mutex_lock(&pending.lock);
+        while (pending.count == 0 && !pending.stopping) {
+            pthread_cond_wait(&pending.ready, &pending.lock);
+        }
+        if (pending.count == 0) { // stopping
+            pthread_mutex_unlock(&pending.lock);
+            break;
+        }
+        int fd = pending.items[0];
+        memmove(pending.items, pending.items + 1, (pending.count - 1) * sizeof(int));
+        pending.count -= 1;
+        pthread_mutex_unlock(&pending.lock);
+        server_handle(fd);
+    }
+    return NULL;
+}
+
+static void server_on_signal(int sig) {
+    stop_requested = 1;
+}
+
+int server_run(Server_Config * config) {
+    server_config = config;
+    cvm_config.pipelined_io = 0; // the streams are in memory and on the socket
+    if (config->sessions) {
+        // their state is per thread and is not swapped with the VM's
+        cvm_config.ir = 0;
+        cvm_config.parallel_calls = 0;
+    }
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(config->socket_path) >= sizeof(addr.sun_path)) {
+        printf("ERROR: Socket path %s is too long.\n", config->socket_path);
+        return 1;
+    }
+    strcpy(addr.sun_path, config->socket_path);
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(config->socket_path); // a stale socket from a previous run
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        listen(listen_fd, 128)) {
+        printf("ERROR: Listen on %s failed: %s.\n", config->socket_path, strerror(errno));
+        if (listen_fd >= 0) close(listen_fd);
+        return 1;
+    }
+
+    // SIGINT and SIGTERM interrupt `accept` in this thread only
+    signal(SIGPIPE, SIG_IGN); // a client went away, its writes just fail
+    struct sigaction action = {.sa_handler = server_on_signal}; // no SA_RESTART
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    sigset_t stop_signals, old_mask;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &old_mask);
+    int n_workers = config->n_workers > 0 ? config->n_workers : 1;
+    pthread_t * workers = NULL;
+    if (config->sessions) {
+        if (coro_start(n_workers)) {
+            pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+            printf("ERROR: Start of the session threads failed.\n");
+            close(listen_fd);
+            return 1;
+        }
+    } else {
+        workers = (pthread_t *)malloc(n_workers * sizeof(pthread_t));
+        for (int i = 0; i < n_workers; ++i) pthread_create(workers + i, NULL, server_worker, NULL);
+    }
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    printf("Serving on %s with %d %s.\n", config->socket_path, n_workers,
+           config->sessions ? "session threads" : "workers");
+    fflush(stdout);
+    while (!stop_requested) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) continue; // EINTR on a stop signal, or a failed connection
+        if (config->sessions) {
+            coro_spawn(server_session, (void *)(intptr_t)fd);
+            continue;
+        }
+        pthread_mutex_lock(&pending.lock);
+        da_append(&pending, fd);
+        pthread_cond_signal(&pending.ready);
+        pthread_mutex_unlock(&pending.lock);
+    }
+
+    // finish the accepted requests, then quit
+    if (config->sessions) {
+        coro_stop();
+    } else {
+        pthread_mutex_lock(&pending.lock);
+        pending.stopping = 1;
+        pthread_cond_broadcast(&pending.ready);
+        pthread_mutex_unlock(&pending.lock);
+        for (int i = 0; i < n_workers; ++i) pthread_join(workers[i], NULL);
+        free(workers);
+    }
+    close(listen_fd);
+    unlink(config->socket_path);
+    for (size_t i = 0; i < lru.count; ++i) server_free_program(lru.items[i]);
+    da_free(&lru);
+    da_free(&pending);
+    return 0;
+}
+
+// client
+
+int client_run(const char * socket_path, const char * code_path, FILE * is, FILE * os, int interactive) {
+    Tokenizer tok = {}; // only to read the file
+    if (Tokenizer_read_file(&tok, code_path)) return 1;
+    struct {
+        char * items;
+        size_t count;
+        size_t capacity;
+    } input = {};
+    char chunk[4096];
+    // interactive: forwarded as it is read, below
+    for (size_t n; !interactive && (n = fread(chunk, 1, sizeof(chunk), is)) > 0; ) {
+        for (size_t i = 0; i < n; ++i) da_append(&input, chunk[i]);
+    }
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+        printf("ERROR: Connect to %s failed: %s.\n", socket_path, strerror(errno));
+        Tokenizer_free(&tok);
+        da_free(&input);
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    char header[SERVER_HEADER_MAX];
+    size_t code_len = strlen(tok.buffer);
+    int header_len = interactive ? snprintf(header, sizeof(header), "%zu -\n", code_len) :
+        snprintf(header, sizeof(header), "%zu %zu\n", code_len, input.count);
+    int failed = write_full(fd, header, header_len) ||
+        write_full(fd, tok.buffer, code_len) ||
+        write_full(fd, input.items, input.count);
+    Tokenizer_free(&tok);
+    da_free(&input);
+    int input_done = !interactive;
+    if (input_done) shutdown(fd, SHUT_WR);
+
+    // output up to the NUL, then the trailer
+    struct {
+        char * items;
+        size_t count;
+        size_t capacity;
+    } trailer = {};
+    int in_trailer = 0;
+    ssize_t n;
+    while (!failed) {
+        if (!input_done) {
+            // whichever comes first: a line for `cin`, or output
+            struct pollfd fds[2] = {{fileno(is), POLLIN}, {fd, POLLIN}};
+            if (poll(fds, 2, -1) < 0) {
+                failed = errno != EINTR;
+                continue;
+            }
+            if (fds[0].revents) {
+                n = read(fileno(is), chunk, sizeof(chunk));
+                if (n > 0) {
+                    failed = write_full(fd, chunk, n);
+                } else {
+                    input_done = 1;
+                    shutdown(fd, SHUT_WR);
+                }
+            }
+            if (!fds[1].revents) continue;
+        }
+        if ((n = read(fd, chunk, sizeof(chunk))) <= 0) break;
+        size_t i = 0;
+        if (!in_trailer) {
+            char * nul = memchr(chunk, '\0', n);
+            i = nul ? nul - chunk : n;
+            fwrite(chunk, 1, i, os);
+            if (interactive) fflush(os);
+            if (nul) {
+                in_trailer = 1;
+                i += 1;
+            }
+        }
+        for (; i < (size_t)n; ++i) da_append(&trailer, chunk[i]);
+    }
+    close(fd);
+    da_append(&trailer, '\0');
+    int status = 1, ret_val, message_at = 0;
+    if (failed || !in_trailer ||
+        sscanf(trailer.items, "%d %d\n%n", &status, &ret_val, &message_at) != 2) {
+        printf("ERROR: Bad response from %s.\n", socket_path);
+        da_free(&trailer);
+        return 1;
+    }
+    fflush(os);
+    printf("%s", trailer.items + message_at);
+    da_free(&trailer);
+    return status;
+}
@@ -0,0 +1,50 @@
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include <stddef.h> // size_t
+#include <stdio.h> // FILE
+
+/*
+  @def Server mode
+
+  `--serve <socket>` listens on a Unix domain socket, one request per
+  connection:
+
+  request  : "<program length> <input length>\n" program input
+  response : output '\0' "<status> <return value>\n<message>\n"
+
+  Program output only has digits, '-' and '\n', so the NUL byte ends it.
+  <status> and <message> are what `main` would exit with and print.
+
+  An input length of "-" streams the input instead: the rest of the
+  connection is `cin`, read as the program asks for it, and output is
+  flushed before each wait, so that a client can answer what it sees.
+
+  request  : "<program length> -\n" program input... (shutdown of writes)
+
+  Requests run on a pool of worker threads, each with its own VM state
+  (see cvm.c). With `--sessions`, each connection is a coroutine instead
+  (see coro.h) and the workers are event loops: a session waiting in
+  `cin` costs its stack and buffers, not a thread, so thousands of them
+  share a few threads. `--ir` and `--parallel-calls` are off in sessions,
+  their state is not swapped with the VM's. Compiled programs are kept in an LRU cache keyed by the
+  hash of the source; a compiled program is used by one request at a
+  time, so a busy program may be cached more than once.
+*/
+
+typedef struct {
+    const char * socket_path;
+    int n_workers;
+    size_t cache_capacity; // compiled programs kept
+    const char * cache_dir; // on-disk cache behind the LRU, may be NULL
+    int sessions; // connections are coroutines on `n_workers` event loops
+} Server_Config;
+
+// runs until SIGINT or SIGTERM, return 1 if the socket cannot be set up
+int server_run(Server_Config * config);
+// sends a request to a server and prints its response like `main` does;
+// `interactive` streams `is` as it is read and the output as it comes
+// @return the status of the run, or 1 if the server cannot be reached
+int client_run(const char * socket_path, const char * code_path, FILE * is, FILE * os, int interactive);
+
+#endif // SERVER_H_
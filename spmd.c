@@ -0,0 +1,718 @@
+#include <stdio.h> // io stream
+#include <stddef.h>
+#include <stdint.h> // uintptr_t
+#include <stdlib.h> // memory
+#include <string.h>
+#include <time.h> // clock_gettime
+#include <sys/resource.h> // getrlimit
+
+#include "spmd.h"
+#include "cvm.h"
+#include "dynarray.h"
+#include "tokenizer.h"
+#include "ast_builder.h"
+
+// @desc
+// the same walk as cvm.c over vectors of lanes, see spmd.h
+
+// gcc/clang vector extension: element-wise operators, compiled to the
+// widest SIMD the target has; comparisons give -1 (true) or 0 per lane
+// aligned as an int: lanes live in dynamic arrays, whose items malloc
+// only aligns to 16 bytes
+// passed by pointer: by value, the calling convention would depend on AVX
+typedef int Lanes __attribute__((vector_size(SPMD_LANES * sizeof(int)), aligned(sizeof(int))));
+
+typedef struct {
+    size_t * items;
+    size_t count;
+    size_t capacity;
+} Spmd_Dims;
+
+typedef struct {
+    Token iden;
+    Spmd_Dims dims; // empty for int
+
+    Lanes value; // for int
+    Lanes * values; // for int array, element-major, zero-initialized
+    size_t bytes; // of `values` in one lane, for the memory limit
+    Lanes declared; // mask of the lanes that declared a local
+} Spmd_Var;
+
+typedef struct {
+    Spmd_Var * items;
+    size_t count;
+    size_t capacity;
+} Spmd_Vars;
+
+typedef struct {
+    Spmd_Vars vars;
+    Lanes ret_val;
+    Lanes returned; // mask of the lanes that executed a `return`
+} Spmd_Frame;
+
+typedef struct {
+    Spmd_Frame * items;
+    size_t count;
+    size_t capacity;
+} Spmd_Stack;
+
+typedef struct {
+    Token iden;
+    AST_Node * def;
+} Spmd_Func;
+
+typedef struct {
+    Spmd_Func * items;
+    size_t count;
+    size_t capacity;
+} Spmd_Funcs;
+
+// per lane
+typedef struct {
+    char * items; // output
+    size_t count;
+    size_t capacity;
+    FILE * is;
+} Spmd_Lane;
+
+static Spmd_Vars globals = {};
+static Spmd_Funcs funcs = {};
+static Spmd_Stack stack = {};
+static Spmd_Lane lanes[SPMD_LANES] = {};
+
+// the resource limits of `cvm_config`, counted for the batch: it may exceed
+// one that none of its lanes does, then the cvm runs them again and knows
+static size_t steps = 0;
+static size_t memory = 0; // bytes of arrays alive in one lane
+static double start_time = 0;
+static const size_t CLOCK_PERIOD = 4096; // checks between reads of the clock
+static size_t clock_countdown = 0;
+// a call keeps kilobytes of vectors on the C stack, so a batch fails before
+// it uses half of it: deep recursion runs on the cvm, which needs far less
+static uintptr_t stack_base = 0;
+static size_t stack_budget = 0;
+
+static int spmd_eval(Lanes * ret_val, const Lanes * mask, AST_Node * node);
+static int spmd_execute_block(Lanes * mask, AST_Node * node);
+
+// lanes
+
+static int any(const Lanes * mask) {
+    for (int l = 0; l < SPMD_LANES; ++l) {
+        if ((*mask)[l]) return 1;
+    }
+    return 0;
+}
+
+// `l` gets `r` where the mask is set
+static void blend(Lanes * l, const Lanes * r, const Lanes * mask) {
+    *l = (*l & ~*mask) | (*r & *mask);
+}
+
+static void lane_write(size_t lane, const char * text) {
+    for (; *text; ++text) da_append(lanes + lane, *text);
+}
+
+// limits
+
+static double spmd_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// @return 1 if a limit is exceeded, as `cvm_check_limits`
+static int spmd_check_limits() {
+    if (cvm_config.max_steps && steps > cvm_config.max_steps) return 1;
+    if (cvm_config.max_time > 0 && clock_countdown-- == 0) {
+        clock_countdown = CLOCK_PERIOD;
+        if (spmd_now() - start_time > cvm_config.max_time) return 1;
+    }
+    return 0;
+}
+
+// names
+
+#define tokstrcmp(tok, str) (strlen(str) != (tok)->len || strncmp(str, (tok)->begin, (tok)->len))
+static int spmd_tokcmp(Token * l, Token * r) {
+    if (l->len != r->len) return 1;
+    return strncmp(l->begin, r->begin, l->len);
+}
+
+static Spmd_Var * spmd_find_var(Spmd_Vars * vars, Token * iden) {
+    for (size_t i = 0; i < vars->count; ++i) {
+        if (spmd_tokcmp(iden, &vars->items[i].iden) == 0) return vars->items + i;
+    }
+    return NULL;
+}
+
+static Spmd_Func * spmd_find_func(Token * iden) {
+    for (size_t i = 0; i < funcs.count; ++i) {
+        if (spmd_tokcmp(iden, &funcs.items[i].iden) == 0) return funcs.items + i;
+    }
+    return NULL;
+}
+
+static Spmd_Frame * spmd_frame() {
+    return stack.items + stack.count - 1;
+}
+
+// variables
+
+static int spmd_declare(Spmd_Vars * vars, AST_Node * node, const Lanes * mask) {
+    // @assert node->count > 0
+    Spmd_Var newvar = {*node->items[0].token, .declared = *mask};
+    if (node->count > 1) {
+        size_t size = 1;
+        int overflow = 0;
+        for (size_t i = 1; i < node->count; ++i) {
+            size_t dim;
+            // @assert the integer literal is followed by a non-digit char
+            sscanf(node->items[i].token->begin, "%zu", &dim);
+            overflow |= __builtin_mul_overflow(size, dim, &size);
+            da_append(&newvar.dims, dim);
+        }
+        // a wrapped size would be indexed out of bounds; calloc checks the bytes
+        if (overflow || __builtin_mul_overflow(size, sizeof(int), &newvar.bytes) ||
+            (cvm_config.max_memory && memory + newvar.bytes > cvm_config.max_memory)) {
+            da_free(&newvar.dims);
+            return 1;
+        }
+        newvar.values = (Lanes *)calloc(size ? size : 1, sizeof(Lanes));
+        if (!newvar.values) {
+            da_free(&newvar.dims);
+            return 1;
+        }
+        memory += newvar.bytes;
+    }
+    da_append(vars, newvar);
+    return 0;
+}
+
+static void spmd_free_vars(Spmd_Vars * vars) {
+    for (size_t i = 0; i < vars->count; ++i) {
+        if (vars->items[i].values) memory -= vars->items[i].bytes;
+        free(vars->items[i].values);
+        da_free(&vars->items[i].dims);
+    }
+    da_free(vars);
+}
+
+static void spmd_cleanup() {
+    spmd_free_vars(&globals);
+    for (size_t i = 0; i < stack.count; ++i) spmd_free_vars(&stack.items[i].vars);
+    da_free(&stack);
+    da_free(&funcs);
+}
+
+// the first local of the frame declared in one of the lanes of `mask`
+static Spmd_Var * spmd_find_local(const Lanes * mask, Token * iden) {
+    Spmd_Vars * vars = &spmd_frame()->vars;
+    for (size_t i = 0; i < vars->count; ++i) {
+        Lanes in = vars->items[i].declared & *mask;
+        if (any(&in) && spmd_tokcmp(iden, &vars->items[i].iden) == 0) return vars->items + i;
+    }
+    return NULL;
+}
+
+// as the cvm, which has no block scope, a name is the first local declared
+// in a lane, else the global; `mask` must name the same variable in all lanes
+static Spmd_Var * spmd_lookup(const Lanes * mask, Token * iden) {
+    Spmd_Var * var = spmd_find_local(mask, iden);
+    if (!var) var = spmd_find_var(&globals, iden);
+    return var;
+}
+
+// the lanes of `mask` in which `iden` names the same variable as in the
+// first of them, for a local declared in a branch that only some lanes took
+// @return 1 if that is not all of `mask`
+static int spmd_split(Lanes * same, const Lanes * mask, Token * iden) {
+    Spmd_Var * var = spmd_find_local(mask, iden);
+    if (!var) return 0;
+    *same = *mask & var->declared;
+    Lanes rest = *mask & ~same[0];
+    return any(&rest);
+}
+
+// the flat index of an array element in each active lane
+// @return NULL on error, else the variable
+static Spmd_Var * spmd_locate(Lanes * index, const Lanes * mask, AST_Node * node) {
+    // @assert node->type == 'VARR'
+    Spmd_Var * var = spmd_lookup(mask, node->items[0].token);
+    if (!var) return NULL;
+    *index = (Lanes) {};
+    if (node->count == 1) return var; // int
+    if (node->count - 1 != var->dims.count) return NULL;
+    size_t postfix_hypervolume = 1;
+    for (int i = var->dims.count - 1; i >= 0; --i) {
+        Lanes sub;
+        if (spmd_eval(&sub, mask, node->items + i + 1)) return NULL;
+        if (cvm_config.checked) {
+            for (int l = 0; l < SPMD_LANES; ++l) {
+                // the cvm reports it when the batch is run again
+                if ((*mask)[l] && (sub[l] < 0 || (size_t)sub[l] >= var->dims.items[i])) return NULL;
+            }
+        }
+        *index += (int)postfix_hypervolume * sub;
+        postfix_hypervolume *= var->dims.items[i];
+    }
+    return var;
+}
+
+static int spmd_load(Lanes * ret_val, const Lanes * mask, AST_Node * node) {
+    Lanes index;
+    Spmd_Var * var = spmd_locate(&index, mask, node);
+    if (!var) return 1;
+    if (node->count == 1) { // int
+        *ret_val = var->value;
+        return 0;
+    }
+    // one vector if the subscripts agree, else a gather of the active lanes
+    int l0 = 0;
+    while (l0 < SPMD_LANES && !(*mask)[l0]) ++l0;
+    if (l0 == SPMD_LANES) return 0;
+    Lanes differ = (index != index[l0]) & *mask;
+    if (!any(&differ)) {
+        *ret_val = var->values[(unsigned)index[l0]];
+        return 0;
+    }
+    for (int l = 0; l < SPMD_LANES; ++l) {
+        if ((*mask)[l]) (*ret_val)[l] = var->values[(unsigned)index[l]][l];
+    }
+    return 0;
+}
+
+static void spmd_store(Spmd_Var * var, AST_Node * node, const Lanes * index, const Lanes * value,
+                       const Lanes * mask) {
+    if (node->count == 1) { // int
+        blend(&var->value, value, mask);
+        return;
+    }
+    for (int l = 0; l < SPMD_LANES; ++l) {
+        if ((*mask)[l]) var->values[(unsigned)(*index)[l]][l] = (*value)[l];
+    }
+}
+
+// control flow
+
+static int spmd_call(Lanes * ret_val, const Lanes * mask, Spmd_Func * func, Spmd_Vars args) {
+    if (func->def->items[func->def->count - 1].type == 'LAZY' && ast_parse_lazy(func->def)) {
+        spmd_free_vars(&args);
+        return 1;
+    }
+    char here;
+    if (spmd_check_limits() || stack_base - (uintptr_t)&here > stack_budget ||
+        (cvm_config.max_depth && stack.count >= cvm_config.max_depth)) {
+        spmd_free_vars(&args);
+        return 1;
+    }
+    da_append(&stack, ((Spmd_Frame) {.vars = args}));
+    AST_Node * block = func->def->items + func->def->count - 1;
+    Lanes active = *mask;
+    int status = spmd_execute_block(&active, block);
+    // lanes that did not return get 0, as in `cvm_call`
+    if (ret_val) *ret_val = spmd_frame()->ret_val;
+    spmd_free_vars(&spmd_frame()->vars);
+    stack.count -= 1;
+    return status;
+}
+
+// runs `node` in the lanes of `mask`, from which lanes that return are removed
+// @return 0 if success, 1 if error
+static int spmd_execute_stmt(Lanes * mask, AST_Node * node) {
+    int status = 0;
+    steps += 1;
+    switch (node->type) {
+    case 'DECL': {
+        status = spmd_declare(&spmd_frame()->vars, node, mask);
+    } break;
+    case 'EXPS': {
+        // @assert node->count == 1
+        status = spmd_eval(NULL, mask, node->items + 0);
+        if (status == 2 || status == 3) status = 0; // eval to cin/cout
+    } break;
+    case 'IFEL': {
+        // @assert node->count == 2 or 3
+        Lanes cond;
+        status = spmd_eval(&cond, mask, node->items + 0);
+        if (status) break;
+        Lanes taken = *mask & (cond != 0);
+        Lanes other = *mask & (cond == 0);
+        for (int b = 1; b < node->count && !status; ++b) {
+            Lanes * branch_mask = b == 1 ? &taken : &other;
+            if (!any(branch_mask)) continue;
+            AST_Node * branch = node->items + b;
+            if (branch->type == 'BLCK') status = spmd_execute_block(branch_mask, branch);
+            else status = spmd_execute_stmt(branch_mask, branch);
+        }
+    } break;
+    case 'WHIL': {
+        // @assert node->count == 2
+        // the loop runs until no lane is left in it
+        Lanes active = *mask;
+        while (1) {
+            Lanes cond;
+            status = spmd_eval(&cond, &active, node->items + 0);
+            if (status) break;
+            active &= cond != 0;
+            if (!any(&active)) break;
+            steps += 1; // an iteration, as in `cvm_execute_stmt`
+            if (node->items[1].type == 'BLCK') status = spmd_execute_block(&active, node->items + 1);
+            else status = spmd_execute_stmt(&active, node->items + 1);
+            if (status || (status = spmd_check_limits())) break; // back-edge
+        }
+    } break;
+    case 'RETN': {
+        // @assert node->count == 1
+        Lanes value = {};
+        status = spmd_eval(&value, mask, node->items + 0);
+        if (status) break;
+        Spmd_Frame * frame = spmd_frame();
+        blend(&frame->ret_val, &value, mask);
+        frame->returned |= *mask;
+    } break;
+    default: status = 1; // @assert unreachable
+    }
+    *mask &= ~spmd_frame()->returned;
+    return status;
+}
+
+static int spmd_execute_block(Lanes * mask, AST_Node * node) {
+    for (size_t i = 0; i < node->count && any(mask); ++i) {
+        if (spmd_execute_stmt(mask, node->items + i)) return 1;
+    }
+    return 0;
+}
+
+// expressions
+
+// division by zero is undefined as in the cvm, but only for active lanes
+static void spmd_divide(Lanes * res, const Lanes * l, const Lanes * r, const Lanes * mask, int is_mod) {
+    *res = (Lanes) {};
+    for (int k = 0; k < SPMD_LANES; ++k) {
+        if ((*mask)[k]) (*res)[k] = is_mod ? (*l)[k] % (*r)[k] : (*l)[k] / (*r)[k];
+    }
+}
+
+// a binary operator, as `spmd_eval`: apart from it, the vectors of its
+// operands take no C stack in each level of a recursion
+static int spmd_eval_biop(Lanes * ret_val, const Lanes * mask, AST_Node * node) {
+    // @assert node->count == 2
+    if (tokstrcmp(node->token, "<<") == 0) {
+        if (!node->items[0].items[0].token ||
+            tokstrcmp(node->items[0].items[0].token, "cout") != 0) {
+            if (spmd_eval(NULL, mask, node->items + 0) != 2) return 1; // cout
+        }
+        if (node->items[1].items[0].token &&
+            tokstrcmp(node->items[1].items[0].token, "endl") == 0) {
+            for (int l = 0; l < SPMD_LANES; ++l) {
+                if ((*mask)[l]) lane_write(l, "\n");
+            }
+            return 2; // return cout
+        }
+        Lanes r;
+        if (spmd_eval(&r, mask, node->items + 1)) return 1;
+        for (int l = 0; l < SPMD_LANES; ++l) {
+            if (!(*mask)[l]) continue;
+            char text[16];
+            snprintf(text, sizeof(text), "%d", r[l]);
+            lane_write(l, text);
+        }
+        return 2; // return cout
+    } else if (tokstrcmp(node->token, ">>") == 0) {
+        if (!node->items[0].items[0].token ||
+            tokstrcmp(node->items[0].items[0].token, "cin") != 0) {
+            if (spmd_eval(NULL, mask, node->items + 1) != 3) return 1; // cin
+        }
+        Lanes index, value;
+        Spmd_Var * var = spmd_locate(&index, mask, node->items + 1);
+        if (!var || spmd_load(&value, mask, node->items + 1)) return 1;
+        for (int l = 0; l < SPMD_LANES; ++l) {
+            if ((*mask)[l]) fscanf(lanes[l].is, "%d", &value[l]); // unchanged on fail
+        }
+        spmd_store(var, node->items + 1, &index, &value, mask);
+        return 3; // return cin
+    } else if (tokstrcmp(node->token, "=") == 0) {
+        if (node->items[0].type != 'VARR') return 1;
+        Lanes index;
+        Spmd_Var * var = spmd_locate(&index, mask, node->items + 0);
+        if (!var) return 1;
+        Lanes r;
+        if (spmd_eval(&r, mask, node->items + 1)) return 1;
+        spmd_store(var, node->items + 0, &index, &r, mask);
+        if (ret_val) *ret_val = r;
+        return 0;
+    } else if (!cvm_config.eager_logic &&
+               (tokstrcmp(node->token, "&&") == 0 ||
+                tokstrcmp(node->token, "||") == 0)) {
+        // short circuit per lane: the right operand runs in the lanes it decides
+        int is_and = node->token->begin[0] == '&';
+        Lanes l, r = {};
+        if (spmd_eval(&l, mask, node->items + 0)) return 1;
+        Lanes undecided = *mask & (is_and ? l != 0 : l == 0);
+        if (any(&undecided) && spmd_eval(&r, &undecided, node->items + 1)) return 1;
+        if (ret_val) *ret_val = (is_and ? (l != 0) & (r != 0) : (l != 0) | (r != 0)) & 1;
+        return 0;
+    }
+
+    Lanes l, r;
+    if (spmd_eval(&l, mask, node->items + 0)) return 1;
+    if (spmd_eval(&r, mask, node->items + 1)) return 1;
+    if (!ret_val) return 0;
+
+    // unsigned so that overflow wraps around like the cvm in practice
+    typedef unsigned Ulanes __attribute__((vector_size(sizeof(Lanes)), aligned(sizeof(int))));
+    if (tokstrcmp(node->token, "*") == 0) {
+        *ret_val = (Lanes)((Ulanes)l * (Ulanes)r);
+    } else if (tokstrcmp(node->token, "/") == 0) {
+        spmd_divide(ret_val, &l, &r, mask, 0);
+    } else if (tokstrcmp(node->token, "%") == 0) {
+        spmd_divide(ret_val, &l, &r, mask, 1);
+    } else if (tokstrcmp(node->token, "+") == 0) {
+        *ret_val = (Lanes)((Ulanes)l + (Ulanes)r);
+    } else if (tokstrcmp(node->token, "-") == 0) {
+        *ret_val = (Lanes)((Ulanes)l - (Ulanes)r);
+    } else if (tokstrcmp(node->token, "<=") == 0) {
+        *ret_val = (l <= r) & 1;
+    } else if (tokstrcmp(node->token, ">=") == 0) {
+        *ret_val = (l >= r) & 1;
+    } else if (tokstrcmp(node->token, "<") == 0) {
+        *ret_val = (l < r) & 1;
+    } else if (tokstrcmp(node->token, ">") == 0) {
+        *ret_val = (l > r) & 1;
+    } else if (tokstrcmp(node->token, "==") == 0) {
+        *ret_val = (l == r) & 1;
+    } else if (tokstrcmp(node->token, "!=") == 0) {
+        *ret_val = (l != r) & 1;
+    } else if (tokstrcmp(node->token, "^") == 0) {
+        *ret_val = ((l != 0) ^ (r != 0)) & 1;
+    } else if (tokstrcmp(node->token, "&&") == 0) {
+        *ret_val = (l != 0) & (r != 0) & 1;
+    } else if (tokstrcmp(node->token, "||") == 0) {
+        *ret_val = ((l != 0) | (r != 0)) & 1;
+    } else {
+        return 1; // @assert unreachable
+    }
+    return 0;
+}
+
+// the variable that `node` assigns or reads into with `cin`, if any
+static AST_Node * spmd_assigned(AST_Node * node) {
+    if (node->type != 'BIOP') return NULL;
+    AST_Node * target = NULL;
+    if (tokstrcmp(node->token, "=") == 0) target = node->items + 0;
+    if (tokstrcmp(node->token, ">>") == 0) target = node->items + 1;
+    return target && target->type == 'VARR' ? target : NULL;
+}
+
+// @return as `cvm_eval_expr`: 0 for evaluated to int, 1 for error, 2 for cout, 3 for cin
+// lanes outside of `mask` get unspecified values in `ret_val`
+static int spmd_eval(Lanes * ret_val, const Lanes * mask, AST_Node * node) {
+    int status = 0;
+    AST_Node * target = node->type == 'VARR' ? node : spmd_assigned(node);
+    Lanes same;
+    if (target && spmd_split(&same, mask, target->items[0].token)) {
+        // the other lanes name another variable, they run apart
+        Lanes rest = *mask & ~same, r = {};
+        status = spmd_eval(ret_val, &same, node);
+        if (status == 1 || spmd_eval(ret_val ? &r : NULL, &rest, node) == 1) return 1;
+        if (ret_val) blend(ret_val, &r, &rest);
+        return status;
+    }
+    switch (node->type) {
+    case 'EXPR': return spmd_eval(ret_val, mask, node->items + 0);
+    case 'VARR': {
+        Lanes value = {};
+        status = spmd_load(&value, mask, node);
+        if (!status && ret_val) *ret_val = value;
+    } break;
+    case 'CALL': {
+        Spmd_Func * func = spmd_find_func(node->items[0].token);
+        if (!func || node->count + 1 != func->def->count) {
+            status = 1;
+            break;
+        }
+        Spmd_Vars args = {};
+        for (int i = 1; i < node->count; ++i) {
+            Lanes thisarg = {};
+            status = spmd_eval(&thisarg, mask, node->items + i);
+            if (status) break;
+            da_append(&args, ((Spmd_Var) {.iden = *func->def->items[i].token, .value = thisarg,
+                                          .declared = *mask}));
+        }
+        if (status) {
+            spmd_free_vars(&args);
+            break;
+        }
+        status = spmd_call(ret_val, mask, func, args);
+    } break;
+    case 'INTG': {
+        if (ret_val) {
+            int value;
+            sscanf(node->items[node->count - 1].token->begin, "%d", &value);
+            if (node->count == 2 && node->items[0].token->begin[0] == '-') value *= -1;
+            *ret_val = (Lanes) {} + value;
+        }
+    } break;
+    case 'UPOP': {
+        // @assert node->token is "!"
+        Lanes val;
+        status = spmd_eval(&val, mask, node->items + 0);
+        if (status) break;
+        if (ret_val) *ret_val = (val == 0) & 1;
+    } break;
+    case 'BIOP': status = spmd_eval_biop(ret_val, mask, node); break;
+    default: status = 1;
+    }
+    return status;
+}
+
+// entry points
+
+int spmd_run(int * ret_vals, AST_Node * ast, FILE ** is, size_t n_lanes) {
+    Lanes mask = {};
+    steps = 0;
+    start_time = spmd_now();
+    clock_countdown = CLOCK_PERIOD;
+    // the stack of the main thread, on which `--spmd` runs
+    char base;
+    struct rlimit rl;
+    stack_base = (uintptr_t)&base;
+    stack_budget = getrlimit(RLIMIT_STACK, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY ? rl.rlim_cur / 2 : 4 << 20;
+    for (size_t l = 0; l < SPMD_LANES; ++l) {
+        lanes[l].count = 0;
+        lanes[l].is = l < n_lanes ? is[l] : NULL;
+        if (l < n_lanes) mask[l] = -1;
+    }
+    int status = 0;
+    for (AST_Node * node = ast->items; node - ast->items < ast->count && !status; ++node) {
+        switch (node->type) {
+        case 'DECL': {
+            status = spmd_declare(&globals, node, &mask);
+        } break;
+        case 'FUNC': {
+            // @assert node->count > 0
+            da_append(&funcs, ((Spmd_Func) {.iden = *node->items[0].token, .def = node}));
+        } break;
+        } // switch
+    }
+
+    const char * entry_point_name = "main";
+    Token entry_point_token = {entry_point_name, strlen(entry_point_name)};
+    Spmd_Func * entry_point = spmd_find_func(&entry_point_token);
+    Lanes ret_val = {};
+    if (!status && entry_point) {
+        status = spmd_call(&ret_val, &mask, entry_point, (Spmd_Vars) {});
+    } else {
+        status = 1;
+    }
+    for (size_t l = 0; l < n_lanes && !status; ++l) ret_vals[l] = ret_val[l];
+    spmd_cleanup();
+    return status;
+}
+
+const char * spmd_output(size_t lane, size_t * len) {
+    *len = lanes[lane].count;
+    return lanes[lane].items;
+}
+
+// the input paths of a list file, heap alloc'ed
+typedef struct {
+    char ** items;
+    size_t count;
+    size_t capacity;
+} Spmd_Paths;
+
+static int spmd_read_list(Spmd_Paths * paths, const char * list_path) {
+    FILE * fp = fopen(list_path, "r");
+    if (!fp) return 1;
+    char * line = NULL;
+    size_t len = 0;
+    ssize_t n;
+    while ((n = getline(&line, &len, fp)) != -1) {
+        while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) line[--n] = '\0';
+        if (n > 0) da_append(paths, strdup(line));
+    }
+    free(line);
+    fclose(fp);
+    return 0;
+}
+
+static FILE * spmd_open_output(const char * input) {
+    size_t len = strlen(input);
+    char * path = (char *)malloc(len + 5);
+    memcpy(path, input, len);
+    memcpy(path + len, ".out", 5);
+    FILE * os = fopen(path, "w");
+    if (!os) printf("ERROR: Cannot open output file %s.\n", path);
+    free(path);
+    return os;
+}
+
+// one input on the cvm, after a failed batch: reports the error like a plain run
+static int spmd_run_scalar(AST_Node * ast, const char * input, FILE * is) {
+    FILE * os = spmd_open_output(input);
+    if (!os) return 1;
+    rewind(is);
+    int ret_val = -1;
+    int status = cvm_run(&ret_val, ast, is, os);
+    fclose(os);
+    if (status == CVM_STATUS_LIMIT) {
+        printf("%s: CVM aborted: %s\n", input, cvm_errmsg);
+    } else if (status && cvm_errmsg) {
+        printf("%s: CVM runtime error: %s\n", input, cvm_errmsg);
+    } else if (status) {
+        printf("%s: CVM exited abnormally. Syntax error in source file.\n", input);
+    } else {
+        printf("%s: CVM exited successfully with return value %d\n", input, ret_val);
+    }
+    return status;
+}
+
+int spmd_run_files(AST_Node * ast, const char * list_path) {
+    Spmd_Paths paths = {};
+    if (spmd_read_list(&paths, list_path)) {
+        printf("ERROR: Cannot open input list %s.\n", list_path);
+        return 1;
+    }
+    int failed = 0;
+    for (size_t first = 0; first < paths.count; first += SPMD_LANES) {
+        size_t n = paths.count - first < SPMD_LANES ? paths.count - first : SPMD_LANES;
+        FILE * is[SPMD_LANES] = {};
+        int opened = 1;
+        for (size_t l = 0; l < n; ++l) {
+            is[l] = fopen(paths.items[first + l], "r");
+            if (!is[l]) {
+                printf("ERROR: Cannot open input file %s.\n", paths.items[first + l]);
+                opened = 0;
+            }
+        }
+        int ret_vals[SPMD_LANES];
+        int status = opened ? spmd_run(ret_vals, ast, is, n) : 1;
+        for (size_t l = 0; l < n; ++l) {
+            const char * input = paths.items[first + l];
+            if (!is[l]) {
+                failed = 1;
+                continue;
+            }
+            if (status) {
+                failed |= spmd_run_scalar(ast, input, is[l]) != 0;
+            } else {
+                FILE * os = spmd_open_output(input);
+                size_t len;
+                const char * output = spmd_output(l, &len);
+                if (os) {
+                    fwrite(output, 1, len, os);
+                    fclose(os);
+                    printf("%s: CVM exited successfully with return value %d\n", input, ret_vals[l]);
+                }
+                failed |= !os;
+            }
+            fclose(is[l]);
+        }
+    }
+    for (size_t i = 0; i < paths.count; ++i) free(paths.items[i]);
+    da_free(&paths);
+    for (size_t l = 0; l < SPMD_LANES; ++l) da_free(lanes + l);
+    return failed;
+}
@@ -0,0 +1,44 @@
+#ifndef SPMD_H_
+#define SPMD_H_
+
+#include <stdio.h> // FILE
+#include <stddef.h> // size_t
+
+#include "ast_builder.h"
+
+/*
+  @def SPMD execution
+
+  One program over many inputs, `SPMD_LANES` instances in lockstep: every
+  `int` is a vector with one value per lane, and operators work on whole
+  vectors. An execution mask says which lanes run the current statement:
+  a divergent `if` runs both branches under complementary masks, a `while`
+  loops until the condition is false in every lane, a lane that returns
+  stays masked off until the end of the function. `cin` reads the input of
+  each lane, `cout` appends to its output.
+
+  Arrays hold the lanes of an element side by side, so a subscript that is
+  the same in every lane reads one vector. Each lane costs its own copy of
+  every array.
+
+  The loop optimizer, kernels, traces and profiles are for the scalar cvm
+  only. The resource limits are counted for the whole batch, which fails
+  when it exceeds one: the cvm then runs its inputs one at a time.
+*/
+
+#define SPMD_LANES 8
+
+// runs `n_lanes` (at most SPMD_LANES) instances of `ast`, lane k reads `is[k]`
+// @return 0 if every lane succeeded, then `ret_vals` and `spmd_output` are set,
+// 1 on any error in any lane, in which case nothing was written
+int spmd_run(int * ret_vals, AST_Node * ast, FILE ** is, size_t n_lanes);
+// the output of lane k of the last `spmd_run`, valid until the next one
+const char * spmd_output(size_t lane, size_t * len);
+
+// `--spmd`: runs `ast` over each input path listed in `list_path`, one per
+// line, writing the output next to it as `<input>.out`; a batch with an
+// error is run again one input at a time by the cvm, which reports it
+// @return 0 if every input ran successfully
+int spmd_run_files(AST_Node * ast, const char * list_path);
+
+#endif // SPMD_H_
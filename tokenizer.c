@@ -53,6 +53,14 @@ void Tokenizer_print_around(Tokenizer * t, size_t index, size_t halflen) {
     printf("...%.*s...\n", (int)len, t->buffer + start);
 }
 
+size_t Tokenizer_line_of(Tokenizer * t, const char * p) {
+    size_t line = 1;
+    for (const char * c = t->buffer; c < p && *c; ++c) {
+        if (*c == '\n') line += 1;
+    }
+    return line;
+}
+
 size_t parse_token(const char * view, const char ** p_errmsg) {
     const char ctoks[][3] = { // fixed tokens enumerated
         "<=", ">=", "==", "!=", "&&", "||", "<<", ">>",
@@ -23,6 +23,7 @@ typedef struct {
 int Tokenizer_read_file(Tokenizer * t, const char * path);
 void Tokenizer_free(Tokenizer * t);
 void Tokenizer_print_around(Tokenizer * t, size_t index, size_t halflen);
+size_t Tokenizer_line_of(Tokenizer * t, const char * p); // 1-based line of a char in buffer
 int Tokenizer_tokenize(Tokenizer * t); // return 1 if tokenizer fails
 
 #endif // TOKENIZER_H_
@@ -0,0 +1,98 @@
+#include <stdio.h> // file
+#include <stddef.h> // size_t
+#include <stdint.h>
+#include <stdlib.h> // memory
+#include <string.h> // memcpy
+
+#include "trace.h"
+#include "dynarray.h"
+#include "tokenizer.h"
+
+Trace_Ring trace_ring = {};
+
+static struct {
+    Token * items; // weak refs into the source, like the tokens
+    size_t count;
+    size_t capacity;
+} trace_names = {};
+
+int trace_open(size_t capacity, int loops, const char * source) {
+    size_t rounded = 1;
+    while (rounded < capacity) rounded *= 2;
+    Trace_Event * items = (Trace_Event *)malloc(rounded * sizeof(Trace_Event));
+    if (!items) return 1;
+    trace_ring = (Trace_Ring) {
+        .items = items,
+        .mask = rounded - 1,
+        .loops = loops,
+        .source = source,
+        .start = trace_clock(),
+    };
+    return 0;
+}
+
+uint32_t trace_name(const char * name, size_t len) {
+    if (!trace_ring.items) return 0;
+    da_append(&trace_names, ((Token) {name, len}));
+    return trace_names.count - 1;
+}
+
+// 1-based line of each loop, one pass over the source for all of them
+static void trace_resolve_lines(Trace_Event * events, size_t n, const char * source) {
+    size_t max_offset = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (events[i].kind == TRACE_LOOP && events[i].id > max_offset) max_offset = events[i].id;
+    }
+    uint32_t * lines = (uint32_t *)malloc((max_offset + 1) * sizeof(uint32_t));
+    uint32_t line = 1;
+    for (size_t i = 0; i <= max_offset; ++i) {
+        lines[i] = line;
+        if (source[i] == '\n') line += 1;
+        else if (source[i] == '\0') break;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (events[i].kind == TRACE_LOOP) events[i].id = lines[events[i].id];
+    }
+    free(lines);
+}
+
+int trace_write(const char * path) {
+    if (!trace_ring.items) return 1;
+    size_t capacity = trace_ring.mask + 1;
+    size_t n = trace_ring.count < capacity ? trace_ring.count : capacity;
+    size_t first = trace_ring.count - n;
+    Trace_Event * events = (Trace_Event *)malloc((n ? n : 1) * sizeof(Trace_Event));
+    for (size_t i = 0; i < n; ++i) {
+        events[i] = trace_ring.items[(first + i) & trace_ring.mask];
+    }
+    trace_resolve_lines(events, n, trace_ring.source);
+
+    Trace_Header header = {
+        .magic = TRACE_MAGIC,
+        .version = TRACE_VERSION,
+        .n_names = trace_names.count,
+        .n_events = n,
+        .dropped = first,
+    };
+    FILE * fp = fopen(path, "wb");
+    if (!fp) {
+        free(events);
+        return 1;
+    }
+    int failed = fwrite(&header, sizeof(header), 1, fp) != 1;
+    for (size_t i = 0; i < trace_names.count && !failed; ++i) {
+        uint32_t len = trace_names.items[i].len;
+        failed = fwrite(&len, sizeof(len), 1, fp) != 1 ||
+            fwrite(trace_names.items[i].begin, 1, len, fp) != len;
+    }
+    if (!failed && n) failed = fwrite(events, sizeof(Trace_Event), n, fp) != n;
+    free(events);
+    if (fclose(fp)) failed = 1;
+    return failed;
+}
+
+void trace_close() {
+    free(trace_ring.items);
+    trace_ring = (Trace_Ring) {};
+    da_free(&trace_names);
+}
@@ -0,0 +1,83 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stddef.h> // size_t
+#include <stdint.h>
+#include <time.h> // clock_gettime
+
+/*
+  @def Event trace
+
+  Events are fixed size records written into a ring buffer, nothing is
+  formatted while the program runs. When the ring is full the oldest
+  events are overwritten. `trace_write` dumps the ring in order:
+
+  header
+  Name   : {uint32 len, char[len]} * n_names, function names by id
+  Event  : Trace_Event * n_events, oldest first
+
+  `trace2json` converts a dump to Chrome trace-event JSON.
+*/
+
+#define TRACE_MAGIC "CVMT"
+#define TRACE_VERSION 1
+
+enum {
+    TRACE_CALL = 1, // id: function
+    TRACE_RETURN, // id: function, value: returned value
+    TRACE_CIN, // value: read
+    TRACE_COUT, // id: 0 for an int, 1 for `endl`, value: written
+    TRACE_LOOP, // an iteration, id: offset of `while` in the source, a line in dumps
+};
+
+typedef struct {
+    uint64_t ts; // ns since `trace_open`
+    uint32_t kind;
+    uint32_t id;
+    int32_t value;
+    uint32_t reserved;
+} Trace_Event;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t n_names;
+    uint32_t reserved;
+    uint64_t n_events;
+    uint64_t dropped; // overwritten events
+} Trace_Header;
+
+typedef struct {
+    Trace_Event * items; // NULL when not tracing
+    size_t mask; // capacity - 1, capacity is a power of 2
+    size_t count; // events ever recorded
+    int loops; // record loop iterations too
+    const char * source; // TRACE_LOOP offsets are relative to it
+    uint64_t start; // ns
+} Trace_Ring;
+
+extern Trace_Ring trace_ring;
+
+static inline uint64_t trace_clock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// the hot path: a no-op unless tracing
+static inline void trace_event(uint32_t kind, uint32_t id, int32_t value) {
+    if (!trace_ring.items) return;
+    Trace_Event * e = trace_ring.items + (trace_ring.count++ & trace_ring.mask);
+    *e = (Trace_Event) {trace_clock() - trace_ring.start, kind, id, value};
+}
+
+// `capacity` is rounded up to a power of 2, return 1 on fail
+// `source` is the program text the AST refers to, it must outlive the trace
+int trace_open(size_t capacity, int loops, const char * source);
+// id of a function name for TRACE_CALL and TRACE_RETURN, 0 if not tracing
+uint32_t trace_name(const char * name, size_t len);
+// return 1 on fail
+int trace_write(const char * path);
+void trace_close();
+
+#endif // TRACE_H_
@@ -0,0 +1,107 @@
+// converts a `--trace` dump to Chrome trace-event JSON (chrome://tracing, Perfetto)
+
+#include <stdio.h>
+#include <stddef.h> // size_t
+#include <stdint.h>
+#include <stdlib.h> // memory
+#include <string.h> // memcmp
+
+#include "trace.h"
+
+typedef struct {
+    char * name;
+    uint32_t len;
+} Name;
+
+static void print_event(FILE * os, const char * name, int name_len, const char * ph, uint64_t ts) {
+    fprintf(os, "{\"name\":\"%.*s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":1",
+            name_len, name, ph, ts / 1000.0);
+}
+
+int main(int argc, char ** argv) {
+    if (argc < 2) {
+        printf("Usage: %s <trace-file> [<json-file>]\n", argv[0]);
+        return 1;
+    }
+    FILE * is = fopen(argv[1], "rb");
+    if (!is) {
+        printf("ERROR: Open trace file %s failed.\n", argv[1]);
+        return 1;
+    }
+    FILE * os = stdout;
+    if (argc >= 3) {
+        os = fopen(argv[2], "w");
+        if (!os) {
+            printf("ERROR: Open output file %s failed.\n", argv[2]);
+            return 1;
+        }
+    }
+
+    Trace_Header header;
+    if (fread(&header, sizeof(header), 1, is) != 1 ||
+        memcmp(header.magic, TRACE_MAGIC, 4) || header.version != TRACE_VERSION) {
+        printf("ERROR: %s is not a trace file.\n", argv[1]);
+        return 1;
+    }
+    Name * names = (Name *)calloc(header.n_names + 1, sizeof(Name));
+    for (uint32_t i = 0; i < header.n_names; ++i) {
+        if (fread(&names[i].len, sizeof(uint32_t), 1, is) != 1) goto truncated;
+        names[i].name = (char *)malloc(names[i].len + 1);
+        if (fread(names[i].name, 1, names[i].len, is) != names[i].len) goto truncated;
+    }
+
+    fprintf(os, "{\"traceEvents\":[\n");
+    // when the ring wrapped, the oldest calls are gone: drop their returns
+    size_t depth = 0;
+    int first = 1;
+    for (uint64_t i = 0; i < header.n_events; ++i) {
+        Trace_Event e;
+        if (fread(&e, sizeof(e), 1, is) != 1) goto truncated;
+        if ((e.kind == TRACE_CALL || e.kind == TRACE_RETURN) && e.id >= header.n_names) continue;
+        if (e.kind == TRACE_RETURN && depth == 0) continue;
+        if (!first) fprintf(os, ",\n");
+        first = 0;
+        switch (e.kind) {
+        case TRACE_CALL: {
+            depth += 1;
+            print_event(os, names[e.id].name, names[e.id].len, "B", e.ts);
+        } break;
+        case TRACE_RETURN: {
+            depth -= 1;
+            print_event(os, names[e.id].name, names[e.id].len, "E", e.ts);
+            fprintf(os, ",\"args\":{\"value\":%d}", e.value);
+        } break;
+        case TRACE_CIN: {
+            print_event(os, "cin", 3, "i", e.ts);
+            fprintf(os, ",\"s\":\"t\",\"args\":{\"value\":%d}", e.value);
+        } break;
+        case TRACE_COUT: {
+            print_event(os, "cout", 4, "i", e.ts);
+            if (e.id) fprintf(os, ",\"s\":\"t\",\"args\":{\"value\":\"endl\"}");
+            else fprintf(os, ",\"s\":\"t\",\"args\":{\"value\":%d}", e.value);
+        } break;
+        case TRACE_LOOP: {
+            char name[32];
+            int len = snprintf(name, sizeof(name), "while (line %u)", e.id);
+            print_event(os, name, len, "i", e.ts);
+            fprintf(os, ",\"s\":\"t\"");
+        } break;
+        default: {
+            print_event(os, "unknown", 7, "i", e.ts);
+            fprintf(os, ",\"s\":\"t\",\"args\":{\"kind\":%u}", e.kind);
+        } break;
+        }
+        fprintf(os, "}");
+    }
+    fprintf(os, "\n],\"otherData\":{\"dropped\":%llu}}\n", (unsigned long long)header.dropped);
+
+    for (uint32_t i = 0; i < header.n_names; ++i) free(names[i].name);
+    free(names);
+    fclose(is);
+    if (os != stdout) fclose(os);
+    return 0;
+
+truncated:
+    printf("ERROR: %s is truncated.\n", argv[1]);
+    return 1;
+}